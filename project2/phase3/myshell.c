@@ -1,6 +1,7 @@
 /* $begin shellmain */
 #include "csapp.h"
 #include <termios.h>
+#include "log.h"
 #define MAXARGS   128
 #define MAXCMDS 10
 #define MAXJOBS 128
@@ -50,6 +51,10 @@ job_t *find_job_by_id(int job_id);
 job_t *find_job_by_pgid(pid_t pgid);
 void list_jobs();
 
+// MYSHELL_LOG가 있을 때 job 이벤트 기록
+void open_log(void);
+void log_job(const char *event, int job_id, pid_t pgid, const char *cmdline);
+
 // fg, bg 실행 함수
 void do_fg(int job_id);
 void do_bg(int job_id);
@@ -183,6 +188,7 @@ int main()
     Signal(SIGTSTP, sigtstp_handler);
     Signal(SIGCHLD, sigchld_handler);
     Signal(SIGTTOU, SIG_IGN);
+    open_log();
 
     char cmdline[MAXLINE]; /* Command line */
     char cmdline_copy[MAXLINE];
@@ -196,6 +202,7 @@ int main()
         }
 
         for (int i = 0; i < done_job_count; i++) {
+            log_job("done", done_jobs[i].job_id, 0, done_jobs[i].cmdline);
             printf("[%d]   Done                    %s", 
                    done_jobs[i].job_id, 
                    done_jobs[i].cmdline);
@@ -267,6 +274,7 @@ void myshell_execute(char **argv, int bg, char *cmdline)
         setpgid(pid, pid);
         int job_id = add_job(pid, cmdline, RUNNING); // 모든 작업 추적을 위해 foreground도 jobs에 추가
         sigprocmask(SIG_SETMASK, &prev_all, NULL);
+        log_job(bg ? "start bg" : "start fg", job_id, pid, cmdline);
         if (!bg){ 
             tcsetpgrp(STDIN_FILENO, pid);
 
@@ -286,9 +294,11 @@ void myshell_execute(char **argv, int bg, char *cmdline)
                 if (job) {
                     job->state = STOPPED;
                 }
+                log_job("stopped", job_id, pid, cmdline);
             } else {
                 // 정상 종료 또는 신호로 종료된 경우
                 delete_job(pid);
+                log_job(WIFSIGNALED(status) ? "killed" : "done", job_id, pid, cmdline);
             }
         }
         else // bg 실행 경우
@@ -568,11 +578,13 @@ void myshell_execute_pipeline(char *cmdline){
     if (bg) {
         // 백그라운드 파이프라인 실행
         add_job(pgid, original_cmdline, RUNNING);
+        log_job("start bg", next_job_id - 1, pgid, original_cmdline);
         printf("[%d] %d\n", next_job_id - 1, pgid);
     } else {
         // 포그라운드 실행
         tcsetpgrp(STDIN_FILENO, pgid);
-        add_job(pgid, original_cmdline, RUNNING);
+        int job_id = add_job(pgid, original_cmdline, RUNNING);
+        log_job("start fg", job_id, pgid, original_cmdline);
 
         int status;
         // 프로세스 그룹 전체 대기
@@ -592,9 +604,11 @@ void myshell_execute_pipeline(char *cmdline){
             if (job) {
                 job->state = STOPPED;
             }
+            log_job("stopped", job_id, pgid, original_cmdline);
         } else {
             // 정상 종료 또는 신호로 종료된 경우
             delete_job(pgid);
+            log_job(WIFSIGNALED(status) ? "killed" : "done", job_id, pgid, original_cmdline);
         }
     }
 
@@ -765,6 +779,7 @@ void do_fg(int job_id) {
     }
 
     printf("%s\n", clean_cmdline);
+    log_job("fg", job->job_id, job->pgid, job->cmdline);
 
     tcsetpgrp(STDIN_FILENO, job->pgid);
     job->state = RUNNING;
@@ -776,11 +791,13 @@ void do_fg(int job_id) {
 
     if (WIFSTOPPED(status)) {
         job->state = STOPPED;
+        log_job("stopped", job->job_id, job->pgid, job->cmdline);
         printf("\n[%d]+  Stopped                 %s", job->job_id, job->cmdline);
         if (job->cmdline[strlen(job->cmdline) - 1] != '\n') {
             printf("\n");
         }
     } else {
+        log_job(WIFSIGNALED(status) ? "killed" : "done", job->job_id, job->pgid, job->cmdline);
         delete_job(job->pgid);
     }
 }
@@ -794,6 +811,7 @@ void do_bg(int job_id) {
 
     job->state = RUNNING;
     Kill(-job->pgid, SIGCONT);
+    log_job("bg", job->job_id, job->pgid, job->cmdline);
 
     // 명령어 출력 형식 조정
     char clean_cmdline[MAXLINE];
@@ -830,4 +848,32 @@ void do_kill(int job_id) {
 
     // 작업을 완전히 종료시키기 위해 SIGTERM 사용
     Kill(-job->pgid, SIGTERM);
+    log_job("kill", job->job_id, job->pgid, job->cmdline);
+}
+
+/*
+MYSHELL_LOG=<file>이면 job 이벤트를 그 파일에 비동기로 남긴다
+exit 때 남은 로그를 내보내고, fork된 자식에서는 log.c가 알아서 끈다
+*/
+void open_log(void) {
+    char *file = getenv("MYSHELL_LOG");
+    if (file == NULL || *file == '\0') return;
+
+    int fd = open(file, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        perror("myshell: MYSHELL_LOG");
+        return;
+    }
+    log_init(fd, LOG_INFO);
+    atexit(log_shutdown);
+    log_info("myshell started (pid %d)", getpid());
+}
+
+// signal handler 밖(main 흐름)에서만 부른다, cmdline 끝의 개행은 빼고 기록
+void log_job(const char *event, int job_id, pid_t pgid, const char *cmdline) {
+    if (!log_enabled(LOG_INFO)) return;
+    if (pgid)
+        log_info("[%d] %d %s: %.*s", job_id, pgid, event, (int)strcspn(cmdline, "\n"), cmdline);
+    else
+        log_info("[%d] %s: %.*s", job_id, event, (int)strcspn(cmdline, "\n"), cmdline);
 }
\ No newline at end of file
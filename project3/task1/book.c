@@ -0,0 +1,213 @@
+/*
+ * book.c - limit order book (price-time priority), 주문 node pool + intrusive level list
+ */
+#include "csapp.h"
+#include "book.h"
+
+void book_init(book* b){
+    memset(b, 0, sizeof(*b));
+    list_init(&b->free_orders);
+}
+
+void book_free(book* b){
+    for (int s = 0; s < 2; s++){
+        for (int i = 0; i < b->side[s].n; i++)
+            free(b->side[s].levels[i]);
+        free(b->side[s].levels);
+    }
+    for (int i = 0; i < b->nfree_levels; i++)
+        free(b->free_levels[i]);
+    for (int i = 0; i < b->nchunks; i++)
+        free(b->chunks[i]);
+    free(b->free_levels);
+    free(b->chunks);
+}
+
+static book_order* slot(book* b, uint32_t s){
+    return &b->chunks[s / BOOK_CHUNK][s % BOOK_CHUNK];
+}
+
+// free list에서 꺼내고, 비었으면 아직 안 쓴 slot (chunk가 모자라면 하나 더)
+static book_order* order_alloc(book* b){
+    book_order* o;
+    uint32_t s;
+
+    if (!list_empty(&b->free_orders)){
+        o = list_entry(list_pop_front(&b->free_orders), book_order, elem);
+        s = (uint32_t)o->id; // 반납할 때 slot 번호만 남겨 둔다
+    } else{
+        s = b->used++;
+        if (s / BOOK_CHUNK == (uint32_t)b->nchunks){
+            b->chunks = Realloc(b->chunks, (b->nchunks + 1) * sizeof(book_order*));
+            b->chunks[b->nchunks++] = Malloc(BOOK_CHUNK * sizeof(book_order));
+        }
+        o = slot(b, s);
+    }
+    o->id = (uint64_t)++b->seq << 32 | s;
+    return o;
+}
+
+static void order_release(book* b, book_order* o){
+    o->id = (uint32_t)o->id;
+    o->level = NULL;
+    list_push_front(&b->free_orders, &o->elem); // 최근에 쓴 node부터 재사용 (cache)
+}
+
+static book_level* level_alloc(book* b, int32_t price){
+    book_level* lvl = b->nfree_levels ? b->free_levels[--b->nfree_levels] : Malloc(sizeof(book_level));
+
+    list_init(&lvl->orders);
+    lvl->price = price;
+    lvl->qty = 0;
+    return lvl;
+}
+
+static void level_release(book* b, book_level* lvl){
+    if (b->nfree_levels == b->free_cap){
+        b->free_cap = b->free_cap ? b->free_cap * 2 : 64;
+        b->free_levels = Realloc(b->free_levels, b->free_cap * sizeof(book_level*));
+    }
+    b->free_levels[b->nfree_levels++] = lvl;
+}
+
+// side에서 a가 b보다 좋은 가격이면 1
+static int better(int side, int32_t a, int32_t b){
+    return side == BOOK_BUY ? a > b : a < b;
+}
+
+// price보다 나쁜 level의 개수 = price level이 들어갈 위치
+static int level_pos(book_side* bs, int side, int32_t price){
+    int lo = 0, hi = bs->n;
+
+    // 새 주문은 대부분 top 근처이므로 끝에서 먼저 확인
+    if (hi == 0 || better(side, price, bs->levels[hi - 1]->price))
+        return hi;
+    while (lo < hi){
+        int mid = (lo + hi) / 2;
+        if (better(side, price, bs->levels[mid]->price))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// price의 level (없으면 만들어서 끼워 넣는다)
+static book_level* level_get(book* b, int side, int32_t price){
+    book_side* bs = &b->side[side];
+    int pos = level_pos(bs, side, price);
+
+    if (pos < bs->n && bs->levels[pos]->price == price)
+        return bs->levels[pos];
+    if (bs->n == bs->cap){
+        bs->cap = bs->cap ? bs->cap * 2 : 64;
+        bs->levels = Realloc(bs->levels, bs->cap * sizeof(book_level*));
+    }
+    memmove(bs->levels + pos + 1, bs->levels + pos, (bs->n - pos) * sizeof(book_level*));
+    bs->levels[pos] = level_alloc(b, price);
+    bs->n++;
+    return bs->levels[pos];
+}
+
+static void level_remove(book* b, int side, book_level* lvl){
+    book_side* bs = &b->side[side];
+    int pos = bs->n - 1;
+
+    if (bs->levels[pos] != lvl){
+        pos = level_pos(bs, side, lvl->price);
+        memmove(bs->levels + pos, bs->levels + pos + 1, (bs->n - pos - 1) * sizeof(book_level*));
+    }
+    bs->n--;
+    level_release(b, lvl);
+}
+
+/*
+반대편 top부터 가격이 맞는 동안 시간 순으로 체결, 남은 수량 반환
+market이면 가격 조건 없이 체결
+*/
+static int32_t match(book* b, int side, int32_t price, int32_t qty, int market, book_result* r){
+    book_side* opp = &b->side[!side];
+
+    while (qty > 0 && opp->n > 0){
+        book_level* lvl = opp->levels[opp->n - 1];
+
+        if (!market && better(side, lvl->price, price))
+            break; // buy면 ask > price, sell이면 bid < price
+        while (qty > 0 && !list_empty(&lvl->orders)){
+            book_order* o = list_entry(list_front(&lvl->orders), book_order, elem);
+            int32_t q = o->qty < qty ? o->qty : qty;
+
+            o->qty -= q;
+            lvl->qty -= q;
+            qty -= q;
+            r->filled += q;
+            r->fills++;
+            r->last_price = lvl->price;
+            if (o->qty == 0){
+                list_pop_front(&lvl->orders);
+                order_release(b, o);
+            }
+        }
+        if (list_empty(&lvl->orders)){
+            opp->n--;
+            level_release(b, lvl);
+        }
+    }
+    return qty;
+}
+
+// 지정가 주문: 체결되고 남은 수량은 book에 넣는다
+void book_limit(book* b, int side, int32_t price, int32_t qty, book_result* r){
+    book_order* o;
+    book_level* lvl;
+
+    memset(r, 0, sizeof(*r));
+    if ((qty = match(b, side, price, qty, 0, r)) == 0)
+        return;
+
+    lvl = level_get(b, side, price);
+    o = order_alloc(b);
+    o->side = side;
+    o->price = price;
+    o->qty = qty;
+    o->level = lvl;
+    list_push_back(&lvl->orders, &o->elem);
+    lvl->qty += qty;
+    r->id = o->id;
+}
+
+// 시장가 주문: 있는 만큼 체결하고 나머지는 버린다
+void book_market(book* b, int side, int32_t qty, book_result* r){
+    memset(r, 0, sizeof(*r));
+    match(b, side, 0, qty, 1, r);
+}
+
+// book에 남아 있는 주문 취소, 없는 id면 0
+int book_cancel(book* b, uint64_t id){
+    uint32_t s = (uint32_t)id;
+    book_order* o;
+    book_level* lvl;
+
+    if (s >= b->used)
+        return 0;
+    o = slot(b, s);
+    if (o->id != id || (lvl = o->level) == NULL)
+        return 0;
+    list_remove(&o->elem);
+    lvl->qty -= o->qty;
+    if (list_empty(&lvl->orders))
+        level_remove(b, o->side, lvl);
+    order_release(b, o);
+    return 1;
+}
+
+// side의 최우선 가격과 그 level의 잔량, 비었으면 0
+int book_top(book* b, int side, int32_t* price, int64_t* qty){
+    book_side* bs = &b->side[side];
+
+    if (bs->n == 0)
+        return 0;
+    *price = bs->levels[bs->n - 1]->price;
+    *qty = bs->levels[bs->n - 1]->qty;
+    return 1;
+}
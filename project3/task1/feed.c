@@ -0,0 +1,481 @@
+/*
+ * feed.c - subscribe 연결에 종목 변경을 push
+ */
+#include "csapp.h"
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "feed.h"
+#include "stats.h"
+
+typedef struct feed_sub feed_sub;
+
+// 연결 하나가 종목 하나를 구독
+typedef struct {
+    feed_sub* s;
+    int idx;
+    proto_snap* pending; // 아직 out으로 옮기지 않은 최신 레코드
+} feed_ent;
+
+typedef struct {
+    feed_ent** v;
+    int n, cap;
+} feed_vec;
+
+struct feed_sub {
+    int fd;
+    proto_conn pc;
+    feed_vec ents; // 구독 중인 종목
+    feed_vec ready; // pending이 있는 종목
+    pbuf out; // 보내는 중인 응답과 레코드 (다 보낸 뒤에야 pending을 옮긴다)
+    size_t out_off;
+    char in[MAXLINE]; // 아직 '\n'을 받지 못한 입력
+    int in_len;
+    char* rest; // worker가 이미 읽어 둔 입력 (attach 직후 처리)
+    size_t nrest;
+    int closing; // exit 요청, 남은 응답을 보낸 뒤 종료
+    int dead; // 연결 에러, 이번 loop 끝에서 정리
+    int blocked; // EAGAIN, EPOLLOUT이 올 때까지 쓰지 않는다
+    int queued; // flush 목록에 있음
+    feed_sub* next; // attach 대기열
+};
+
+static struct {
+    stock_table* stocks;
+    int epfd, evfd;
+    int nwords;
+    uint64_t* dirty; // 종목별 변경 bit (producer가 켜고 feed thread가 가져간다)
+    int* nsubs; // 종목별 구독 연결 수 (producer는 읽기만)
+    feed_vec* subs; // 종목별 구독 (이하 feed thread 전용)
+    uint64_t* last; // 종목별 마지막으로 보낸 (잔량, 가격)
+    int signaled; // eventfd에 이미 썼음
+    pthread_mutex_t mutex;
+    feed_sub* attach; // 넘겨받은 연결 대기열 (mutex)
+    feed_sub** flush; // 이번 loop에서 보낼 것이 생긴 연결
+    int nflush, flush_cap;
+    int subscribers, conflated; // stats gauge
+} feed = {.mutex = PTHREAD_MUTEX_INITIALIZER};
+
+static void vec_push(feed_vec* v, feed_ent* e){
+    if (v->n == v->cap){
+        v->cap = v->cap ? v->cap * 2 : 8;
+        v->v = Realloc(v->v, v->cap * sizeof(feed_ent*));
+    }
+    v->v[v->n++] = e;
+}
+
+// 순서는 유지하지 않는다
+static void vec_remove(feed_vec* v, feed_ent* e){
+    for (int i = 0; i < v->n; i++){
+        if (v->v[i] == e){
+            v->v[i] = v->v[--v->n];
+            return;
+        }
+    }
+}
+
+void feed_init(stock_table* t){
+    int n = t->count ? t->count : 1;
+
+    feed.stocks = t;
+    feed.nwords = (n + 63) / 64;
+    feed.dirty = Calloc(feed.nwords, sizeof(uint64_t));
+    feed.nsubs = Calloc(n, sizeof(int));
+    feed.subs = Calloc(n, sizeof(feed_vec));
+    feed.last = Calloc(n, sizeof(uint64_t));
+}
+
+static void wake(void){
+    uint64_t one = 1;
+
+    if (write(feed.evfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("feed: eventfd write");
+}
+
+/*
+buy/sell 등이 값을 바꾼 뒤 호출, 구독자가 없으면 load 한 번으로 끝난다
+값을 바꾼 CAS 다음에 nsubs를 읽고 feed thread는 nsubs를 올린 뒤 값을 읽으므로
+구독 직후의 변경은 둘 중 한 쪽에서 반드시 보인다
+*/
+void feed_changed(int idx){
+    uint64_t* w = &feed.dirty[idx / 64];
+    uint64_t bit = 1ull << (idx % 64);
+
+    if (__atomic_load_n(&feed.nsubs[idx], __ATOMIC_SEQ_CST) == 0)
+        return;
+    // 이미 켜져 있으면 feed thread가 아직 가져가지 않았으므로 최신 값을 읽게 된다
+    if (__atomic_load_n(w, __ATOMIC_RELAXED) & bit)
+        return;
+    __atomic_fetch_or(w, bit, __ATOMIC_SEQ_CST);
+    // 깨우는 것은 feed thread가 잠든 뒤 처음 바꾼 thread 하나만
+    if (!__atomic_exchange_n(&feed.signaled, 1, __ATOMIC_SEQ_CST))
+        wake();
+}
+
+// "ID 잔량 가격\n" 레코드 (참조 1개를 가진 채 반환)
+static proto_snap* record(int idx, Item v){
+    char line[64];
+    int n = snprintf(line, sizeof(line), "%d %d %d\n", feed.stocks->ids[idx], v.left_stock, v.price);
+    proto_snap* r = Malloc(sizeof(proto_snap) + n);
+
+    r->refcnt = 1;
+    r->len = n;
+    memcpy(r->data, line, n);
+    return r;
+}
+
+static void queue_flush(feed_sub* s){
+    if (s->queued)
+        return;
+    if (feed.nflush == feed.flush_cap){
+        feed.flush_cap = feed.flush_cap ? feed.flush_cap * 2 : 64;
+        feed.flush = Realloc(feed.flush, feed.flush_cap * sizeof(feed_sub*));
+    }
+    feed.flush[feed.nflush++] = s;
+    s->queued = 1;
+}
+
+static void mark_dead(feed_sub* s){
+    s->dead = 1;
+    queue_flush(s);
+}
+
+// 레코드 참조를 하나 더 얻어 e의 pending으로, 보내지 못한 옛 레코드가 있으면 대체 (conflation)
+static void set_pending(feed_ent* e, proto_snap* r){
+    __atomic_add_fetch(&r->refcnt, 1, __ATOMIC_RELAXED);
+    if (e->pending){
+        proto_snap_put(e->pending);
+        __atomic_add_fetch(&feed.conflated, 1, __ATOMIC_RELAXED);
+    } else{
+        vec_push(&e->s->ready, e);
+    }
+    e->pending = r;
+    queue_flush(e->s);
+}
+
+/*
+idx의 현재 값이 마지막으로 보낸 값과 다르면 모든 구독에 보낸다
+fresh(방금 구독한 연결)에는 같더라도 현재 값을 보낸다
+*/
+static void publish_one(int idx, feed_ent* fresh){
+    feed_vec* v = &feed.subs[idx];
+    Item cur = stock_get(feed.stocks, idx);
+    int changed = (cur.word != feed.last[idx]);
+    proto_snap* r;
+
+    if (v->n == 0 || (!changed && fresh == NULL))
+        return;
+    feed.last[idx] = cur.word;
+    r = record(idx, cur);
+    if (changed){
+        for (int i = 0; i < v->n; i++)
+            set_pending(v->v[i], r);
+    } else{
+        set_pending(fresh, r);
+    }
+    proto_snap_put(r);
+}
+
+// 켜진 dirty bit를 모두 가져가 바뀐 종목마다 레코드 하나를 만들어 공유
+static void publish(void){
+    __atomic_store_n(&feed.signaled, 0, __ATOMIC_SEQ_CST);
+    for (int w = 0; w < feed.nwords; w++){
+        uint64_t bits;
+
+        if (__atomic_load_n(&feed.dirty[w], __ATOMIC_RELAXED) == 0)
+            continue;
+        bits = __atomic_exchange_n(&feed.dirty[w], 0, __ATOMIC_ACQUIRE);
+        while (bits){
+            publish_one(w * 64 + __builtin_ctzll(bits), NULL);
+            bits &= bits - 1;
+        }
+    }
+}
+
+static void unlink_ent(feed_ent* e){
+    vec_remove(&feed.subs[e->idx], e);
+    __atomic_sub_fetch(&feed.nsubs[e->idx], 1, __ATOMIC_SEQ_CST);
+    if (e->pending)
+        proto_snap_put(e->pending);
+    free(e);
+}
+
+// s->pc.sub_idx의 종목들을 구독하고 현재 값을 보낸다 (이미 구독 중인 종목은 건너뛴다)
+static void subscribe(feed_sub* s){
+    for (int i = 0; i < s->pc.sub_n; i++){
+        int idx = s->pc.sub_idx[i], dup = 0;
+        feed_vec* v = &feed.subs[idx];
+        feed_ent* e;
+
+        for (int k = 0; k < v->n && !dup; k++)
+            dup = (v->v[k]->s == s);
+        if (dup)
+            continue;
+        e = Calloc(1, sizeof(feed_ent));
+        e->s = s;
+        e->idx = idx;
+        vec_push(v, e);
+        vec_push(&s->ents, e);
+        __atomic_add_fetch(&feed.nsubs[idx], 1, __ATOMIC_SEQ_CST);
+        publish_one(idx, e);
+    }
+    free(s->pc.sub_idx);
+    s->pc.sub_idx = NULL;
+    s->pc.sub_n = 0;
+}
+
+// ID가 없으면 전부 해지, 없는 ID가 있으면 아무것도 해지하지 않는다
+static void unsubscribe(feed_sub* s, proto_req* req){
+    int idx[PROTO_ORDER_MAX];
+
+    for (int i = 0; i < req->nlegs; i++){
+        if ((idx[i] = stock_find(feed.stocks, req->legs[i].id)) < 0){
+            pbuf_append(&s->out, "Invalid stock ID\n", 17);
+            return;
+        }
+    }
+    for (int i = s->ents.n - 1; i >= 0; i--){
+        feed_ent* e = s->ents.v[i];
+        int hit = (req->nlegs == 0);
+
+        for (int k = 0; k < req->nlegs && !hit; k++)
+            hit = (idx[k] == e->idx);
+        if (!hit)
+            continue;
+        if (e->pending)
+            vec_remove(&s->ready, e);
+        s->ents.v[i] = s->ents.v[--s->ents.n];
+        unlink_ent(e);
+    }
+    pbuf_append(&s->out, "[unsubscribe] success\n", 22);
+}
+
+// pending 레코드들을 보낼 버퍼 뒤로 옮긴다 (참조만 넘긴다)
+static void take_pending(feed_sub* s){
+    for (int i = 0; i < s->ready.n; i++){
+        feed_ent* e = s->ready.v[i];
+        pbuf_append_snap(&s->out, e->pending);
+        e->pending = NULL;
+    }
+    s->ready.n = 0;
+}
+
+static void sub_command(feed_sub* s, char* line){
+    proto_req req;
+
+    // 요청보다 먼저 생긴 변경이 응답보다 늦게 가지 않도록
+    take_pending(s);
+    proto_parse_text(line, &req);
+    if (req.op == PROTO_OP_UNSUBSCRIBE){
+        stats_request(req.op);
+        unsubscribe(s, &req);
+    } else{
+        switch (proto_execute(&s->pc, &req, &s->out)){
+        case PROTO_CLOSE: s->closing = 1; break;
+        case PROTO_SUBSCRIBE: subscribe(s); break;
+        }
+    }
+    queue_flush(s);
+}
+
+// task1의 process_input과 같은 규칙으로 줄을 나눈다 ('\n' 포함, 최대 MAXLINE-1 byte)
+static void sub_input(feed_sub* s, const char* data, size_t n){
+    while (n > 0 && !s->closing){
+        const char* nl = memchr(data, '\n', n);
+        size_t take = nl ? (size_t)(nl - data) + 1 : n;
+
+        if (take > (size_t)(MAXLINE - 1 - s->in_len))
+            take = MAXLINE - 1 - s->in_len;
+        memcpy(s->in + s->in_len, data, take);
+        s->in_len += take;
+        data += take;
+        n -= take;
+        if (s->in[s->in_len - 1] != '\n' && s->in_len < MAXLINE - 1)
+            return;
+        s->in[s->in_len] = '\0';
+        stats_bytes_in(s->in_len);
+        s->in_len = 0;
+        sub_command(s, s->in);
+    }
+}
+
+static void sub_read(feed_sub* s){
+    char buf[MAXBUF];
+    ssize_t n;
+
+    while (!s->closing){
+        n = read(s->fd, buf, sizeof(buf));
+        if (n > 0){
+            sub_input(s, buf, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        mark_dead(s); // EOF 또는 에러
+        return;
+    }
+}
+
+// out을 다 보내면 그동안 쌓인 pending을 옮겨 이어서 보낸다
+static void sub_flush(feed_sub* s){
+    struct iovec iov[FEED_IOV_MAX];
+
+    while (!s->blocked){
+        if (s->out_off == s->out.total){
+            pbuf_reset(&s->out);
+            s->out_off = 0;
+            if (s->closing){
+                s->dead = 1;
+                return;
+            }
+            if (s->ready.n == 0)
+                return;
+            take_pending(s);
+        }
+        ssize_t n = writev(s->fd, iov, pbuf_iov(&s->out, s->out_off, iov, FEED_IOV_MAX));
+        if (n < 0){
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                s->blocked = 1;
+            else
+                s->dead = 1;
+            return;
+        }
+        stats_bytes_out(n);
+        s->out_off += n;
+    }
+}
+
+static void sub_destroy(feed_sub* s){
+    for (int i = 0; i < s->ents.n; i++)
+        unlink_ent(s->ents.v[i]);
+    free(s->ents.v);
+    free(s->ready.v);
+    pbuf_free(&s->out);
+    free(s->pc.sub_idx);
+    free(s->rest);
+    close(s->fd);
+    stats_conn(-1);
+    __atomic_sub_fetch(&feed.subscribers, 1, __ATOMIC_RELAXED);
+    free(s);
+}
+
+// worker/reactor가 넘긴 연결을 epoll에 등록하고 첫 subscribe를 처리
+static void attach_all(void){
+    struct epoll_event ev;
+    feed_sub* s;
+
+    pthread_mutex_lock(&feed.mutex);
+    s = feed.attach;
+    feed.attach = NULL;
+    pthread_mutex_unlock(&feed.mutex);
+
+    while (s){
+        feed_sub* next = s->next;
+
+        __atomic_add_fetch(&feed.subscribers, 1, __ATOMIC_RELAXED);
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = s;
+        if (epoll_ctl(feed.epfd, EPOLL_CTL_ADD, s->fd, &ev) < 0){
+            perror("feed: epoll_ctl");
+            mark_dead(s);
+        } else{
+            subscribe(s);
+            if (s->nrest > 0)
+                sub_input(s, s->rest, s->nrest);
+            queue_flush(s);
+        }
+        s = next;
+    }
+}
+
+static void *feed_thread(void *vargp){
+    struct epoll_event events[FEED_MAXEVENTS];
+    uint64_t cnt;
+    int n;
+
+    Pthread_detach(pthread_self());
+    while (1){
+        if ((n = epoll_wait(feed.epfd, events, FEED_MAXEVENTS, -1)) < 0){
+            if (errno == EINTR) continue;
+            unix_error("feed: epoll_wait error");
+        }
+        for (int i = 0; i < n; i++){
+            feed_sub* s = events[i].data.ptr;
+
+            if (s == NULL){
+                if (read(feed.evfd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+                    perror("feed: eventfd read");
+                continue;
+            }
+            if (events[i].events & EPOLLOUT){
+                s->blocked = 0;
+                queue_flush(s);
+            }
+            if (!s->dead && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                sub_read(s);
+        }
+        attach_all();
+        publish();
+
+        for (int i = 0; i < feed.nflush; i++){
+            feed_sub* s = feed.flush[i];
+
+            s->queued = 0;
+            if (!s->dead)
+                sub_flush(s);
+            if (s->dead)
+                sub_destroy(s);
+        }
+        feed.nflush = 0;
+    }
+    return NULL;
+}
+
+void feed_start(void){
+    struct epoll_event ev;
+    pthread_t tid;
+
+    if ((feed.epfd = epoll_create1(0)) < 0)
+        unix_error("feed: epoll_create1 error");
+    if ((feed.evfd = eventfd(0, EFD_NONBLOCK)) < 0)
+        unix_error("feed: eventfd error");
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(feed.epfd, EPOLL_CTL_ADD, feed.evfd, &ev) < 0)
+        unix_error("feed: epoll_ctl error");
+    stats_gauge("subscribers", &feed.subscribers);
+    stats_gauge("feed_conflated", &feed.conflated);
+    Pthread_create(&tid, NULL, feed_thread, NULL);
+}
+
+/*
+subscribe를 처리한 연결을 feed thread로 넘긴다 (worker/reactor는 이후 fd를 건드리지 않는다)
+pc의 구독 목록, 아직 보내지 못한 out (out_off부터), 이미 읽어 둔 입력 rest도 함께 넘긴다
+*/
+void feed_attach(int fd, proto_conn* pc, pbuf* out, size_t out_off, const char* rest, size_t n){
+    feed_sub* s = Calloc(1, sizeof(feed_sub));
+
+    s->fd = fd;
+    s->pc = *pc;
+    pc->sub_idx = NULL;
+    pc->sub_n = 0;
+    s->out = *out;
+    s->out_off = out_off;
+    pbuf_init(out);
+    if (n > 0){
+        s->rest = Malloc(n);
+        memcpy(s->rest, rest, n);
+        s->nrest = n;
+    }
+    if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) < 0)
+        perror("feed: fcntl");
+
+    pthread_mutex_lock(&feed.mutex);
+    s->next = feed.attach;
+    feed.attach = s;
+    pthread_mutex_unlock(&feed.mutex);
+    wake();
+}
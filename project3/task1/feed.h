@@ -0,0 +1,30 @@
+/*
+ * feed.h - 종목 변경 push (subscribe 연결 전용 thread)
+ *
+ * subscribe 요청을 받은 연결은 worker/reactor가 feed_attach로 feed thread에 넘긴다.
+ * feed thread 하나가 epoll로 모든 구독 연결을 맡아 요청도 처리하고 변경도 보낸다.
+ *
+ * buy/sell 등은 feed_changed(idx)로 종목별 dirty bit만 켠다 (구독자가 없는 종목이면 아무것도 안 함).
+ * feed thread는 깨어날 때마다 dirty bit를 모아, 바뀐 종목마다 "ID 잔량 가격\n" 레코드를 한 번만 만들고
+ * 그 종목의 모든 구독 연결이 참조 카운트로 공유한다 (연결마다 복사하지 않는다, show snapshot과 같은 방식).
+ *
+ * 연결마다 (구독 종목 하나 당) 아직 보내지 못한 레코드를 최대 하나만 들고 있다.
+ * 느린 연결은 보내는 중인 버퍼가 비워질 때까지 같은 종목의 새 레코드가 옛 레코드를 대체하므로
+ * (conflation) 메모리가 구독 종목 수로 제한되고, buy/sell 쪽은 절대 기다리지 않는다.
+ */
+#ifndef __FEED_H__
+#define __FEED_H__
+
+#include <stddef.h>
+#include "stock.h"
+#include "proto.h"
+
+#define FEED_MAXEVENTS 256 // epoll_wait 한 번에 받는 최대 event 수
+#define FEED_IOV_MAX 1024 // writev 한 번에 넘기는 최대 구간 수 (레코드마다 하나)
+
+void feed_init(stock_table*);
+void feed_start(void);
+void feed_changed(int);
+void feed_attach(int, proto_conn*, pbuf*, size_t, const char*, size_t);
+
+#endif /* __FEED_H__ */
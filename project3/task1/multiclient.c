@@ -1,111 +1,608 @@
+/*
+ * multiclient.c - stock server 부하 생성기
+ *
+ *   usage: ./multiclient <host> <port> <conn#> [options]
+ *     --threads N         연결을 나눠 맡을 epoll thread 수 (기본 min(conn#, 4))
+ *     --duration SEC      측정 시간 (기본 10초, --orders만 주면 무제한)
+ *     --orders N          연결 당 요청 수, 다 보내면 연결 종료
+ *     --rate R            open loop: 전체 R req/s로 예정된 시각에 보낸다
+ *                         (0이면 closed loop: 응답을 받으면 다음 요청)
+ *     --pipeline-depth N  closed loop에서 연결 당 동시에 보내둘 요청 수 (기본 1)
+ *     --mix S,B,T         show,buy,sell 비율 (기본 1,1,1)
+ *     --stocks N          buy/sell ID 범위 1~N (기본 5)
+ *     --binary            v3 binary protocol 사용 (기본 v2 text)
+ *
+ * 요청마다 보낸 시각부터 응답을 다 받은 시각까지를 ns 단위 log-linear
+ * histogram(HDR 방식, 오차 1% 미만)에 기록한다. open loop의 시작 시각은 실제로
+ * 보낸 시각이 아니라 예정 시각이므로 서버가 밀려도 지연이 가려지지 않는다.
+ * 끝나면 사람이 읽는 요약은 stderr, 한 줄 JSON 요약은 stdout으로 낸다.
+ */
 #include "csapp.h"
 #include <time.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define OP_SHOW 1
+#define OP_BUY 2
+#define OP_SELL 3
+#define ST_OK 0
+#define ST_SNAPSHOT 16
 
-#define MAX_CLIENT 100
-#define ORDER_PER_CLIENT 10
-#define STOCK_NUM 5
 #define BUY_SELL_MAX 10
+#define IN_BUFSIZE 16384
+#define MAX_EVENTS 64
+#define DRAIN_NS 2000000000ull // duration이 끝난 뒤 남은 응답을 기다리는 시간
 
-int main(int argc, char **argv) 
-{
-	pid_t pids[MAX_CLIENT];
-	int runprocess = 0, status, i;
-
-	int clientfd, num_client;
-	char *host, *port, buf[MAXLINE], tmp[3];
-	rio_t rio;
-
-	if (argc != 4) {
-		fprintf(stderr, "usage: %s <host> <port> <client#>\n", argv[0]);
-		exit(0);
-	}
-
-	host = argv[1];
-	port = argv[2];
-	num_client = atoi(argv[3]);
-
-/*	fork for each client process	*/
-	while(runprocess < num_client){
-		//wait(&state);
-		pids[runprocess] = fork();
-
-		if(pids[runprocess] < 0)
-			return -1;
-		/*	child process		*/
-		else if(pids[runprocess] == 0){
-			printf("child %ld\n", (long)getpid());
-
-			clientfd = Open_clientfd(host, port);
-			Rio_readinitb(&rio, clientfd);
-			srand((unsigned int) getpid());
-
-			for(i=0;i<ORDER_PER_CLIENT;i++){
-				int option = rand() % 3;
-				
-				if(option == 0){//show
-					strcpy(buf, "show\n");
-				}
-				else if(option == 1){//buy
-					int list_num = rand() % STOCK_NUM + 1;
-					int num_to_buy = rand() % BUY_SELL_MAX + 1;//1~10
-
-					strcpy(buf, "buy ");
-					sprintf(tmp, "%d", list_num);
-					strcat(buf, tmp);
-					strcat(buf, " ");
-					sprintf(tmp, "%d", num_to_buy);
-					strcat(buf, tmp);
-					strcat(buf, "\n");
-				}
-				else if(option == 2){//sell
-					int list_num = rand() % STOCK_NUM + 1; 
-					int num_to_sell = rand() % BUY_SELL_MAX + 1;//1~10
-					
-					strcpy(buf, "sell ");
-					sprintf(tmp, "%d", list_num);
-					strcat(buf, tmp);
-					strcat(buf, " ");
-					sprintf(tmp, "%d", num_to_sell);
-					strcat(buf, tmp);
-					strcat(buf, "\n");
+// latency histogram: 2의 거듭제곱 구간마다 HIST_SUB개로 나눈다
+#define HIST_SUB_BITS 7
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS 40 // 2^40 ns (약 18분) 이상은 마지막 bucket
+#define HIST_BUCKETS ((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+// 응답을 기다리는 요청
+typedef struct {
+	uint64_t t; // 시작 시각 (ns)
+	int op;
+} pending_t;
+
+typedef struct {
+	int fd;
+	int ready; // hello 응답을 받았음
+	char in[IN_BUFSIZE];
+	size_t in_pos, in_len;
+	char* out;
+	size_t out_pos, out_len, out_cap;
+	int want_out; // EPOLLOUT 등록 여부
+	pending_t* q; // 보낸 순서대로 (ring)
+	int q_head, q_len, q_cap;
+	int snap_state; // binary show 응답을 읽는 중: 1 개수 대기, 2 varint 대기
+	uint32_t snap_left;
+	long sent;
+	uint64_t next_send; // open loop 다음 예정 시각
+} conn_t;
+
+typedef struct {
+	pthread_t tid;
+	int epfd;
+	int tfd; // 다음 예정 시각에 깨우는 timer (epoll_wait timeout은 ms 단위라 open loop에 부족)
+	uint64_t armed; // tfd에 설정된 시각
+	conn_t** conns;
+	int nconns;
+	unsigned int seed;
+	uint64_t done, rejected, errors, sum, min, max, last;
+	uint64_t hist[HIST_BUCKETS];
+} worker_t;
+
+static struct {
+	char *host, *port;
+	int conns, threads, depth, binary, stocks;
+	int mix[3];
+	long orders;
+	double duration, rate;
+} cfg;
+
+static char hello_msg[32]; // "hello 2\n" 또는 "hello 3\n"
+static size_t hello_len;
+static pthread_barrier_t barrier;
+static uint64_t t_start, t_end; // 측정 시작/송신 종료 시각, t_end가 0이면 무제한
+
+static uint64_t now_ns(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int hist_index(uint64_t v){
+	int e, shift;
+
+	if (v < HIST_SUB)
+		return v;
+	e = 63 - __builtin_clzll(v);
+	if (e >= HIST_MAX_BITS)
+		return HIST_BUCKETS - 1;
+	shift = e - HIST_SUB_BITS;
+	return (shift + 1) * HIST_SUB + (int)((v >> shift) - HIST_SUB);
+}
+
+// bucket의 대표값 (구간 중간)
+static uint64_t hist_value(int i){
+	int shift;
+
+	if (i < HIST_SUB)
+		return i;
+	shift = i / HIST_SUB - 1;
+	return ((uint64_t)(i % HIST_SUB + HIST_SUB) << shift) + ((1ull << shift) >> 1);
+}
+
+static uint64_t hist_percentile(uint64_t* hist, uint64_t total, double q){
+	uint64_t target = (uint64_t)(q * total + 0.999999), cum = 0;
+
+	if (target == 0)
+		target = 1;
+	for (int i = 0; i < HIST_BUCKETS; i++){
+		cum += hist[i];
+		if (cum >= target)
+			return hist_value(i);
+	}
+	return 0;
+}
+
+static void out_append(conn_t* c, const void* p, size_t n){
+	if (c->out_len + n > c->out_cap){
+		c->out_cap = (c->out_len + n) * 2;
+		c->out = Realloc(c->out, c->out_cap);
+	}
+	memcpy(c->out + c->out_len, p, n);
+	c->out_len += n;
+}
+
+static int put_varint(unsigned char* p, uint32_t v){
+	int n = 0;
+
+	while (v >= 0x80){
+		p[n++] = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	p[n++] = v;
+	return n;
+}
+
+// 읽은 byte 수, 모자라면 0
+static int get_varint(const unsigned char* p, size_t n, uint32_t* v){
+	uint32_t x = 0;
+
+	for (size_t i = 0; i < n && i < 5; i++){
+		x |= (uint32_t)(p[i] & 0x7f) << (7 * i);
+		if (!(p[i] & 0x80)){
+			*v = x;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+/*	mix 비율에 따라 요청 하나를 만들어 out에 붙이고 대기열에 넣는다	*/
+static void send_request(worker_t* w, conn_t* c, uint64_t t){
+	int total = cfg.mix[0] + cfg.mix[1] + cfg.mix[2];
+	int r = rand_r(&w->seed) % total, op;
+	int id = rand_r(&w->seed) % cfg.stocks + 1;
+	int count = rand_r(&w->seed) % BUY_SELL_MAX + 1;
+
+	op = r < cfg.mix[0] ? OP_SHOW : r < cfg.mix[0] + cfg.mix[1] ? OP_BUY : OP_SELL;
+	if (cfg.binary){
+		unsigned char frame[11];
+		int n = 0;
+
+		frame[n++] = op;
+		if (op != OP_SHOW){
+			n += put_varint(frame + n, id);
+			n += put_varint(frame + n, count);
+		}
+		out_append(c, frame, n);
+	} else{
+		char line[64];
+		int n;
+
+		if (op == OP_SHOW)
+			n = sprintf(line, "show\n");
+		else
+			n = sprintf(line, "%s %d %d\n", op == OP_BUY ? "buy" : "sell", id, count);
+		out_append(c, line, n);
+	}
+
+	if (c->q_len == c->q_cap){
+		// ring을 펼쳐서 두 배로
+		pending_t* q = Malloc(2 * c->q_cap * sizeof(pending_t));
+		for (int i = 0; i < c->q_len; i++)
+			q[i] = c->q[(c->q_head + i) % c->q_cap];
+		Free(c->q);
+		c->q = q;
+		c->q_head = 0;
+		c->q_cap *= 2;
+	}
+	c->q[(c->q_head + c->q_len) % c->q_cap] = (pending_t){t, op};
+	c->q_len++;
+	c->sent++;
+}
+
+static int sending(conn_t* c, uint64_t now){
+	if (!c->ready)
+		return 0;
+	if (cfg.orders && c->sent >= cfg.orders)
+		return 0;
+	return t_end == 0 || now < t_end;
+}
+
+// 더 보낼 요청도 기다리는 응답도 없음
+static int finished(conn_t* c, uint64_t now){
+	if (c->q_len > 0)
+		return 0;
+	return (cfg.orders && c->sent >= cfg.orders) || (t_end && now >= t_end);
+}
+
+static void set_events(worker_t* w, conn_t* c, int want_out){
+	struct epoll_event ev;
+
+	if (c->want_out == want_out)
+		return;
+	ev.events = EPOLLIN | (want_out ? EPOLLOUT : 0);
+	ev.data.ptr = c;
+	epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+	c->want_out = want_out;
+}
+
+static void conn_close(worker_t* w, conn_t* c){
+	w->errors += c->q_len; // 응답을 받지 못한 요청
+	c->q_len = 0;
+	Close(c->fd);
+	c->fd = -1;
+}
+
+// 보낼 수 있는 만큼 보낸다, 연결이 끊어졌으면 0
+static int flush(worker_t* w, conn_t* c){
+	while (c->out_pos < c->out_len){
+		ssize_t n = write(c->fd, c->out + c->out_pos, c->out_len - c->out_pos);
+		if (n < 0){
+			if (errno == EAGAIN){
+				set_events(w, c, 1);
+				return 1;
+			}
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		c->out_pos += n;
+	}
+	c->out_pos = c->out_len = 0;
+	set_events(w, c, 0);
+	return 1;
+}
+
+static void complete(worker_t* w, conn_t* c, uint64_t now, int rejected){
+	pending_t* p = &c->q[c->q_head];
+	uint64_t lat = now > p->t ? now - p->t : 0;
+
+	c->q_head = (c->q_head + 1) % c->q_cap;
+	c->q_len--;
+	w->hist[hist_index(lat)]++;
+	w->done++;
+	w->rejected += rejected;
+	w->sum += lat;
+	if (lat < w->min)
+		w->min = lat;
+	if (lat > w->max)
+		w->max = lat;
+	w->last = now;
+}
+
+/*
+버퍼에 들어온 응답을 처리한다
+text: 한 줄이 응답 하나, show는 ".\n" 줄까지
+binary: status 1 byte, show는 개수 + 종목마다 varint 3개
+*/
+static void parse_replies(worker_t* w, conn_t* c, uint64_t now){
+	if (!c->ready){
+		if (c->in_len - c->in_pos < hello_len)
+			return;
+		if (memcmp(c->in + c->in_pos, hello_msg, hello_len) != 0){
+			fprintf(stderr, "protocol version mismatch\n");
+			exit(1);
+		}
+		c->in_pos += hello_len;
+		c->ready = 1;
+		if (c->next_send < now)
+			c->next_send = now; // 늦게 받아준 연결은 지금부터 예정대로
+	}
+	while (c->q_len > 0 && c->in_pos < c->in_len){
+		unsigned char* p = (unsigned char*)c->in + c->in_pos;
+		size_t avail = c->in_len - c->in_pos;
+		int op = c->q[c->q_head].op;
+
+		if (!cfg.binary){
+			char* nl = memchr(p, '\n', avail);
+			if (nl == NULL)
+				return;
+			c->in_pos += nl - (char*)p + 1;
+			if (op != OP_SHOW)
+				complete(w, c, now, p[0] != '['); // 성공 응답만 "[buy] ..."/"[sell] ..." 형식
+			else if (nl == (char*)p + 1 && p[0] == '.')
+				complete(w, c, now, 0);
+			continue;
+		}
+
+		if (c->snap_state == 0){
+			c->in_pos++;
+			if (p[0] != ST_SNAPSHOT)
+				complete(w, c, now, p[0] != ST_OK);
+			else
+				c->snap_state = 1;
+			continue;
+		}
+
+		uint32_t v;
+		int n = get_varint(p, avail, &v);
+		if (n == 0)
+			return;
+		c->in_pos += n;
+		if (c->snap_state == 1){
+			c->snap_left = v * 3;
+			c->snap_state = 2;
+		} else{
+			c->snap_left--;
+		}
+		if (c->snap_left == 0){
+			c->snap_state = 0;
+			complete(w, c, now, 0);
+		}
+	}
+}
+
+// 연결이 끊어졌으면 0
+static int conn_read(worker_t* w, conn_t* c){
+	for (;;){
+		if (c->in_pos > 0){
+			memmove(c->in, c->in + c->in_pos, c->in_len - c->in_pos);
+			c->in_len -= c->in_pos;
+			c->in_pos = 0;
+		}
+		ssize_t n = read(c->fd, c->in + c->in_len, IN_BUFSIZE - c->in_len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno == EAGAIN)
+			return 1;
+		if (n <= 0)
+			return 0;
+		c->in_len += n;
+		parse_replies(w, c, now_ns());
+	}
+}
+
+static void* worker(void* arg){
+	worker_t* w = arg;
+	struct epoll_event ev, evs[MAX_EVENTS];
+	uint64_t interval = 0, now;
+	int alive = w->nconns;
+
+	w->epfd = epoll_create1(0);
+	w->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+	ev.events = EPOLLIN;
+	ev.data.ptr = NULL;
+	epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->tfd, &ev);
+	for (int i = 0; i < w->nconns; i++){
+		conn_t* c = w->conns[i];
+
+		// hello 응답은 event loop에서 받는다 (서버가 바로 받아주지 않을 수 있음)
+		c->fd = Open_clientfd(cfg.host, cfg.port);
+		Rio_writen(c->fd, hello_msg, hello_len);
+		fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) | O_NONBLOCK);
+		c->q_cap = 16;
+		c->q = Malloc(c->q_cap * sizeof(pending_t));
+		ev.events = EPOLLIN;
+		ev.data.ptr = c;
+		epoll_ctl(w->epfd, EPOLL_CTL_ADD, c->fd, &ev);
+	}
+	pthread_barrier_wait(&barrier); // 모든 연결이 준비됨
+	pthread_barrier_wait(&barrier); // main이 t_start를 정함
+
+	now = t_start;
+	if (cfg.rate > 0){
+		// 연결 당 rate/conn# req/s, 시작 위치는 한 주기 안에서 흩어 놓는다
+		interval = (uint64_t)(1e9 * cfg.conns / cfg.rate);
+		for (int i = 0; i < w->nconns; i++)
+			w->conns[i]->next_send = t_start + (interval ? rand_r(&w->seed) % interval : 0);
+	}
+
+	while (alive > 0){
+		uint64_t wake = UINT64_MAX;
+		int n;
+
+		for (int i = 0; i < w->nconns; i++){
+			conn_t* c = w->conns[i];
+
+			if (c->fd < 0)
+				continue;
+			if (interval){
+				while (sending(c, now) && c->next_send <= now){
+					send_request(w, c, c->next_send);
+					c->next_send += interval;
 				}
-				//strcpy(buf, "buy 1 2\n");
-			
-				Rio_writen(clientfd, buf, strlen(buf));
-				// Rio_readlineb(&rio, buf, MAXLINE);
-				Rio_readnb(&rio, buf, MAXLINE);
-				Fputs(buf, stdout);
-
-				usleep(1000000);
+				if (sending(c, now) && c->next_send < wake)
+					wake = c->next_send;
+			} else{
+				while (sending(c, now) && c->q_len < cfg.depth)
+					send_request(w, c, now);
+			}
+			if (!flush(w, c)){
+				conn_close(w, c);
+				alive--;
+			} else if (finished(c, now)){
+				Close(c->fd); // 다 받았음
+				c->fd = -1;
+				alive--;
 			}
+		}
+		if (alive == 0)
+			break;
 
-			Close(clientfd);
-			exit(0);
+		if (t_end){
+			if (now >= t_end + DRAIN_NS){
+				for (int i = 0; i < w->nconns; i++)
+					if (w->conns[i]->fd >= 0)
+						conn_close(w, w->conns[i]);
+				break;
+			}
+			if (now < t_end && t_end < wake)
+				wake = t_end;
+			else if (now >= t_end && t_end + DRAIN_NS < wake)
+				wake = t_end + DRAIN_NS;
+		}
+		if (wake != UINT64_MAX && wake != w->armed){
+			struct itimerspec its = {{0, 0}, {wake / 1000000000ull, wake % 1000000000ull}};
+			timerfd_settime(w->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+			w->armed = wake;
 		}
-		/*	parten process		*/
-		/*else{
-			for(i=0;i<num_client;i++){
-				waitpid(pids[i], &status, 0);
+
+		n = epoll_wait(w->epfd, evs, MAX_EVENTS, wake <= now ? 0 : -1);
+		for (int i = 0; i < n; i++){
+			conn_t* c = evs[i].data.ptr;
+			uint64_t expired;
+
+			if (c == NULL){
+				if (read(w->tfd, &expired, sizeof(expired)) > 0)
+					w->armed = 0;
+				continue;
 			}
-		}*/
-		runprocess++;
+			if (c->fd < 0)
+				continue;
+			if ((evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && !conn_read(w, c)){
+				conn_close(w, c);
+				alive--;
+			}
+		}
+		now = now_ns();
 	}
-	for(i=0;i<num_client;i++){
-		waitpid(pids[i], &status, 0);
+	Close(w->tfd);
+	Close(w->epfd);
+	return NULL;
+}
+
+static void usage(char* prog){
+	fprintf(stderr, "usage: %s <host> <port> <conn#> [--threads N] [--duration SEC] [--orders N]\n"
+		"\t[--rate R] [--pipeline-depth N] [--mix S,B,T] [--stocks N] [--binary]\n", prog);
+	exit(0);
+}
+
+int main(int argc, char **argv)
+{
+	worker_t* workers;
+	conn_t* conns;
+	uint64_t done = 0, rejected = 0, errors = 0, sum = 0, min = UINT64_MAX, max = 0, last = 0;
+	uint64_t* hist;
+	double sec, tput, p[4];
+	int opt;
+	static struct option options[] = {
+		{"threads", required_argument, NULL, 't'},
+		{"duration", required_argument, NULL, 'D'},
+		{"orders", required_argument, NULL, 'o'},
+		{"rate", required_argument, NULL, 'r'},
+		{"pipeline-depth", required_argument, NULL, 'd'},
+		{"mix", required_argument, NULL, 'm'},
+		{"stocks", required_argument, NULL, 's'},
+		{"binary", no_argument, NULL, 'b'},
+		{NULL, 0, NULL, 0}
+	};
+
+	cfg.depth = 1;
+	cfg.stocks = 5;
+	cfg.mix[0] = cfg.mix[1] = cfg.mix[2] = 1;
+	while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1){
+		switch (opt){
+		case 't': cfg.threads = atoi(optarg); break;
+		case 'D': cfg.duration = atof(optarg); break;
+		case 'o': cfg.orders = atol(optarg); break;
+		case 'r': cfg.rate = atof(optarg); break;
+		case 'd': cfg.depth = atoi(optarg); break;
+		case 's': cfg.stocks = atoi(optarg); break;
+		case 'b': cfg.binary = 1; break;
+		case 'm':
+			if (sscanf(optarg, "%d,%d,%d", &cfg.mix[0], &cfg.mix[1], &cfg.mix[2]) != 3)
+				usage(argv[0]);
+			break;
+		default: usage(argv[0]);
+		}
 	}
+	if (argc - optind != 3)
+		usage(argv[0]);
+	cfg.host = argv[optind];
+	cfg.port = argv[optind + 1];
+	cfg.conns = atoi(argv[optind + 2]);
+	if (cfg.threads == 0)
+		cfg.threads = cfg.conns < 4 ? cfg.conns : 4;
+	if (cfg.duration == 0 && cfg.orders == 0)
+		cfg.duration = 10;
+	if (cfg.conns < 1 || cfg.threads < 1 || cfg.threads > cfg.conns || cfg.depth < 1 || cfg.stocks < 1
+		|| cfg.duration < 0 || cfg.orders < 0 || cfg.rate < 0
+		|| cfg.mix[0] < 0 || cfg.mix[1] < 0 || cfg.mix[2] < 0 || cfg.mix[0] + cfg.mix[1] + cfg.mix[2] == 0)
+		usage(argv[0]);
+	signal(SIGPIPE, SIG_IGN);
+	hello_len = sprintf(hello_msg, "hello %d\n", cfg.binary ? 3 : 2);
 
+	/*	연결 i는 thread i % threads가 맡는다	*/
+	workers = Calloc(cfg.threads, sizeof(worker_t));
+	conns = Calloc(cfg.conns, sizeof(conn_t));
+	for (int t = 0; t < cfg.threads; t++){
+		workers[t].conns = Malloc((cfg.conns / cfg.threads + 1) * sizeof(conn_t*));
+		workers[t].seed = (unsigned int)getpid() * 31 + t;
+		workers[t].min = UINT64_MAX;
+	}
+	for (int i = 0; i < cfg.conns; i++){
+		worker_t* w = &workers[i % cfg.threads];
+		w->conns[w->nconns++] = &conns[i];
+	}
+
+	pthread_barrier_init(&barrier, NULL, cfg.threads + 1);
+	for (int t = 0; t < cfg.threads; t++)
+		Pthread_create(&workers[t].tid, NULL, worker, &workers[t]);
+	pthread_barrier_wait(&barrier);
+	t_start = now_ns();
+	t_end = cfg.duration > 0 ? t_start + (uint64_t)(cfg.duration * 1e9) : 0;
+	pthread_barrier_wait(&barrier);
+
+	hist = Calloc(HIST_BUCKETS, sizeof(uint64_t));
+	for (int t = 0; t < cfg.threads; t++){
+		worker_t* w = &workers[t];
 
-	/*clientfd = Open_clientfd(host, port);
-	Rio_readinitb(&rio, clientfd);
+		Pthread_join(w->tid, NULL);
+		done += w->done;
+		rejected += w->rejected;
+		errors += w->errors;
+		sum += w->sum;
+		min = w->min < min ? w->min : min;
+		max = w->max > max ? w->max : max;
+		last = w->last > last ? w->last : last;
+		for (int i = 0; i < HIST_BUCKETS; i++)
+			hist[i] += w->hist[i];
+	}
+	if (done == 0)
+		min = 0;
 
-	while (Fgets(buf, MAXLINE, stdin) != NULL) {
-		Rio_writen(clientfd, buf, strlen(buf));
-		Rio_readlineb(&rio, buf, MAXLINE);
-		Fputs(buf, stdout);
+	/*	처리량은 시작부터 마지막 응답까지 기준	*/
+	sec = last > t_start ? (last - t_start) / 1e9 : 0;
+	tput = sec > 0 ? done / sec : 0;
+	for (int i = 0; i < 4; i++){
+		static const double q[4] = {0.50, 0.90, 0.99, 0.999};
+		uint64_t v = hist_percentile(hist, done, q[i]);
+		p[i] = (v > max ? max : v < min ? min : v) / 1e3; // bucket 대표값이 실제 범위를 넘지 않게
 	}
 
-	Close(clientfd); //line:netp:echoclient:close
-	exit(0);*/
+	fprintf(stderr, "conns=%d threads=%d %s %s mix=%d,%d,%d: %.3f s\n",
+		cfg.conns, cfg.threads, cfg.rate > 0 ? "open" : "closed", cfg.binary ? "binary" : "text",
+		cfg.mix[0], cfg.mix[1], cfg.mix[2], sec);
+	fprintf(stderr, "requests %llu (rejected %llu, errors %llu), %.0f req/s\n",
+		(unsigned long long)done, (unsigned long long)rejected, (unsigned long long)errors, tput);
+	fprintf(stderr, "latency us: min %.1f mean %.1f p50 %.1f p90 %.1f p99 %.1f p999 %.1f max %.1f\n",
+		min / 1e3, done ? sum / 1e3 / done : 0, p[0], p[1], p[2], p[3], max / 1e3);
+
+	printf("{\"conns\":%d,\"threads\":%d,\"mode\":\"%s\",\"rate\":%.0f,\"depth\":%d,\"proto\":\"%s\","
+		"\"mix\":[%d,%d,%d],\"stocks\":%d,\"seconds\":%.3f,\"requests\":%llu,\"rejected\":%llu,\"errors\":%llu,"
+		"\"throughput\":%.1f,\"latency_us\":{\"min\":%.1f,\"mean\":%.1f,\"p50\":%.1f,\"p90\":%.1f,"
+		"\"p99\":%.1f,\"p999\":%.1f,\"max\":%.1f}}\n",
+		cfg.conns, cfg.threads, cfg.rate > 0 ? "open" : "closed", cfg.rate, cfg.depth, cfg.binary ? "binary" : "text",
+		cfg.mix[0], cfg.mix[1], cfg.mix[2], cfg.stocks, sec,
+		(unsigned long long)done, (unsigned long long)rejected, (unsigned long long)errors, tput,
+		min / 1e3, done ? sum / 1e3 / done : 0, p[0], p[1], p[2], p[3], max / 1e3);
 
+	for (int i = 0; i < cfg.conns; i++){
+		Free(conns[i].out);
+		Free(conns[i].q);
+	}
+	for (int t = 0; t < cfg.threads; t++)
+		Free(workers[t].conns);
+	Free(workers);
+	Free(conns);
+	Free(hist);
 	return 0;
 }
@@ -0,0 +1,207 @@
+/*
+ * stats.c - thread 별 통계 counter
+ */
+#include "csapp.h"
+#include "stats.h"
+#include "proto.h"
+#include <time.h>
+
+static stats_slot slots[STATS_MAX_THREADS];
+static int nslots; // 지금까지 배정한 slot 수
+static __thread stats_slot* my; // 이 thread의 slot
+static __thread int shared; // 다른 thread와 같이 쓰는 slot이면 1
+static __thread unsigned tick; // latency 표본 선택용
+static uint64_t start_ns;
+static int connections; // 연결 수는 드물게 바뀌므로 전역 counter 하나
+static pthread_key_t slot_key;
+static stats_slot* free_slots[STATS_MAX_THREADS]; // 끝난 thread가 돌려준 slot
+static int nfree;
+static pthread_mutex_t free_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// 다른 모듈이 관리하는 값 (worker 수 등), stats 출력 때 읽기만 한다
+static struct {
+    const char* name;
+    int* value;
+} gauges[STATS_MAX_GAUGES];
+static int ngauges;
+
+static const char* op_names[STATS_OPS] = {
+    [PROTO_OP_SHOW] = "show",
+    [PROTO_OP_BUY] = "buy",
+    [PROTO_OP_SELL] = "sell",
+    [PROTO_OP_EXIT] = "exit",
+    [PROTO_OP_HELLO] = "hello",
+    [PROTO_OP_BADARGS] = "badargs",
+    [PROTO_OP_UNKNOWN] = "invalid",
+    [PROTO_OP_STATS] = "stats",
+    [PROTO_OP_ORDER] = "order",
+    [PROTO_OP_LIMIT] = "limit",
+    [PROTO_OP_MARKET] = "market",
+    [PROTO_OP_CANCEL] = "cancel",
+    [PROTO_OP_BOOK] = "book",
+    [PROTO_OP_SUBSCRIBE] = "subscribe",
+    [PROTO_OP_UNSUBSCRIBE] = "unsubscribe",
+};
+
+// thread가 끝나면 혼자 쓰던 slot을 돌려준다 (쌓인 값은 합계에 계속 남는다)
+static void slot_release(void* p){
+    pthread_mutex_lock(&free_mutex);
+    free_slots[nfree++] = p;
+    pthread_mutex_unlock(&free_mutex);
+}
+
+static stats_slot* slot(void){
+    if (my == NULL){
+        pthread_mutex_lock(&free_mutex);
+        if (nfree > 0)
+            my = free_slots[--nfree];
+        pthread_mutex_unlock(&free_mutex);
+        if (my == NULL){
+            int id = __atomic_fetch_add(&nslots, 1, __ATOMIC_RELAXED);
+            my = &slots[id % STATS_MAX_THREADS];
+            shared = (id >= STATS_MAX_THREADS);
+        }
+        if (!shared)
+            pthread_setspecific(slot_key, my);
+    }
+    return my;
+}
+
+// 자기 slot은 혼자 쓰므로 load + store면 충분 (읽는 쪽은 찢어지지 않은 값만 보면 된다)
+static void add(uint64_t* p, uint64_t v){
+    if (shared)
+        __atomic_fetch_add(p, v, __ATOMIC_RELAXED);
+    else
+        __atomic_store_n(p, __atomic_load_n(p, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static uint64_t get(uint64_t* p){
+    return __atomic_load_n(p, __ATOMIC_RELAXED);
+}
+
+void stats_init(void){
+    start_ns = stats_now_ns();
+    pthread_key_create(&slot_key, slot_release);
+}
+
+uint64_t stats_now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 이번 요청의 latency를 잴 차례면 1
+int stats_sample(void){
+    return tick++ % STATS_SAMPLE == 0;
+}
+
+void stats_request(int op){
+    if (op >= 0 && op < STATS_OPS)
+        add(&slot()->req[op], 1);
+}
+
+// 표본으로 뽑힌 요청의 처리 시간
+void stats_latency(uint64_t ns){
+    int k = ns ? 64 - __builtin_clzll(ns) : 0;
+    add(&slot()->lat[k < STATS_LAT_BUCKETS ? k : STATS_LAT_BUCKETS - 1], 1);
+}
+
+void stats_buy_fail(void){
+    add(&slot()->buy_fail, 1);
+}
+
+void stats_bytes_in(size_t n){
+    add(&slot()->bytes_in, n);
+}
+
+void stats_bytes_out(size_t n){
+    add(&slot()->bytes_out, n);
+}
+
+void stats_conn(int delta){
+    __atomic_fetch_add(&connections, delta, __ATOMIC_RELAXED);
+}
+
+// 연결 하나가 큐에서 worker를 기다린 시간 (연결마다 한 번이라 표본 추출 없음)
+void stats_queue_wait(uint64_t ns){
+    int k = ns ? 64 - __builtin_clzll(ns) : 0;
+    add(&slot()->qwait[k < STATS_LAT_BUCKETS ? k : STATS_LAT_BUCKETS - 1], 1);
+}
+
+// 시작할 때 등록, "이름 값" 줄로 출력된다 (table이 가득 차면 조용히 빠지지 않게 종료)
+void stats_gauge(const char* name, int* value){
+    if (ngauges == STATS_MAX_GAUGES)
+        app_error("stats_gauge: too many gauges (raise STATS_MAX_GAUGES)");
+    gauges[ngauges].name = name;
+    gauges[ngauges].value = value;
+    ngauges++;
+}
+
+// 전체 latency 중 q 비율이 들어가는 구간의 상한 (ns)
+static uint64_t percentile(uint64_t* lat, uint64_t total, double q){
+    uint64_t need = (uint64_t)(total * q), sum = 0;
+
+    for (int k = 0; k < STATS_LAT_BUCKETS; k++){
+        sum += lat[k];
+        if (sum > need)
+            return 1ull << k;
+    }
+    return 1ull << (STATS_LAT_BUCKETS - 1);
+}
+
+// 값이 있는 가장 높은 구간의 상한 (ns)
+static uint64_t max_bucket(uint64_t* lat){
+    for (int k = STATS_LAT_BUCKETS - 1; k > 0; k--){
+        if (lat[k])
+            return 1ull << k;
+    }
+    return 1;
+}
+
+// 모든 slot을 합쳐서 "이름 값" 줄들로 출력, 쓴 길이 반환
+int stats_format(char* buf, size_t size){
+    stats_slot sum;
+    uint64_t total = 0, qtotal = 0;
+    int n = __atomic_load_n(&nslots, __ATOMIC_RELAXED), len = 0;
+
+    memset(&sum, 0, sizeof(sum));
+    for (int i = 0; i < n && i < STATS_MAX_THREADS; i++){
+        for (int k = 0; k < STATS_OPS; k++)
+            sum.req[k] += get(&slots[i].req[k]);
+        for (int k = 0; k < STATS_LAT_BUCKETS; k++){
+            sum.lat[k] += get(&slots[i].lat[k]);
+            sum.qwait[k] += get(&slots[i].qwait[k]);
+        }
+        sum.buy_fail += get(&slots[i].buy_fail);
+        sum.bytes_in += get(&slots[i].bytes_in);
+        sum.bytes_out += get(&slots[i].bytes_out);
+    }
+    for (int k = 0; k < STATS_LAT_BUCKETS; k++){
+        total += sum.lat[k];
+        qtotal += sum.qwait[k];
+    }
+
+#define OUT(...) (len += snprintf(buf + len, len < (int)size ? size - len : 0, __VA_ARGS__))
+    OUT("uptime_s %llu\n", (unsigned long long)((stats_now_ns() - start_ns) / 1000000000ull));
+    OUT("connections %d\n", __atomic_load_n(&connections, __ATOMIC_RELAXED));
+    for (int k = 0; k < ngauges; k++)
+        OUT("%s %d\n", gauges[k].name, __atomic_load_n(gauges[k].value, __ATOMIC_RELAXED));
+    for (int k = 0; k < STATS_OPS; k++){
+        if (op_names[k])
+            OUT("req_%s %llu\n", op_names[k], (unsigned long long)sum.req[k]);
+    }
+    OUT("buy_fail %llu\n", (unsigned long long)sum.buy_fail);
+    OUT("bytes_in %llu\n", (unsigned long long)sum.bytes_in);
+    OUT("bytes_out %llu\n", (unsigned long long)sum.bytes_out);
+    // 2의 거듭제곱 구간이라 실제 값보다 최대 2배 크게 나올 수 있다
+    OUT("latency_ns_p50 %llu\n", (unsigned long long)percentile(sum.lat, total, 0.50));
+    OUT("latency_ns_p99 %llu\n", (unsigned long long)percentile(sum.lat, total, 0.99));
+    OUT("latency_ns_p999 %llu\n", (unsigned long long)percentile(sum.lat, total, 0.999));
+    if (qtotal > 0){
+        OUT("queue_wait_ns_p50 %llu\n", (unsigned long long)percentile(sum.qwait, qtotal, 0.50));
+        OUT("queue_wait_ns_p99 %llu\n", (unsigned long long)percentile(sum.qwait, qtotal, 0.99));
+        OUT("queue_wait_ns_max %llu\n", (unsigned long long)max_bucket(sum.qwait));
+    }
+#undef OUT
+    return len < (int)size ? len : (int)size - 1;
+}
@@ -0,0 +1,45 @@
+/*
+ * stats.h - server 통계 (요청 종류별 개수, byte 수, buy 실패, 처리 latency)
+ *
+ * thread마다 cache line 단위로 떨어진 counter 묶음을 하나씩 가지고 자기 것만 증가시킨다.
+ * 전역 lock이나 공유 cache line이 없고 (lock prefix 없는 load + store),
+ * "stats" 명령이 들어왔을 때만 모든 thread의 값을 합친다.
+ * latency는 clock_gettime 비용 때문에 thread 별로 STATS_SAMPLE개 중 하나만 잰다.
+ * 끝난 thread의 slot은 값을 그대로 둔 채 다음에 생기는 thread가 이어서 쓴다.
+ */
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define STATS_CACHELINE 64
+#define STATS_MAX_THREADS 256 // 넘으면 slot을 나눠 쓰고 atomic add로 증가
+#define STATS_SAMPLE 16 // latency 표본 간격
+#define STATS_OPS 16 // proto.h의 PROTO_OP_* 번호
+#define STATS_LAT_BUCKETS 40 // latency log2(ns) 구간
+#define STATS_MAX_GAUGES 32 // 넘게 등록하면 stats_gauge가 app_error
+
+typedef struct {
+    uint64_t req[STATS_OPS];
+    uint64_t buy_fail;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t lat[STATS_LAT_BUCKETS]; // [k]: 2^(k-1) <= ns < 2^k
+    uint64_t qwait[STATS_LAT_BUCKETS]; // 연결이 worker를 기다린 시간, 구간은 lat과 같다
+} __attribute__((aligned(STATS_CACHELINE))) stats_slot;
+
+void stats_init(void);
+uint64_t stats_now_ns(void);
+int stats_sample(void);
+void stats_request(int);
+void stats_latency(uint64_t);
+void stats_buy_fail(void);
+void stats_bytes_in(size_t);
+void stats_bytes_out(size_t);
+void stats_conn(int);
+void stats_queue_wait(uint64_t);
+void stats_gauge(const char*, int*);
+int stats_format(char*, size_t);
+
+#endif /* __STATS_H__ */
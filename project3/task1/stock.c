@@ -0,0 +1,713 @@
+/*
+ * stock.c - mmap 기반 주식 테이블 (정렬된 struct-of-arrays + 이진 탐색) + write-ahead log
+ */
+#include "csapp.h"
+#include "stock.h"
+
+#define ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+static int cmp_entry(const void* a, const void* b){
+    int x = ((const stock_entry*)a)->ID, y = ((const stock_entry*)b)->ID;
+    return (x > y) - (x < y);
+}
+
+static size_t db_size(size_t n, size_t* recs_off){
+    *recs_off = ALIGN8(sizeof(stock_db_hdr) + n * sizeof(int32_t));
+    return *recs_off + n * sizeof(Item);
+}
+
+// write()가 중간에 끊겨도 모두 쓸 때까지 반복
+static int write_all(int fd, const void* buf, size_t n){
+    const char* p = buf;
+    while (n > 0){
+        ssize_t w = write(fd, p, n);
+        if (w < 0){
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += w;
+        n -= w;
+    }
+    return 0;
+}
+
+// rename 결과가 crash 후에도 남도록 path가 속한 디렉토리를 fsync
+static int fsync_dir(const char* path){
+    char dir[256];
+    char* slash;
+    int fd, rc;
+
+    snprintf(dir, sizeof(dir), "%s", path);
+    if ((slash = strrchr(dir, '/')) != NULL)
+        *(slash == dir ? slash + 1 : slash) = '\0';
+    else
+        strcpy(dir, ".");
+    if ((fd = open(dir, O_RDONLY)) < 0)
+        return -1;
+    rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+static void wal_path(char* buf, size_t n, const char* db, uint64_t gen){
+    snprintf(buf, n, "%s.wal.%llu", db, (unsigned long long)gen);
+}
+
+static uint32_t wal_check(const stock_wal_rec* rec){
+    uint32_t d = (uint32_t)rec->delta;
+    return STOCK_WAL_MAGIC ^ ((uint32_t)rec->ID * 2654435761u) ^ ((d << 16) | (d >> 16));
+}
+
+static uint32_t wal_batch_check(const stock_wal_rec* rec){
+    return STOCK_WAL_BATCH_MAGIC ^ ((uint32_t)rec->ID * 2654435761u);
+}
+
+static uint32_t wal_price_check(const stock_wal_rec* rec){
+    uint32_t d = (uint32_t)rec->delta;
+    return STOCK_WAL_PRICE_MAGIC ^ ((uint32_t)rec->ID * 2654435761u) ^ ((d << 16) | (d >> 16));
+}
+
+static int find_idx(const int32_t* ids, int n, int ID){
+    const int32_t* base = ids;
+
+    if (n == 0) return -1;
+    while (n > 1){
+        int half = n / 2;
+        base = (base[half] <= ID) ? base + half : base;
+        n -= half;
+    }
+    return (*base == ID) ? (int)(base - ids) : -1;
+}
+
+static int check_hdr(const char* map, size_t len){
+    const stock_db_hdr* hdr = (const stock_db_hdr*)map;
+    size_t recs_off;
+
+    return len >= sizeof(stock_db_hdr) &&
+           hdr->magic == STOCK_DB_MAGIC && hdr->version == STOCK_DB_VERSION &&
+           hdr->count <= INT32_MAX && db_size(hdr->count, &recs_off) <= len &&
+           hdr->ids_off == sizeof(stock_db_hdr) && hdr->recs_off == recs_off;
+}
+
+// db 파일을 쓰기 가능한 MAP_PRIVATE로 map (변경 사항은 파일에 반영되지 않는다)
+static char* map_db(const char* db, size_t* len){
+    struct stat st;
+    char* map;
+    int fd;
+
+    if ((fd = open(db, O_RDONLY)) < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0){
+        close(fd);
+        return NULL;
+    }
+    *len = st.st_size;
+    map = mmap(NULL, *len ? *len : 1, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    if (!check_hdr(map, *len)){
+        munmap(map, *len ? *len : 1);
+        errno = EINVAL;
+        return NULL;
+    }
+    return map;
+}
+
+// 세그먼트 하나를 replay, *valid에는 마지막 정상 레코드까지의 길이를 저장
+static int wal_replay(const char* path, const int32_t* ids, Item* recs, int n, off_t* valid){
+    stock_wal_rec buf[512];
+    ssize_t r;
+    int fd;
+
+    *valid = 0;
+    if ((fd = open(path, O_RDONLY)) < 0)
+        return -1;
+    while ((r = read(fd, buf, sizeof(buf))) > 0){
+        int k, j, legs, cnt = r / sizeof(stock_wal_rec), partial = 0;
+        for (k = 0; k < cnt; k++){
+            legs = 0;
+            if (buf[k].check == wal_batch_check(&buf[k]) && buf[k].delta == 0){
+                // order: leg가 이 chunk 안에 모두 온전히 있어야 반영
+                legs = buf[k].ID;
+                if (legs <= 0 || legs > STOCK_ORDER_MAX)
+                    break;
+                if (k + legs >= cnt){
+                    partial = 1;
+                    break;
+                }
+                for (j = 1; j <= legs && buf[k + j].check == wal_check(&buf[k + j]); j++)
+                    ;
+                if (j <= legs)
+                    break;
+                k++;
+            } else if (buf[k].check == wal_price_check(&buf[k])){
+                int idx = find_idx(ids, n, buf[k].ID);
+                if (idx >= 0)
+                    recs[idx].price = buf[k].delta;
+                continue;
+            } else if (buf[k].check != wal_check(&buf[k])){
+                break;
+            }
+            for (j = k; j <= k + (legs ? legs - 1 : 0); j++){
+                int idx = find_idx(ids, n, buf[j].ID);
+                if (idx >= 0)
+                    recs[idx].left_stock += buf[j].delta;
+            }
+            if (legs)
+                k += legs - 1;
+        }
+        *valid += k * sizeof(stock_wal_rec);
+        // chunk 끝에 걸친 order는 header부터 다시 읽는다
+        if (partial && k > 0 && r == sizeof(buf)){
+            if (lseek(fd, *valid, SEEK_SET) < 0)
+                break;
+            continue;
+        }
+        if (k < cnt || r % sizeof(stock_wal_rec))
+            break; // 잘린 tail
+        if (lseek(fd, *valid, SEEK_SET) < 0)
+            break;
+    }
+    close(fd);
+    return 0;
+}
+
+// entries를 ID 순으로 정렬 & 중복 제거 후 db 파일 생성 (tmp 파일에 쓰고 rename)
+int stock_create(const char* db, stock_entry* entries, int n){
+    char tmp[MAXLINE];
+    size_t recs_off, size;
+    int i, m = 0, fd;
+    char* map;
+
+    // price의 부호 bit는 STOCK_LOCKED로 쓴다
+    for (i = 0; i < n; i++){
+        if (entries[i].price < 0){
+            errno = EINVAL;
+            return -1;
+        }
+    }
+    qsort(entries, n, sizeof(stock_entry), cmp_entry);
+    for (i = 0; i < n; i++){
+        if (m > 0 && entries[m-1].ID == entries[i].ID)
+            continue;
+        entries[m++] = entries[i];
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", db);
+    if ((fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, DEF_MODE)) < 0)
+        return -1;
+    size = db_size(m, &recs_off);
+    if (ftruncate(fd, size) < 0){
+        close(fd);
+        return -1;
+    }
+    if ((map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED){
+        close(fd);
+        return -1;
+    }
+
+    stock_db_hdr* hdr = (stock_db_hdr*)map;
+    int32_t* ids = (int32_t*)(map + sizeof(stock_db_hdr));
+    Item* recs = (Item*)(map + recs_off);
+
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->magic = STOCK_DB_MAGIC;
+    hdr->version = STOCK_DB_VERSION;
+    hdr->count = m;
+    hdr->ids_off = sizeof(stock_db_hdr);
+    hdr->recs_off = recs_off;
+    for (i = 0; i < m; i++){
+        ids[i] = entries[i].ID;
+        recs[i].left_stock = entries[i].left_stock;
+        recs[i].price = entries[i].price;
+    }
+
+    int rc = msync(map, size, MS_SYNC);
+    munmap(map, size);
+    if (rc < 0 || fsync(fd) < 0){
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    if (rename(tmp, db) < 0)
+        return -1;
+    return fsync_dir(db);
+}
+
+// "ID 잔량 가격" 형식의 txt 파일 -> db 파일
+int stock_import_text(const char* txt, const char* db){
+    struct stat st;
+    int fd, n = 0, cap = 0;
+    stock_entry* entries = NULL;
+    char* text = NULL;
+
+    if ((fd = open(txt, O_RDONLY)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0){
+        close(fd);
+        return -1;
+    }
+    if (st.st_size > 0 &&
+        (text = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED){
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    // fscanf 대신 직접 파싱
+    const char* p = text;
+    const char* end = text + st.st_size;
+    while (p < end){
+        long v[3];
+        int k;
+        for (k = 0; k < 3; k++){
+            while (p < end && isspace((unsigned char)*p)) p++;
+            if (p == end) break;
+            int neg = (*p == '-');
+            if (neg || *p == '+') p++;
+            if (p == end || !isdigit((unsigned char)*p)) break;
+            for (v[k] = 0; p < end && isdigit((unsigned char)*p); p++)
+                v[k] = v[k] * 10 + (*p - '0');
+            if (neg) v[k] = -v[k];
+        }
+        if (k < 3) break;
+
+        if (n == cap){
+            cap = cap ? cap * 2 : 1024;
+            entries = Realloc(entries, cap * sizeof(stock_entry));
+        }
+        entries[n].ID = v[0];
+        entries[n].left_stock = v[1];
+        entries[n].price = v[2];
+        n++;
+    }
+    if (text)
+        munmap(text, st.st_size);
+
+    int rc = stock_create(db, entries, n);
+    free(entries);
+    return rc;
+}
+
+// db -> txt (tmp 파일에 쓰고 rename)
+int stock_export_text(stock_table* t, const char* txt){
+    char tmp[MAXLINE], line[64];
+    char* buf = Malloc(MAXBUF);
+    int fd, len = 0, rc = 0;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", txt);
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, DEF_MODE)) < 0){
+        free(buf);
+        return -1;
+    }
+    for (int i = 0; i < t->count && rc == 0; i++){
+        Item item = stock_get(t, i);
+        int n = snprintf(line, sizeof(line), "%d %d %d\n", t->ids[i], item.left_stock, item.price);
+        if (len + n > MAXBUF){
+            rc = write_all(fd, buf, len);
+            len = 0;
+        }
+        memcpy(buf + len, line, n);
+        len += n;
+    }
+    if (rc == 0)
+        rc = write_all(fd, buf, len);
+    free(buf);
+    if (rc == 0)
+        rc = fsync(fd);
+    close(fd);
+    if (rc < 0 || rename(tmp, txt) < 0)
+        return -1;
+    return fsync_dir(txt);
+}
+
+// db 파일을 그대로 mmap, WAL은 사용하지 않는다
+int stock_open(stock_table* t, const char* db){
+    stock_db_hdr* hdr;
+
+    if ((t->map = map_db(db, &t->maplen)) == NULL)
+        return -1;
+    hdr = (stock_db_hdr*)t->map;
+    snprintf(t->db, sizeof(t->db), "%s", db);
+    t->count = hdr->count;
+    t->ids = (int32_t*)(t->map + hdr->ids_off);
+    t->recs = (Item*)(t->map + hdr->recs_off);
+    t->snap_gen = t->wal_gen = hdr->wal_gen;
+    t->wal_fd = -1;
+    t->wal_size = 0;
+    t->wal_dirty = 0;
+    t->show_dirty = ~0u;
+    return 0;
+}
+
+// db가 있으면 map 후 WAL replay, 없으면 txt 파일을 import
+int stock_load(stock_table* t, const char* db, const char* txt){
+    char path[300];
+    pthread_rwlockattr_t attr;
+    uint64_t gen;
+    off_t valid = 0;
+
+    if (access(db, F_OK) < 0){
+        // 새로 import 하는 경우 이전 db의 세그먼트는 무효
+        for (gen = 1; wal_path(path, sizeof(path), db, gen), unlink(path) == 0; gen++)
+            ;
+        if (stock_import_text(txt, db) < 0)
+            return -1;
+    }
+    if (stock_open(t, db) < 0)
+        return -1;
+
+    // 스냅샷 이후의 세그먼트를 순서대로 replay, 마지막 세그먼트에 이어서 append
+    t->wal_gen = t->snap_gen + 1;
+    for (gen = t->snap_gen + 1; ; gen++){
+        off_t v;
+        wal_path(path, sizeof(path), db, gen);
+        if (wal_replay(path, t->ids, t->recs, t->count, &v) < 0)
+            break;
+        t->wal_gen = gen;
+        valid = v;
+    }
+    wal_path(path, sizeof(path), db, t->wal_gen);
+    if ((t->wal_fd = open(path, O_WRONLY | O_CREAT | O_APPEND, DEF_MODE)) < 0)
+        return -1;
+    if (ftruncate(t->wal_fd, valid) < 0)
+        return -1;
+    t->wal_size = valid;
+
+    pthread_rwlockattr_init(&attr);
+    pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+    pthread_rwlock_init(&t->wal_lock, &attr);
+    pthread_rwlockattr_destroy(&attr);
+    pthread_mutex_init(&t->compact_mutex, NULL);
+    pthread_mutex_init(&t->price_mutex, NULL);
+    return 0;
+}
+
+// 잔량 변화량을 현재 세그먼트에 append (O_APPEND 단일 write라 thread 간 섞이지 않는다)
+// delta는 교환 법칙이 성립하므로 CAS 순서와 append 순서가 달라도 replay 결과는 같다
+void stock_log(stock_table* t, int idx, int delta){
+    stock_wal_rec rec;
+
+    if (t->wal_fd < 0)
+        return; // stock_open()으로 연 테이블
+
+    rec.ID = t->ids[idx];
+    rec.delta = delta;
+    rec.check = wal_check(&rec);
+
+    pthread_rwlock_rdlock(&t->wal_lock);
+    if (write_all(t->wal_fd, &rec, sizeof(rec)) < 0)
+        unix_error("stock_log error");
+    __atomic_add_fetch(&t->wal_size, sizeof(rec), __ATOMIC_RELAXED);
+    __atomic_store_n(&t->wal_dirty, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&t->wal_lock);
+}
+
+// 현재 세그먼트를 디스크에 반영
+int stock_flush(stock_table* t){
+    int rc = 0;
+
+    pthread_rwlock_rdlock(&t->wal_lock);
+    if (__atomic_exchange_n(&t->wal_dirty, 0, __ATOMIC_RELAXED))
+        rc = fdatasync(t->wal_fd);
+    pthread_rwlock_unlock(&t->wal_lock);
+    return rc;
+}
+
+/*
+세그먼트를 교체하고, (이전 스냅샷 + 닫힌 세그먼트)로 새 스냅샷 생성
+실행 중인 테이블은 건드리지 않으므로 buy/sell과 동시에 수행 가능
+*/
+int stock_compact(stock_table* t){
+    char path[300], tmp[300];
+    uint64_t gen, old_gen;
+    size_t len;
+    char* map;
+    int fd, old_fd, rc = -1;
+
+    pthread_mutex_lock(&t->compact_mutex);
+
+    // 1. 세그먼트 교체
+    old_gen = t->wal_gen;
+    wal_path(path, sizeof(path), t->db, old_gen + 1);
+    if ((fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, DEF_MODE)) < 0)
+        goto out;
+    pthread_rwlock_wrlock(&t->wal_lock);
+    old_fd = t->wal_fd;
+    t->wal_fd = fd;
+    t->wal_gen = old_gen + 1;
+    t->wal_size = 0;
+    t->wal_dirty = 0;
+    pthread_rwlock_unlock(&t->wal_lock);
+    rc = fdatasync(old_fd);
+    close(old_fd);
+    if (rc < 0)
+        goto out;
+
+    // 2. 이전 스냅샷에 닫힌 세그먼트 적용
+    rc = -1;
+    if ((map = map_db(t->db, &len)) == NULL)
+        goto out;
+    stock_db_hdr* hdr = (stock_db_hdr*)map;
+    for (gen = t->snap_gen + 1; gen <= old_gen; gen++){
+        off_t valid;
+        wal_path(path, sizeof(path), t->db, gen);
+        wal_replay(path, (int32_t*)(map + hdr->ids_off), (Item*)(map + hdr->recs_off),
+                   hdr->count, &valid);
+    }
+    hdr->wal_gen = old_gen;
+
+    // 3. tmp 파일에 쓰고 rename
+    snprintf(tmp, sizeof(tmp), "%s.tmp", t->db);
+    if ((fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, DEF_MODE)) >= 0){
+        if (write_all(fd, map, len) == 0 && fsync(fd) == 0)
+            rc = 0;
+        close(fd);
+    }
+    munmap(map, len);
+    if (rc < 0 || rename(tmp, t->db) < 0 || fsync_dir(t->db) < 0){
+        rc = -1;
+        goto out;
+    }
+
+    // 4. 반영된 세그먼트 삭제
+    for (gen = t->snap_gen + 1; gen <= old_gen; gen++){
+        wal_path(path, sizeof(path), t->db, gen);
+        unlink(path);
+    }
+    t->snap_gen = old_gen;
+
+out:
+    pthread_mutex_unlock(&t->compact_mutex);
+    return rc;
+}
+
+// 주기적으로 fdatasync, 세그먼트가 커지면 compaction
+static void* sync_thread(void* vargp){
+    stock_table* t = vargp;
+
+    Pthread_detach(pthread_self());
+    while (1){
+        usleep(STOCK_SYNC_MS * 1000);
+        if (stock_flush(t) < 0)
+            perror("stock_flush");
+        if (__atomic_load_n(&t->wal_size, __ATOMIC_RELAXED) >= STOCK_COMPACT_BYTES &&
+            stock_compact(t) < 0)
+            perror("stock_compact");
+    }
+    return NULL;
+}
+
+void stock_start_sync(stock_table* t){
+    Pthread_create(&t->tid, NULL, sync_thread, t);
+}
+
+void stock_close(stock_table* t){
+    munmap(t->map, t->maplen ? t->maplen : 1);
+    if (t->wal_fd >= 0)
+        close(t->wal_fd);
+}
+
+int stock_find(stock_table* t, int ID){
+    return find_idx(t->ids, t->count, ID);
+}
+
+// order가 잡고 있으면 풀릴 때까지 기다린 뒤의 값 (order는 메모리 연산만 하고 바로 푼다)
+static Item load_unlocked(Item* rec){
+    Item item;
+
+    for (int spin = 0; ; spin++){
+        item.word = __atomic_load_n(&rec->word, __ATOMIC_ACQUIRE);
+        if (!(item.word & STOCK_LOCKED))
+            return item;
+        if (spin % 64 == 63)
+            sched_yield();
+    }
+}
+
+// lock 없이 일관된 (잔량, 가격) 스냅샷
+Item stock_get(stock_table* t, int idx){
+    return load_unlocked(&t->recs[idx]);
+}
+
+/*
+show 캐시 무효화: 모든 bit가 이미 켜져 있으면 읽기만 하므로
+buy/sell이 몰려도 같은 cache line에 계속 쓰지 않는다
+*/
+static void mark_dirty(stock_table* t){
+    if (__atomic_load_n(&t->show_dirty, __ATOMIC_SEQ_CST) != ~0u)
+        __atomic_fetch_or(&t->show_dirty, ~0u, __ATOMIC_RELEASE);
+}
+
+// bit가 켜져 있었으면 끄고 1 (호출한 쪽이 캐시를 다시 만든다)
+int stock_take_dirty(stock_table* t, uint32_t bit){
+    if (!(__atomic_load_n(&t->show_dirty, __ATOMIC_ACQUIRE) & bit))
+        return 0;
+    return (__atomic_fetch_and(&t->show_dirty, ~bit, __ATOMIC_SEQ_CST) & bit) != 0;
+}
+
+// 잔량이 충분할 때만 CAS로 차감, 성공 1 / 잔량 부족 0
+// CAS는 lock bit가 꺼진 값을 기대하므로 order가 잡고 있는 동안에는 실패한다
+int stock_buy(stock_table* t, int idx, int count){
+    Item old, new;
+
+    do {
+        old = load_unlocked(&t->recs[idx]);
+        if (old.left_stock < count)
+            return 0;
+        new = old;
+        new.left_stock -= count;
+    } while (!__atomic_compare_exchange_n(&t->recs[idx].word, &old.word, new.word, 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    mark_dirty(t);
+    stock_log(t, idx, -count);
+    return 1;
+}
+
+// 더한 잔량이 int32를 넘지 않을 때만 CAS로 더한다, 성공 1 / 범위 초과 0
+int stock_sell(stock_table* t, int idx, int count){
+    Item old, new;
+
+    do {
+        old = load_unlocked(&t->recs[idx]);
+        if ((int64_t)old.left_stock + count > INT32_MAX)
+            return 0;
+        new = old;
+        new.left_stock += count;
+    } while (!__atomic_compare_exchange_n(&t->recs[idx].word, &old.word, new.word, 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    mark_dirty(t);
+    stock_log(t, idx, count);
+    return 1;
+}
+
+static int cmp_leg(const void* a, const void* b){
+    int x = ((const stock_leg*)a)->idx, y = ((const stock_leg*)b)->idx;
+    return (x > y) - (x < y);
+}
+
+// order의 leg들을 header와 함께 write 한 번으로 기록
+static void stock_log_order(stock_table* t, stock_leg* legs, int n){
+    stock_wal_rec recs[STOCK_ORDER_MAX + 1];
+
+    if (t->wal_fd < 0)
+        return;
+    recs[0].ID = n;
+    recs[0].delta = 0;
+    recs[0].check = wal_batch_check(&recs[0]);
+    for (int i = 0; i < n; i++){
+        recs[i + 1].ID = t->ids[legs[i].idx];
+        recs[i + 1].delta = legs[i].delta;
+        recs[i + 1].check = wal_check(&recs[i + 1]);
+    }
+
+    pthread_rwlock_rdlock(&t->wal_lock);
+    if (write_all(t->wal_fd, recs, (n + 1) * sizeof(stock_wal_rec)) < 0)
+        unix_error("stock_log error");
+    __atomic_add_fetch(&t->wal_size, (n + 1) * sizeof(stock_wal_rec), __ATOMIC_RELAXED);
+    __atomic_store_n(&t->wal_dirty, 1, __ATOMIC_RELAXED);
+    pthread_rwlock_unlock(&t->wal_lock);
+}
+
+/*
+여러 종목의 잔량 변화를 전부 반영하거나 하나도 반영하지 않는다
+성공 1 / 잔량 부족 0 / 결과 잔량이 INT32_MAX 초과 -1
+같은 종목의 leg는 int64로 합쳐서 결과 잔량이 0 이상 INT32_MAX 이하이면 된다
+legs는 idx 순으로 정렬되고 합쳐진다 (idx 순서 = ID 순서로 lock을 잡아 deadlock 방지)
+*/
+int stock_order(stock_table* t, stock_leg* legs, int n){
+    Item old[STOCK_ORDER_MAX], new;
+    int64_t left;
+    int i, m = 0, locked, ok = 1;
+
+    if (n <= 0 || n > STOCK_ORDER_MAX)
+        return 0;
+    qsort(legs, n, sizeof(stock_leg), cmp_leg);
+    for (i = 0; i < n; i++){
+        if (m > 0 && legs[m-1].idx == legs[i].idx){
+            // 합이 int32를 벗어나면 어떤 잔량에 더해도 0~INT32_MAX 밖이다
+            int64_t sum = (int64_t)legs[m-1].delta + legs[i].delta;
+            if (sum < INT32_MIN)
+                return 0;
+            if (sum > INT32_MAX)
+                return -1;
+            legs[m-1].delta = sum;
+        }
+        else
+            legs[m++] = legs[i];
+    }
+
+    // lock bit 잡기: 풀린 값에서 bit만 켜는 CAS, 결과 잔량이 범위를 벗어나는 leg를 만나면 거기서 멈춘다
+    for (locked = 0; locked < m && ok == 1; locked++){
+        Item* rec = &t->recs[legs[locked].idx];
+        do {
+            old[locked] = load_unlocked(rec);
+        } while (!__atomic_compare_exchange_n(&rec->word, &old[locked].word, old[locked].word | STOCK_LOCKED, 1,
+                                              __ATOMIC_ACQUIRE, __ATOMIC_RELAXED));
+        left = (int64_t)old[locked].left_stock + legs[locked].delta;
+        if (left < 0)
+            ok = 0;
+        else if (left > INT32_MAX)
+            ok = -1;
+    }
+
+    // 새 값 (실패면 이전 값)을 저장하면서 lock도 같이 푼다
+    for (i = 0; i < locked; i++){
+        new = old[i];
+        if (ok == 1)
+            new.left_stock += legs[i].delta;
+        __atomic_store_n(&t->recs[legs[i].idx].word, new.word, __ATOMIC_RELEASE);
+    }
+    if (ok != 1)
+        return ok;
+    mark_dirty(t);
+    stock_log_order(t, legs, m);
+    return 1;
+}
+
+// 가격이 바뀌었으면 1 (잔량은 그대로)
+static int swap_price(stock_table* t, int idx, int price){
+    Item old, new;
+
+    do {
+        old = load_unlocked(&t->recs[idx]);
+        if (old.price == price)
+            return 0;
+        new = old;
+        new.price = price;
+    } while (!__atomic_compare_exchange_n(&t->recs[idx].word, &old.word, new.word, 1,
+                                          __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    mark_dirty(t);
+    return 1;
+}
+
+/*
+체결가로 가격 변경 (잔량은 그대로), WAL에는 가격 레코드로 남긴다
+가격 레코드는 delta와 달리 replay에서 마지막 값이 남으므로
+CAS와 append를 price_mutex 안에서 해서 두 순서가 같게 한다
+*/
+void stock_set_price(stock_table* t, int idx, int price){
+    stock_wal_rec rec;
+
+    if (price < 0)
+        return;
+    if (t->wal_fd < 0){
+        swap_price(t, idx, price);
+        return;
+    }
+
+    pthread_mutex_lock(&t->price_mutex);
+    if (swap_price(t, idx, price)){
+        rec.ID = t->ids[idx];
+        rec.delta = price;
+        rec.check = wal_price_check(&rec);
+        pthread_rwlock_rdlock(&t->wal_lock);
+        if (write_all(t->wal_fd, &rec, sizeof(rec)) < 0)
+            unix_error("stock_log error");
+        __atomic_add_fetch(&t->wal_size, sizeof(rec), __ATOMIC_RELAXED);
+        __atomic_store_n(&t->wal_dirty, 1, __ATOMIC_RELAXED);
+        pthread_rwlock_unlock(&t->wal_lock);
+    }
+    pthread_mutex_unlock(&t->price_mutex);
+}
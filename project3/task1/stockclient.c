@@ -4,14 +4,197 @@
 /* $begin echoclientmain */
 #include "csapp.h"
 
+/*
+접속 직후 "hello 2"(text) 또는 "hello 3"(binary)으로 protocol을 요청한다
+v2에서는 응답이 '\n'으로 끝나는 정확한 길이로 오고, show는 ".\n" 줄로 끝난다
+v3 frame 형식은 서버의 proto.h 참고
+서버가 hello에 답하지 않는 경우(구버전)는 고려하지 않는다
+*/
+#define OP_SHOW 1
+#define OP_BUY 2
+#define OP_SELL 3
+#define OP_EXIT 4
+#define OP_ORDER 9
+#define ORDER_MAX 128
+#define ST_SNAPSHOT 16
+
+static void hello(int clientfd, rio_t* rp, int version){
+    char buf[MAXLINE], expect[32];
+
+    sprintf(expect, "hello %d\n", version);
+    Rio_writen(clientfd, expect, strlen(expect));
+    if (Rio_readlineb(rp, buf, MAXLINE) == 0 || strcmp(buf, expect) != 0){
+        fprintf(stderr, "protocol version mismatch\n");
+        exit(1);
+    }
+}
+
+static int put_varint(unsigned char* p, uint32_t v){
+    int n = 0;
+
+    while (v >= 0x80){
+        p[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    p[n++] = v;
+    return n;
+}
+
+static int get_varint(rio_t* rp, uint32_t* v){
+    unsigned char c;
+    int shift = 0;
+
+    *v = 0;
+    do {
+        if (Rio_readnb(rp, &c, 1) != 1)
+            return 0;
+        *v |= (uint32_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while ((c & 0x80) && shift < 35);
+    return 1;
+}
+
+// "order buy 1 5 sell 3 2 ..." 를 order frame으로, 형식이 틀리면 0
+static int order_frame(char* buf, unsigned char* frame){
+    char side[8];
+    int pos = 0, k, id, count, nlegs = 0, n = 0;
+    unsigned char legs[ORDER_MAX * 11];
+
+    sscanf(buf, " order%n", &pos);
+    while (sscanf(buf + pos, " %7s %d %d%n", side, &id, &count, &k) == 3){
+        if (nlegs == ORDER_MAX || (strcmp(side, "buy") != 0 && strcmp(side, "sell") != 0))
+            return 0;
+        legs[n++] = strcmp(side, "buy") == 0 ? OP_BUY : OP_SELL;
+        n += put_varint(legs + n, (uint32_t)id);
+        n += put_varint(legs + n, (uint32_t)count);
+        nlegs++;
+        pos += k;
+    }
+    if (nlegs == 0 || buf[pos + strspn(buf + pos, " \t\r\n")] != '\0')
+        return 0;
+    frame[0] = OP_ORDER;
+    k = 1 + put_varint(frame + 1, nlegs);
+    memcpy(frame + k, legs, n);
+    return k + n;
+}
+
+/*
+text 요청 한 줄을 binary frame으로 보내고 응답을 text 형식으로 출력
+서버가 연결을 끊었으면 0
+*/
+static int bin_request(int clientfd, rio_t* rp, char* buf){
+    static const char* msg[] = {"", "Not enough left stocks\n", "Invalid stock ID\n", "Invalid command\n"};
+    static const char* ok[] = {[OP_BUY] = "[buy] success\n", [OP_SELL] = "[sell] success\n", [OP_ORDER] = "[order] success\n"};
+    unsigned char frame[6 + ORDER_MAX * 11], st;
+    char command[MAXLINE];
+    int id, count, n = 0;
+    uint32_t nstocks, v[3];
+
+    if (sscanf(buf, "%s", command) != 1)
+        command[0] = '\0';
+    if (strcmp(command, "show") == 0)
+        frame[n++] = OP_SHOW;
+    else if (strcmp(command, "buy") == 0 && sscanf(buf, "buy %d %d", &id, &count) == 2)
+        frame[n++] = OP_BUY;
+    else if (strcmp(command, "sell") == 0 && sscanf(buf, "sell %d %d", &id, &count) == 2)
+        frame[n++] = OP_SELL;
+    else if (strcmp(command, "order") == 0 && (n = order_frame(buf, frame)) > 0)
+        ;
+    else{
+        Fputs("Invalid command\n", stdout); // binary로 보낼 수 없는 요청
+        return 1;
+    }
+    if (frame[0] == OP_BUY || frame[0] == OP_SELL){
+        n += put_varint(frame + n, (uint32_t)id);
+        n += put_varint(frame + n, (uint32_t)count);
+    }
+    Rio_writen(clientfd, frame, n);
+
+    if (Rio_readnb(rp, &st, 1) != 1)
+        return 0;
+    if (st != ST_SNAPSHOT){
+        if (st == 0)
+            Fputs(ok[frame[0]], stdout);
+        else if (st < 4)
+            Fputs(msg[st], stdout);
+        return 1;
+    }
+    if (!get_varint(rp, &nstocks))
+        return 0;
+    while (nstocks-- > 0){
+        if (!get_varint(rp, &v[0]) || !get_varint(rp, &v[1]) || !get_varint(rp, &v[2]))
+            return 0;
+        printf("%d %d %d\n", (int)v[0], (int)v[1], (int)v[2]);
+    }
+    return 1;
+}
+
+// 서버와 같은 규칙으로 요청의 첫 단어를 꺼낸다 (빈 줄이면 "")
+static void request_command(char* req, char* command){
+    if (sscanf(req, "%s", command) != 1)
+        command[0] = '\0';
+}
+
+// 요청 하나에 대한 응답을 끝까지 읽어 출력, 서버가 연결을 끊었으면 0
+static int read_reply(rio_t* rp, char* command){
+    char buf[MAXLINE];
+    int multi = (strcmp(command, "show") == 0 || strcmp(command, "stats") == 0 || strcmp(command, "book") == 0);
+
+    while (Rio_readlineb(rp, buf, MAXLINE) > 0){
+        if (multi && strcmp(buf, ".\n") == 0)
+            return 1;
+        Fputs(buf, stdout);
+        if (!multi)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+subscribe 이후에는 서버가 언제든 변경을 보내므로 stdin과 socket을 같이 기다린다
+받은 줄은 그대로 출력하고 ("." 종료 줄은 빼고), 입력한 요청은 그대로 보낸다
+*/
+static void watch(int clientfd, rio_t* rp){
+    char buf[MAXLINE];
+    fd_set fds;
+
+    while (1){
+        // rio 버퍼에 이미 받은 줄은 select 없이 출력
+        while (rp->rio_cnt > 0){
+            if (Rio_readlineb(rp, buf, MAXLINE) == 0)
+                return;
+            if (strcmp(buf, ".\n") != 0)
+                Fputs(buf, stdout);
+        }
+        fflush(stdout);
+        FD_ZERO(&fds);
+        FD_SET(STDIN_FILENO, &fds);
+        FD_SET(clientfd, &fds);
+        Select(clientfd + 1, &fds, NULL, NULL, NULL);
+        if (FD_ISSET(clientfd, &fds)){
+            if (Rio_readlineb(rp, buf, MAXLINE) == 0)
+                return;
+            if (strcmp(buf, ".\n") != 0)
+                Fputs(buf, stdout);
+        }
+        if (FD_ISSET(STDIN_FILENO, &fds)){
+            if (Fgets(buf, MAXLINE, stdin) == NULL)
+                return;
+            Rio_writen(clientfd, buf, strlen(buf));
+        }
+    }
+}
+
 int main(int argc, char **argv) 
 {
-    int clientfd;
-    char *host, *port, buf[MAXLINE];
+    int clientfd, binary = 0;
+    char *host, *port, buf[MAXLINE], command[MAXLINE];
     rio_t rio;
 
-    if (argc != 3) {
-	fprintf(stderr, "usage: %s <host> <port>\n", argv[0]);
+    if (argc == 4 && strcmp(argv[3], "--binary") == 0)
+	binary = 1;
+    if (argc != 3 && !binary) {
+	fprintf(stderr, "usage: %s <host> <port> [--binary]\n", argv[0]);
 	exit(0);
     }
     host = argv[1];
@@ -19,11 +202,27 @@ int main(int argc, char **argv)
 
     clientfd = Open_clientfd(host, port);
     Rio_readinitb(&rio, clientfd);
+    hello(clientfd, &rio, binary ? 3 : 2);
 
     while (Fgets(buf, MAXLINE, stdin) != NULL) {
+	request_command(buf, command);
+	if (binary){
+	    if (strcmp(command, "exit") == 0){
+		unsigned char op = OP_EXIT;
+		Rio_writen(clientfd, &op, 1);
+		break;
+	    }
+	    if (!bin_request(clientfd, &rio, buf))
+		break;
+	    continue;
+	}
 	Rio_writen(clientfd, buf, strlen(buf));
-	Rio_readnb(&rio, buf, MAXLINE);
-	Fputs(buf, stdout);
+	if (strcmp(command, "exit") == 0 || !read_reply(&rio, command))
+	    break; // exit에는 응답이 없다
+	if (strcmp(command, "subscribe") == 0){
+	    watch(clientfd, &rio); // 연결이 끊기거나 stdin이 끝날 때까지
+	    break;
+	}
     }
     Close(clientfd); //line:netp:echoclient:close
     exit(0);
@@ -1,334 +1,618 @@
-/* 
- * echoserveri.c - An iterative echo server 
- */ 
+/*
+ * echoserveri.c - An iterative echo server
+ */
 /* $begin echoserverimain */
 #include "csapp.h"
 #include <semaphore.h>
-#define MAX_STOCKS 1000
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <getopt.h>
+#include "stock.h"
+#include "proto.h"
+#include "stats.h"
+#include "log.h"
+#include "feed.h"
+#include "timer.h"
+#define MAXEVENTS 1024 // epoll_wait 한 번에 받는 최대 event 수
+#define MAXREACTORS 256 // --threads 최대값
+#define PIPE_FLUSH_BYTES 65536 // pipelining 중 모인 응답이 이보다 크면 바로 전송
+#define MAX_INFLIGHT (4 * PIPE_FLUSH_BYTES) // 보내지 못한 응답이 이만큼 쌓이면 다 보낼 때까지 읽지 않는다 (--max-inflight)
+#define IDLE_TIMEOUT_MS 300000 // 요청 없이 이만큼 지나면 연결 종료 (--idle-timeout-ms)
+#define READ_TIMEOUT_MS 10000 // 시작된 요청(줄/frame)은 이 안에 끝까지 와야 한다 (--read-timeout-ms)
+#define WRITE_TIMEOUT_MS 30000 // 응답이 밀린 채 이만큼 전혀 보내지지 않으면 종료 (--write-timeout-ms)
+#define FD_RESERVE 64 // --max-conns 기본값 = fd limit - 이 값 (db, WAL, epoll 등)
 /*
-트리 자료구조
+주식 테이블
 */
-typedef struct item{
-    int ID;
-    int left_stock;
-    int price;
-    int readcnt; // task2 사용
-    sem_t mutex; // task2 사용
-} Item;
-
-typedef struct TreeNode {
-    Item data;
-    struct TreeNode* left;
-    struct TreeNode* right;
-} TreeNode;
-
-Item create_item(int, int, int);
-TreeNode* insert(TreeNode*, TreeNode*);
-void free_tree(TreeNode*);
-TreeNode* search(TreeNode*, int);
-TreeNode* load_stock_file(const char*);
+void load_stock_file(const char*);
 void save_stock(char*);
 
 /*
 client 다루기 위한 자료구조
+idle 연결은 이 struct 하나만 차지하고, 입력/출력 버퍼는 필요할 때만 할당한다
+
+연결마다 deadline이 하나 있고 상태에 따라 다르게 정한다:
+  응답이 밀려 있음 (blocked)   -> 마지막으로 보내진 시각 + write timeout
+  요청이 반쯤 옴 (in_len > 0)   -> 그 요청이 시작된 시각 + read timeout (byte가 더 와도 늘지 않는다, slowloris)
+  그 외                        -> 마지막 event + idle timeout
+deadline이 늦춰질 때는 timer를 옮기지 않고 만료됐을 때 다시 건다 (요청마다 list 조작 없음)
 */
 typedef struct {
-    int maxfd;
-    fd_set read_set;
-    fd_set ready_set;
-    int nready;
-    int maxi;
-    int clientfd[FD_SETSIZE];
-    rio_t clientrio[FD_SETSIZE];
-}pool;
-
-void init_pool(int, pool*);
-void add_client(int, pool*);
-void check_clients(pool*);
-int handle_client_command(int, char*, TreeNode*, pool*);
-void sigint_handler(int signo);
-int zero_client(pool*);
-
-int byte_cnt = 0;
-int stock_count = 0;
-TreeNode* stock_root;
-TreeNode* stock_array[MAX_STOCKS];
-
-void echo(int connfd);
+    int fd;
+    int epfd; // 연결을 가진 reactor (subscribe면 여기서 빼고 feed로 넘긴다)
+    char* in; // 아직 '\n'을 받지 못한 입력 (MAXLINE)
+    int in_len;
+    pbuf out; // 아직 보내지 못한 응답
+    size_t out_off;
+    proto_conn pc; // protocol version 등 연결 별 상태
+    int closing; // exit 요청, 남은 응답을 보낸 뒤 종료
+    int blocked; // 응답을 보내다 EAGAIN, 다 보낼 때까지 1
+    int throttled; // 응답이 MAX_INFLIGHT 넘게 밀려 읽기를 멈춤, 다 보내면 다시 읽는다
+    uint64_t in_since; // 반쯤 온 요청이 시작된 시각 (ms)
+    uint64_t out_since; // blocked 이후 마지막으로 보내진 시각 (ms)
+    uint64_t deadline; // ms
+    timer_node timer;
+    timer_wheel* wheel; // 연결을 가진 reactor의 timer
+} conn_t;
 
-int main(int argc, char **argv) 
-{
-    Signal(SIGINT, sigint_handler);
-    stock_root = load_stock_file("stock.txt");
-
-    int listenfd, connfd;
-    socklen_t clientlen;
-    struct sockaddr_storage clientaddr;  /* Enough space for any address */  //line:netp:echoserveri:sockaddrstorage
-    static pool pool;
-    
-    char client_hostname[MAXLINE], client_port[MAXLINE];
+/*
+reactor: epoll 하나 + SO_REUSEPORT listen socket 하나를 가진 event loop thread
+커널이 새 연결을 reactor들의 listen socket에 나눠주므로 연결은 처음 받은 reactor가 끝까지 담당한다
+*/
+typedef struct {
+    int epfd;
+    int listenfd;
+    pthread_t tid;
+    timer_wheel wheel; // 이 reactor가 가진 연결들의 deadline
+} reactor_t;
+
+int open_reuseport_listenfd(char*);
+void reactor_init(reactor_t*, char*);
+void *reactor_thread(void *vargp);
+void raise_fd_limit(void);
+void accept_clients(reactor_t*);
+void add_client(reactor_t*, int);
+void reject_client(int);
+void conn_deadline(conn_t*, uint64_t);
+void conn_expired(timer_node*, void*);
+void close_client(conn_t*);
+void handoff_client(conn_t*, char*, int);
+void read_client(conn_t*);
+void write_client(conn_t*);
+void process_input(conn_t*, char*, int);
+void process_input_bin(conn_t*, char*, int);
+int handle_client_command(conn_t*, char*);
+void *signal_thread(void *vargp);
+
+static int start_level = LOG_INFO; // --verbose면 요청마다 DEBUG 로그까지
+stock_table stocks;
+static reactor_t reactors[MAXREACTORS];
 
-    if (argc != 2) {
-	fprintf(stderr, "usage: %s <port>\n", argv[0]);
-	exit(0);
-    } // 포트 전달하지 않으면 에러 메세지 출력 & 종료
+/*
+연결 제한 (모든 reactor 공유)
+max_conns를 넘는 연결은 받자마자 "Server busy"를 보내고 닫는다 (fd가 바닥나 accept가 멈추기 전에)
+*/
+static struct {
+    int max_conns; // 0이면 fd limit에서 정한다
+    int max_inflight;
+    long idle_ms, read_ms, write_ms;
+    int conns; // reactor가 가진 연결 수
+    int timeouts, shed, throttled; // stats gauge
+} limits = {0, MAX_INFLIGHT, IDLE_TIMEOUT_MS, READ_TIMEOUT_MS, WRITE_TIMEOUT_MS};
 
-    // client 접속 대기
-    listenfd = Open_listenfd(argv[1]);
-    init_pool(listenfd, &pool);
+void echo(int connfd);
 
-    while (1) {
+static void usage(char* prog){
+    fprintf(stderr, "usage: %s <port> [--threads N] [--max-conns N] [--max-inflight BYTES]\n"
+                    "\t[--idle-timeout-ms MS] [--read-timeout-ms MS] [--write-timeout-ms MS] [--verbose]\n", prog);
+    exit(0);
+}
 
-        pool.ready_set = pool.read_set;
-        pool.nready = Select(pool.maxfd+1, &pool.ready_set, NULL, NULL, NULL);
-
-        if(FD_ISSET(listenfd, &pool.ready_set)){
-            clientlen = sizeof(struct sockaddr_storage);
-            // 클라이언트가 연결 요청 보내면, 수락
-            connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);
-            add_client(connfd, &pool);
-            Getnameinfo((SA *) &clientaddr, clientlen, client_hostname, MAXLINE, 
-                        client_port, MAXLINE, 0);
-            printf("Connected to (%s, %s)\n", client_hostname, client_port);
+int main(int argc, char **argv)
+{
+    int i, opt, nthreads = 1;
+    static struct option options[] = {
+        {"threads", required_argument, NULL, 't'},
+        {"max-conns", required_argument, NULL, 'c'},
+        {"max-inflight", required_argument, NULL, 'f'},
+        {"idle-timeout-ms", required_argument, NULL, 'i'},
+        {"read-timeout-ms", required_argument, NULL, 'r'},
+        {"write-timeout-ms", required_argument, NULL, 'w'},
+        {"verbose", no_argument, NULL, 'v'},
+        {NULL, 0, NULL, 0}
+    };
+    pthread_t tid;
+    sigset_t mask;
+
+    // SIGINT는 signal_thread에서만 sigwait로 받는다
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGINT);
+    Sigprocmask(SIG_BLOCK, &mask, NULL);
+    Signal(SIGPIPE, SIG_IGN); // 끊긴 연결에 쓰면 process 종료 대신 write 에러
+    load_stock_file("stock.txt");
+
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1){
+        switch (opt){
+        case 't': nthreads = atoi(optarg); break;
+        case 'c': limits.max_conns = atoi(optarg); break;
+        case 'f': limits.max_inflight = atoi(optarg); break;
+        case 'i': limits.idle_ms = atol(optarg); break;
+        case 'r': limits.read_ms = atol(optarg); break;
+        case 'w': limits.write_ms = atol(optarg); break;
+        case 'v': start_level = LOG_DEBUG; break;
+        default: usage(argv[0]);
         }
+    }
+    if (optind != argc - 1 || nthreads < 1 || nthreads > MAXREACTORS || limits.max_conns < 0
+        || limits.max_inflight < 1 || limits.idle_ms < 1 || limits.read_ms < 1 || limits.write_ms < 1)
+        usage(argv[0]); // 포트 전달하지 않으면 에러 메세지 출력 & 종료
 
-        check_clients(&pool);
+    log_init(STDOUT_FILENO, start_level);
 
-        if (zero_client(&pool)){
-            save_stock("stock.txt");
-        }
-    }
+    // client 접속 대기
+    raise_fd_limit();
+    for (i = 0; i < nthreads; i++)
+        reactor_init(&reactors[i], argv[optind]);
+
+    stock_start_sync(&stocks);
+    feed_start();
+    stats_gauge("conn_timeouts", &limits.timeouts);
+    stats_gauge("conns_shed", &limits.shed);
+    stats_gauge("conns_throttled", &limits.throttled);
+    Pthread_create(&tid, NULL, signal_thread, NULL);
+
+    // reactor 0은 main thread가 직접 돌린다
+    for (i = 1; i < nthreads; i++)
+        Pthread_create(&reactors[i].tid, NULL, reactor_thread, &reactors[i]);
+    reactor_thread(&reactors[0]);
     exit(0);
 }
 
 /////////////////////////////////////////
-// item 생성 & 초기화
-// 서버 시작 시, txt 파일 -> 트리
-// 클라이언트의 insert 요청 시
-Item create_item(int ID, int left_stock, int price){
-    Item newItem;
-    newItem.ID = ID;
-    newItem.left_stock = left_stock;
-    newItem.price = price;
-    newItem.readcnt = 0;
-    Sem_init(&newItem.mutex, 0, 1);
-    return newItem;
+// stock.db를 map (없으면 txt 파일을 import)
+void load_stock_file(const char* filename){
+    if (stock_load(&stocks, "stock.db", filename) < 0){
+        perror("Failed to load stock file");
+        exit(1);
+    }
+    proto_init(&stocks);
 }
 
-// tree 삽입
-TreeNode* insert(TreeNode* root, TreeNode* node){
-    if (root == NULL){
-        return node;
+/////////////////////////////////////////
+// open_listenfd와 같지만 SO_REUSEPORT로 여러 socket이 같은 port를 공유한다
+int open_reuseport_listenfd(char *port)
+{
+    struct addrinfo hints, *listp, *p;
+    int listenfd, optval=1;
+
+    memset(&hints, 0, sizeof(struct addrinfo));
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE | AI_ADDRCONFIG | AI_NUMERICSERV;
+    Getaddrinfo(NULL, port, &hints, &listp);
+
+    for (p = listp; p; p = p->ai_next) {
+        if ((listenfd = socket(p->ai_family, p->ai_socktype, p->ai_protocol)) < 0)
+            continue;
+        Setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, (const void *)&optval, sizeof(int));
+        Setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, (const void *)&optval, sizeof(int));
+        if (bind(listenfd, p->ai_addr, p->ai_addrlen) == 0)
+            break;
+        Close(listenfd);
     }
 
-    if (node->data.ID < root->data.ID)
-        root->left = insert(root->left, node);
-    else if (node->data.ID > root->data.ID)
-        root->right = insert(root->right, node);
-    return root;
+    Freeaddrinfo(listp);
+    if (!p)
+        return -1;
+    if (listen(listenfd, LISTENQ) < 0) {
+        Close(listenfd);
+        return -1;
+    }
+    return listenfd;
 }
 
-// 메모리 해제 & 세마포어 파괴
-void free_tree(TreeNode* root){
-    if (root == NULL) return;
-    free_tree(root->left);
-    free_tree(root->right);
-    free(root);
+void reactor_init(reactor_t* r, char* port){
+    struct epoll_event ev;
+
+    if ((r->listenfd = open_reuseport_listenfd(port)) < 0)
+        unix_error("open_listenfd error");
+    if (fcntl(r->listenfd, F_SETFL, O_NONBLOCK) < 0)
+        unix_error("fcntl error");
+    if ((r->epfd = epoll_create1(0)) < 0)
+        unix_error("epoll_create1 error");
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL; // listen socket
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->listenfd, &ev) < 0)
+        unix_error("epoll_ctl error");
+    timer_init(&r->wheel, timer_now_ms());
 }
 
-// 이진 트리 검색
-TreeNode* search(TreeNode* root, int ID){
-    if (root == NULL) return NULL;
+// 연결은 accept 한 reactor에서만 처리되므로 conn_t는 thread 간에 공유되지 않는다
+void *reactor_thread(void *vargp){
+    reactor_t* r = vargp;
+    struct epoll_event events[MAXEVENTS];
+    uint64_t now;
+    int n, i;
 
-    if (ID == root->data.ID)
-        return root;
-    else if (ID < root->data.ID)
-        return search(root->left, ID);
-    else
-        return search(root->right, ID);
-}
+    while (1) {
+        // 준비된 연결만 돌려받으므로 wakeup 당 작업량은 O(ready), deadline은 timer가 가까울 때만 깨운다
+        n = epoll_wait(r->epfd, events, MAXEVENTS, timer_wait_ms(&r->wheel, timer_now_ms()));
+        if (n < 0){
+            if (errno == EINTR) continue;
+            unix_error("epoll_wait error");
+        }
 
-// txt 파일 읽고, BST 구성
-TreeNode* load_stock_file(const char* filename){
-    FILE* fp = fopen(filename, "r");
-    if (fp == NULL){
-        perror("Failed to open file");
-        exit(1);
+        now = timer_now_ms();
+        for (i = 0; i < n; i++){
+            conn_t* c = events[i].data.ptr;
+
+            if (c == NULL){
+                accept_clients(r);
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+                read_client(c);
+            if (c->fd >= 0 && (events[i].events & EPOLLOUT))
+                write_client(c);
+            if (c->fd < 0)
+                free(c);
+            else
+                conn_deadline(c, now);
+        }
+        timer_advance(&r->wheel, now, conn_expired, &now);
     }
+    return NULL;
+}
 
-    TreeNode* root = NULL;
-    int id, stock, price;
+// 연결 수가 fd soft limit(보통 1024)에 막히지 않도록 hard limit까지 올림
+void raise_fd_limit(void){
+    struct rlimit rl;
 
-    while (fscanf(fp, "%d %d %d", &id, &stock, &price) != EOF){
-        Item item = create_item(id, stock, price);
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max){
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+    // --max-conns가 없으면 fd가 바닥나 accept가 실패하기 전에 거절하도록
+    if (limits.max_conns == 0 && getrlimit(RLIMIT_NOFILE, &rl) == 0){
+        rlim_t n = rl.rlim_cur < (1 << 24) ? rl.rlim_cur : (1 << 24);
+        limits.max_conns = n > 2 * FD_RESERVE ? n - FD_RESERVE : FD_RESERVE;
+    }
+}
 
-        TreeNode* node = (TreeNode*)malloc(sizeof(TreeNode));
-        node->data = item;
-        node->left = node->right = NULL;
+// edge-triggered이므로 EAGAIN이 나올 때까지 accept
+void accept_clients(reactor_t* r){
+    int connfd;
+    socklen_t clientlen;
+    struct sockaddr_storage clientaddr;  /* Enough space for any address */  //line:netp:echoserveri:sockaddrstorage
+    char client_hostname[MAXLINE], client_port[MAXLINE];
 
-        stock_array[stock_count++] = node;
-        root = insert(root, node);
+    while (1){
+        clientlen = sizeof(struct sockaddr_storage);
+        // 클라이언트가 연결 요청 보내면, 수락
+        connfd = accept(r->listenfd, (SA *)&clientaddr, &clientlen);
+        if (connfd < 0){
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                perror("accept error"); // EMFILE 등: 다음 event 때 다시 시도
+            return;
+        }
+        if (fcntl(connfd, F_SETFL, O_NONBLOCK) < 0){
+            Close(connfd);
+            continue;
+        }
+        if (__atomic_load_n(&limits.conns, __ATOMIC_RELAXED) >= limits.max_conns){
+            reject_client(connfd);
+            continue;
+        }
+        add_client(r, connfd);
+        if (log_enabled(LOG_INFO) && getnameinfo((SA *) &clientaddr, clientlen, client_hostname, MAXLINE,
+                                                 client_port, MAXLINE, NI_NUMERICHOST | NI_NUMERICSERV) == 0)
+            log_info("Connected to (%s, %s)", client_hostname, client_port);
     }
-    fclose(fp);
-    return root;
 }
 
-/////////////////////////////////////////
-void init_pool(int listenfd, pool *p){
-    int i;
-    p->maxi = -1;
-    for (i=0; i<FD_SETSIZE; i++)
-        p->clientfd[i] = -1;
-    
-    p->maxfd = listenfd;
-    FD_ZERO(&p->read_set);
-    FD_SET(listenfd, &p->read_set);
+void add_client(reactor_t* r, int connfd){
+    struct epoll_event ev;
+    conn_t* c = Calloc(1, sizeof(conn_t));
+
+    c->fd = connfd;
+    c->epfd = r->epfd;
+    c->wheel = &r->wheel;
+    proto_conn_init(&c->pc);
+    // 읽기/쓰기 모두 edge-triggered로 한 번만 등록 (이후 epoll_ctl 호출 없음)
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = c;
+    if (epoll_ctl(r->epfd, EPOLL_CTL_ADD, connfd, &ev) < 0){
+        perror("epoll_ctl error");
+        Close(connfd);
+        free(c);
+        return;
+    }
+    __atomic_add_fetch(&limits.conns, 1, __ATOMIC_RELAXED);
+    stats_conn(1);
+    conn_deadline(c, timer_now_ms());
 }
 
-void add_client(int connfd, pool *p){
-    int i;
-    p->nready--;
-    for (i=0; i<FD_SETSIZE; i++){
-        if (p->clientfd[i] < 0){
-            p->clientfd[i] = connfd;
-            Rio_readinitb(&p->clientrio[i], connfd);
+// 한도를 넘은 연결: 이유를 한 줄 보내고 바로 닫는다 (client는 기다리지 않고 나중에 다시 시도)
+void reject_client(int connfd){
+    static const char msg[] = "Server busy\n";
 
-            FD_SET(connfd, &p->read_set);
+    if (write(connfd, msg, sizeof(msg) - 1) < 0)
+        ; // 보내지 못해도 닫기만 하면 된다
+    Close(connfd);
+    __atomic_add_fetch(&limits.shed, 1, __ATOMIC_RELAXED);
+    log_debug("connection shed (%d open)", limits.max_conns);
+}
 
-            if (connfd > p->maxfd)
-                p->maxfd = connfd;
-            if (i > p->maxi)
-                p->maxi = i;
-            break;
-        }
+// 지금 상태의 deadline을 정하고, 걸려 있는 timer보다 이르면 당긴다
+void conn_deadline(conn_t* c, uint64_t now){
+    if (c->blocked)
+        c->deadline = c->out_since + limits.write_ms;
+    else if (c->in_len > 0)
+        c->deadline = c->in_since + limits.read_ms;
+    else
+        c->deadline = now + limits.idle_ms;
+    timer_arm(c->wheel, &c->timer, c->deadline);
+}
+
+// timer 만료: deadline이 그 사이 늦춰졌으면 다시 걸고, 지났으면 연결 종료
+void conn_expired(timer_node* t, void* arg){
+    conn_t* c = (conn_t*)((char*)t - offsetof(conn_t, timer));
+    uint64_t now = *(uint64_t*)arg;
+
+    if (now < c->deadline){
+        timer_add(c->wheel, t, c->deadline);
+        return;
     }
-    if(i == FD_SETSIZE)
-        app_error("add_client error: Too many clients");
+    log_info("connection timed out (%s)", c->blocked ? "write" : c->in_len > 0 ? "read" : "idle");
+    __atomic_add_fetch(&limits.timeouts, 1, __ATOMIC_RELAXED);
+    close_client(c);
+    free(c);
 }
 
-void check_clients(pool *p){
-    int i, connfd, n;
-    char buf[MAXLINE];
-    rio_t rio;
-
-    for(i=0; (i <= p->maxi) && (p->nready > 0); i++){
-        connfd = p->clientfd[i];
-        rio = p->clientrio[i];
-
-        if (connfd <= 0) continue;
-
-        if (FD_ISSET(connfd, &p->ready_set)){
-            p->nready--;
-            if((n = Rio_readlineb(&rio, buf, MAXLINE)) != 0){
-                byte_cnt += n;
-                printf("server recieved %d bytes\n", n);
-                fflush(stdout);
-                // echo 동작
-                //Rio_writen(connfd, buf, n);
-                if (handle_client_command(connfd, buf, stock_root, p) == 1){
-                    break;
-                }
-                p->clientrio[i] = rio;
-            }
-            else {
-                Close(connfd);
-                FD_CLR(connfd, &p->read_set);
-                p->clientfd[i] = -1;
-            }
-        }
+// close 하면 epoll에서도 자동으로 빠진다, struct는 event 처리 후 main에서 free
+void close_client(conn_t* c){
+    timer_del(c->wheel, &c->timer);
+    __atomic_sub_fetch(&limits.conns, 1, __ATOMIC_RELAXED);
+    if (c->throttled)
+        __atomic_sub_fetch(&limits.throttled, 1, __ATOMIC_RELAXED);
+    stats_conn(-1);
+    Close(c->fd);
+    c->fd = -1;
+    free(c->in);
+    c->in = NULL;
+    pbuf_free(&c->out);
+}
+
+/*
+subscribe 연결은 feed thread가 맡는다: epoll에서 빼고 남은 응답과 아직 처리하지 않은 입력째로 넘긴다
+struct는 close와 같이 event 처리 후 main에서 free (fd는 닫지 않는다)
+*/
+void handoff_client(conn_t* c, char* rest, int n){
+    if (epoll_ctl(c->epfd, EPOLL_CTL_DEL, c->fd, NULL) < 0){
+        perror("epoll_ctl error");
+        close_client(c);
+        return;
     }
+    timer_del(c->wheel, &c->timer);
+    __atomic_sub_fetch(&limits.conns, 1, __ATOMIC_RELAXED);
+    feed_attach(c->fd, &c->pc, &c->out, c->out_off, rest, n);
+    c->fd = -1;
+    c->out_off = 0;
+    free(c->in);
+    c->in = NULL;
+    pbuf_free(&c->out);
 }
 
-int handle_client_command(int connfd, char* buf, TreeNode* root, pool* p){
-    char command[MAXLINE];
-    int id, count;
-    char response[MAXLINE] = "";
-
-    response[0] = '\0'; // 응답 버퍼 초기화
-    buf[strcspn(buf, "\n")] = 0;
-    
-    if (sscanf(buf, "%s", command) != 1)
-        return 0;
-
-    // show - 전체 주식 목록 출력
-    if (strcmp(command, "show") == 0){
-
-        for (int i = 0; i < stock_count; i++){
-            TreeNode* node = stock_array[i];
-            char line[100];
-            sprintf(line, "%d %d %d\n", node->data.ID, node->data.left_stock, node->data.price);
-            strcat(response, line);
+/*
+EAGAIN이 나올 때까지 읽고, 완성된 줄을 모두 처리한 뒤 응답을 한 번에 보낸다 (pipelining)
+보내지 못한 응답이 max_inflight를 넘으면 읽기를 멈춘다: 입력은 socket 버퍼에 남고
+TCP flow control로 client가 더 보내지 못하게 된다. 다 보내면 write_client가 다시 읽는다.
+*/
+void read_client(conn_t* c){
+    char buf[MAXBUF];
+    ssize_t n;
+
+    if (c->throttled)
+        return;
+    while (!c->closing){
+        if (c->out.total - c->out_off >= (size_t)limits.max_inflight){
+            write_client(c);
+            if (c->fd < 0)
+                return;
+            if (c->out.total - c->out_off >= (size_t)limits.max_inflight){
+                c->throttled = 1;
+                __atomic_add_fetch(&limits.throttled, 1, __ATOMIC_RELAXED);
+                return;
+            }
+        }
+        n = read(c->fd, buf, sizeof(buf));
+        if (n > 0){
+            if (c->pc.version == PROTO_BIN)
+                process_input_bin(c, buf, n);
+            else
+                process_input(c, buf, n);
+            // pipelining으로 응답이 많이 쌓였으면 읽기를 계속하기 전에 먼저 보낸다
+            if (c->out.total - c->out_off >= PIPE_FLUSH_BYTES)
+                write_client(c);
+            if (c->fd < 0)
+                return;
+            continue;
         }
-        Rio_writen(connfd, response, MAXLINE);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        close_client(c); // EOF 또는 에러
+        return;
     }
-    
-    else if (strncmp(command, "buy", 3) == 0){
-        if (sscanf(buf, "buy %d %d", &id, &count) == 2){
-            TreeNode* node = search(root, id);
-            if (node){
-                if (node->data.left_stock >= count){
-                    node->data.left_stock -= count;
-                    strcpy(response, "[buy] success\n");
-                } else{
-                    strcpy(response, "Not enough left stocks\n");
+    write_client(c);
+}
+
+// 보낼 수 있는 만큼 보내고, 나머지는 EPOLLOUT 때 이어서 보낸다
+void write_client(conn_t* c){
+    struct iovec iov[PROTO_IOV_MAX];
+
+    while (c->out_off < c->out.total){
+        // show snapshot은 공유 버퍼를 복사 없이 그대로 보낸다
+        ssize_t n = writev(c->fd, iov, pbuf_iov(&c->out, c->out_off, iov, PROTO_IOV_MAX));
+        if (n < 0){
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK){
+                if (!c->blocked){
+                    c->blocked = 1;
+                    c->out_since = timer_now_ms();
                 }
-            } else{
-                strcpy(response, "Invalid stock ID\n");
+                return;
             }
+            close_client(c);
+            return;
         }
-        Rio_writen(connfd, response, MAXLINE);
+        stats_bytes_out(n);
+        c->out_off += n;
+        if (c->blocked)
+            c->out_since = timer_now_ms(); // 조금이라도 보내지면 write timeout을 다시 센다
     }
-    
-    else if (strncmp(command, "sell", 4) == 0){
-        if (sscanf(buf, "sell %d %d", &id, &count) == 2){
-            TreeNode* node = search(root, id);
-            if (node){
-                node->data.left_stock += count;
-                strcpy(response, "[sell] success\n");
-            } else{
-                strcpy(response, "Invalid stock ID\n");
-            }
-        }
-        Rio_writen(connfd, response, MAXLINE);
+    // 모두 보냈으면 버퍼 반환
+    pbuf_free(&c->out);
+    c->out_off = 0;
+    c->blocked = 0;
+    if (c->closing){
+        close_client(c);
+        return;
     }
-    else if (strcmp(command, "exit") == 0) {
-        Close(connfd);
-        FD_CLR(connfd, &p->read_set);
-        for (int i=0; i <= p->maxi; i++){
-            if (p->clientfd[i] == connfd){
-                p->clientfd[i] = -1;
-                break;
-            }
-        }
-        return 1; // 연결 종료
+    // 밀린 응답 때문에 멈췄던 읽기를 재개 (edge-triggered라 socket에 남은 입력은 event가 다시 오지 않는다)
+    if (c->throttled){
+        c->throttled = 0;
+        __atomic_sub_fetch(&limits.throttled, 1, __ATOMIC_RELAXED);
+        read_client(c);
     }
-    return 0;
 }
 
-void sigint_handler(int signo)
-{
-    save_stock("stock.txt");
-    free_tree(stock_root);
-    exit(1);
+// 받은 byte는 thread 별 counter에 더하고, 로그는 ring에 넣기만 한다 (--verbose일 때)
+static void count_bytes(int n){
+    stats_bytes_in(n);
+    log_debug("server recieved %d bytes", n);
 }
 
-void save_stock(char* file){
-    FILE *fp = fopen(file, "w");
-    if (fp != NULL){
-        for (int i=0; i<stock_count; i++){
-            TreeNode* node = stock_array[i];
-            fprintf(fp, "%d %d %d\n", node->data.ID, node->data.left_stock, node->data.price);
+// Rio_readlineb와 같은 규칙으로 줄을 나눈다 ('\n' 포함, 최대 MAXLINE-1 byte)
+void process_input(conn_t* c, char* data, int n){
+    char line[MAXLINE];
+    int len;
+
+    while (n > 0 && !c->closing){
+        char* nl = memchr(data, '\n', n);
+        int take = nl ? (int)(nl - data) + 1 : n;
+
+        if (take > MAXLINE - 1 - c->in_len)
+            take = MAXLINE - 1 - c->in_len;
+
+        if (c->in_len == 0 && nl && take == nl - data + 1){
+            // 흔한 경우: 쌓인 입력 없이 한 줄이 통째로 들어옴
+            memcpy(line, data, take);
+            len = take;
+        } else{
+            if (c->in == NULL){
+                c->in = Malloc(MAXLINE);
+                c->in_since = timer_now_ms();
+            }
+            memcpy(c->in + c->in_len, data, take);
+            c->in_len += take;
+            if (c->in[c->in_len - 1] != '\n' && c->in_len < MAXLINE - 1)
+                return; // 줄이 아직 끝나지 않음, 다음 read에서 이어 붙인다
+            memcpy(line, c->in, c->in_len);
+            len = c->in_len;
+            c->in_len = 0;
+            free(c->in);
+            c->in = NULL;
+        }
+        data += take;
+        n -= take;
+
+        line[len] = '\0';
+        count_bytes(len);
+        switch (handle_client_command(c, line)){
+        case PROTO_CLOSE:
+            c->closing = 1;
+            break;
+        case PROTO_SUBSCRIBE:
+            handoff_client(c, data, n);
+            return;
+        }
+        // hello 3 이후로 남은 입력은 binary frame
+        if (c->pc.version == PROTO_BIN){
+            process_input_bin(c, data, n);
+            return;
         }
-        fclose(fp);
     }
 }
 
-int zero_client(pool* p){
-    for(int i=0; i <= p->maxi; i++){
-        if(p->clientfd[i] != -1){
-            return 0;
+/*
+binary frame을 입력 버퍼에서 바로 파싱한다
+read 경계에 걸린 frame의 앞부분만 c->in에 보관 (최대 PROTO_BIN_MAXREQ byte)
+*/
+void process_input_bin(conn_t* c, char* data, int n){
+    proto_req req;
+    int k;
+
+    while (n > 0 && !c->closing){
+        if (c->in_len > 0){
+            // 보관 중인 앞부분에 1 byte씩 이어 붙여 frame 완성
+            c->in[c->in_len++] = *data++;
+            n--;
+            if ((k = proto_parse_bin(c->in, c->in_len, &req)) == 0)
+                continue;
+            c->in_len = 0;
+            free(c->in);
+            c->in = NULL;
+        } else if ((k = proto_parse_bin(data, n, &req)) == 0){
+            c->in = Malloc(MAXLINE);
+            c->in_since = timer_now_ms();
+            memcpy(c->in, data, n);
+            c->in_len = n;
+            return;
+        } else if (k > 0){
+            data += k;
+            n -= k;
         }
+
+        if (k < 0){
+            req.op = PROTO_OP_UNKNOWN;
+        } else{
+            count_bytes(k);
+        }
+        if (proto_execute(&c->pc, &req, &c->out) == PROTO_CLOSE)
+            c->closing = 1;
     }
-    return 1;
+}
+
+// 요청 처리는 proto.c, 응답은 연결의 출력 버퍼 뒤에 쌓인다
+// PROTO_CLOSE면 남은 응답을 보낸 뒤 연결 종료, PROTO_SUBSCRIBE면 feed로 넘긴다
+int handle_client_command(conn_t* c, char* buf){
+    return proto_handle_line(&c->pc, buf, &c->out);
+}
+
+// signal handler 대신 sigwait로 받아서 일반 thread 문맥에서 종료 처리
+void *signal_thread(void *vargp){
+    sigset_t mask;
+    int signo;
+
+    Pthread_detach(pthread_self());
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGINT);
+    sigwait(&mask, &signo);
+
+    log_info("shutting down");
+    save_stock("stock.txt");
+    stock_close(&stocks);
+    log_shutdown();
+    exit(1);
+}
+
+// WAL을 스냅샷(stock.db)으로 compaction, 기존 도구를 위해 txt로도 export
+void save_stock(char* file){
+    if (stock_compact(&stocks) < 0)
+        perror("stock_compact");
+    if (stock_export_text(&stocks, file) < 0)
+        perror("stock_export_text");
 }
 /* $end echoserverimain */
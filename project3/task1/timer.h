@@ -0,0 +1,46 @@
+/*
+ * timer.h - 연결 deadline용 계층형 timer wheel (thread 하나 전용, lock 없음)
+ *
+ * 시간은 TIMER_TICK_MS 단위 tick으로 센다. level마다 TIMER_SLOTS개의 slot이 있고
+ * level L에는 앞으로 64^(L+1) tick 안에 만료되는 timer가 들어간다 (level 0은 tick 하나가 slot 하나).
+ * level 0이 한 바퀴 돌 때마다 위 level의 slot 하나를 아래 level로 다시 나눠 넣으므로 (cascade)
+ * 추가/삭제는 O(1)이고, 만료 전에 지워지는 대부분의 timer는 cascade도 거치지 않는다.
+ * 64^TIMER_LEVELS tick보다 먼 deadline은 마지막 level에 넣었다가 그때 다시 넣는다.
+ *
+ * timer는 deadline보다 일찍 만료되지 않는다 (tick 단위로 올림, 늦게는 최대 한 tick).
+ */
+#ifndef __TIMER_H__
+#define __TIMER_H__
+
+#include <stdint.h>
+#include "list.h"
+
+#define TIMER_TICK_MS 10
+#define TIMER_BITS 6
+#define TIMER_SLOTS (1 << TIMER_BITS)
+#define TIMER_LEVELS 4 // 64^4 tick = 약 46시간
+
+typedef struct {
+    struct list_elem elem;
+    uint64_t expires; // tick
+    int armed;
+} timer_node;
+
+typedef struct {
+    uint64_t now; // 다음에 처리할 tick
+    int count; // 걸려 있는 timer 수
+    struct list slots[TIMER_LEVELS][TIMER_SLOTS];
+} timer_wheel;
+
+// 만료된 timer마다 호출 (이미 wheel에서 빠진 상태라 다시 걸거나 free 해도 된다)
+typedef void (*timer_fn)(timer_node*, void*);
+
+uint64_t timer_now_ms(void);
+void timer_init(timer_wheel*, uint64_t);
+void timer_add(timer_wheel*, timer_node*, uint64_t);
+void timer_arm(timer_wheel*, timer_node*, uint64_t);
+void timer_del(timer_wheel*, timer_node*);
+void timer_advance(timer_wheel*, uint64_t, timer_fn, void*);
+int timer_wait_ms(timer_wheel*, uint64_t);
+
+#endif /* __TIMER_H__ */
@@ -0,0 +1,134 @@
+/*
+ * bench_atomic.c - buy/sell/show 경합 측정 (P()/V() readers-writers vs CAS)
+ *   usage: ./bench_atomic [stocks] [ops per thread]
+ *   각 thread는 buy 45%, sell 45%, show(전체 종목 읽기) 10%를 수행한다.
+ *   종목 수가 적을수록 (기본 5, stock.txt와 같음) 같은 item에 대한 경합이 커진다.
+ */
+#include "csapp.h"
+#include "stock.h"
+#include <time.h>
+
+// 이전 구현과 같은 item 별 readers-writers 세마포어
+typedef struct {
+    int left_stock;
+    int price;
+    int readcnt;
+    sem_t mutex;
+    sem_t w;
+} sem_item;
+
+static int nstocks, nops;
+static sem_item* sem_items;
+static stock_table table;
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* sem_worker(void* vargp){
+    unsigned int seed = (unsigned long)vargp;
+    volatile long sink = 0;
+
+    for (int n = 0; n < nops; n++){
+        int op = rand_r(&seed) % 20;
+        if (op < 2){
+            for (int i = 0; i < nstocks; i++){
+                sem_item* it = &sem_items[i];
+                P(&it->mutex);
+                if (++it->readcnt == 1) P(&it->w);
+                V(&it->mutex);
+                sink += it->left_stock + it->price;
+                P(&it->mutex);
+                if (--it->readcnt == 0) V(&it->w);
+                V(&it->mutex);
+            }
+        } else{
+            sem_item* it = &sem_items[rand_r(&seed) % nstocks];
+            int count = rand_r(&seed) % 10 + 1;
+            P(&it->w);
+            if (op < 11){
+                if (it->left_stock >= count)
+                    it->left_stock -= count;
+            } else{
+                it->left_stock += count;
+            }
+            V(&it->w);
+        }
+    }
+    return NULL;
+}
+
+static void* cas_worker(void* vargp){
+    unsigned int seed = (unsigned long)vargp;
+    volatile long sink = 0;
+
+    for (int n = 0; n < nops; n++){
+        int op = rand_r(&seed) % 20;
+        if (op < 2){
+            for (int i = 0; i < nstocks; i++){
+                Item it = stock_get(&table, i);
+                sink += it.left_stock + it.price;
+            }
+        } else{
+            int idx = rand_r(&seed) % nstocks;
+            int count = rand_r(&seed) % 10 + 1;
+            if (op < 11)
+                stock_buy(&table, idx, count);
+            else
+                stock_sell(&table, idx, count);
+        }
+    }
+    return NULL;
+}
+
+static double run(void* (*worker)(void*), int nthreads){
+    pthread_t* tids = Malloc(nthreads * sizeof(pthread_t));
+    double start = now_sec();
+
+    for (long i = 0; i < nthreads; i++)
+        Pthread_create(&tids[i], NULL, worker, (void*)(i + 1));
+    for (int i = 0; i < nthreads; i++)
+        Pthread_join(tids[i], NULL);
+
+    double sec = now_sec() - start;
+    free(tids);
+    return (double)nthreads * nops / sec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    const char* db = "/tmp/bench_atomic.db";
+    int threads[] = {4, 16, 64};
+
+    nstocks = (argc > 1) ? atoi(argv[1]) : 5;
+    nops = (argc > 2) ? atoi(argv[2]) : 200000;
+
+    stock_entry* entries = Malloc(nstocks * sizeof(stock_entry));
+    sem_items = Malloc(nstocks * sizeof(sem_item));
+    for (int i = 0; i < nstocks; i++){
+        entries[i].ID = i + 1;
+        entries[i].left_stock = sem_items[i].left_stock = 1000;
+        entries[i].price = sem_items[i].price = 1000;
+        sem_items[i].readcnt = 0;
+        Sem_init(&sem_items[i].mutex, 0, 1);
+        Sem_init(&sem_items[i].w, 0, 1);
+    }
+    if (stock_create(db, entries, nstocks) < 0 || stock_open(&table, db) < 0)
+        unix_error("bench_atomic");
+
+    printf("stocks=%d ops/thread=%d\n", nstocks, nops);
+    printf("%8s %14s %14s %8s\n", "threads", "P/V(Mops/s)", "CAS(Mops/s)", "speedup");
+    for (int k = 0; k < 3; k++){
+        double s = run(sem_worker, threads[k]);
+        double c = run(cas_worker, threads[k]);
+        printf("%8d %14.2f %14.2f %7.1fx\n", threads[k], s, c, c / s);
+    }
+
+    stock_close(&table);
+    unlink(db);
+    free(entries);
+    free(sem_items);
+    return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * bench_book.c - order book 매칭 replay 벤치마크
+ *   usage: ./bench_book [events] [file]
+ *   주문 흐름(limit / market / cancel)을 한 book에 그대로 replay 한다.
+ *   file이 있으면 그 흐름을 읽고, 없으면 고정 seed로 만든 흐름을 file에 저장한 뒤 replay 한다.
+ *   (같은 file로 다시 돌리면 구현이 바뀌어도 같은 흐름을 비교할 수 있다)
+ *     file 형식: 한 줄에 하나, "L B|S 가격 수량", "M B|S 수량", "C 취소할 limit의 줄 번호(0부터)"
+ *   전체 replay의 event 당 ns와, event마다 잰 latency의 p50/p99/p999를 종류별로 출력한다.
+ */
+#include "csapp.h"
+#include "book.h"
+#include <time.h>
+
+typedef struct {
+    char type; // 'L', 'M', 'C'
+    int side;
+    int32_t price;
+    int32_t qty;
+    int ref; // cancel할 event 번호
+} event;
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/*
+mid 근처에 쌓이는 limit 55% (그중 일부는 반대편을 넘어 체결), market 10%,
+최근 limit 중 하나를 취소 35%. mid는 천천히 움직인다.
+*/
+static void generate(event* ev, int n){
+    int mid = 10000, nlimit = 0;
+    int* limits = Malloc(n * sizeof(int));
+
+    srand(1);
+    for (int i = 0; i < n; i++){
+        int r = rand() % 100;
+        event* e = &ev[i];
+
+        e->side = rand() % 2 ? BOOK_BUY : BOOK_SELL;
+        if (r < 55 || nlimit == 0){
+            int off = rand() % 10 + 1;
+            if (rand() % 10 == 0)
+                off = -(rand() % 5); // 반대편으로 넘어가는 공격적인 주문
+            e->type = 'L';
+            e->price = e->side == BOOK_BUY ? mid - off : mid + off;
+            e->qty = rand() % 100 + 1;
+            limits[nlimit++] = i;
+        } else if (r < 65){
+            e->type = 'M';
+            e->qty = rand() % 50 + 1;
+        } else{
+            int window = nlimit < 1000 ? nlimit : 1000;
+            e->type = 'C';
+            e->ref = limits[nlimit - 1 - rand() % window];
+        }
+        if (rand() % 100 == 0)
+            mid += rand() % 3 - 1;
+    }
+    free(limits);
+}
+
+static int load(const char* file, event** ev){
+    FILE* fp = fopen(file, "r");
+    char line[128], type, side;
+    int n = 0, cap = 0;
+
+    if (fp == NULL)
+        return -1;
+    *ev = NULL;
+    while (fgets(line, sizeof(line), fp)){
+        event e = {0};
+        if (sscanf(line, " %c", &type) != 1)
+            continue;
+        e.type = type;
+        if ((type == 'L' && sscanf(line, " L %c %d %d", &side, &e.price, &e.qty) != 3)
+            || (type == 'M' && sscanf(line, " M %c %d", &side, &e.qty) != 2)
+            || (type == 'C' && (sscanf(line, " C %d", &e.ref) != 1 || e.ref < 0 || e.ref >= n))
+            || (type != 'L' && type != 'M' && type != 'C'))
+            app_error("bench_book: bad event line");
+        e.side = (side == 'B') ? BOOK_BUY : BOOK_SELL;
+        if (n == cap){
+            cap = cap ? cap * 2 : 4096;
+            *ev = Realloc(*ev, cap * sizeof(event));
+        }
+        (*ev)[n++] = e;
+    }
+    fclose(fp);
+    return n;
+}
+
+static void save(const char* file, event* ev, int n){
+    FILE* fp = fopen(file, "w");
+    char s;
+
+    if (fp == NULL)
+        unix_error("bench_book: save");
+    for (int i = 0; i < n; i++){
+        s = ev[i].side == BOOK_BUY ? 'B' : 'S';
+        if (ev[i].type == 'L')
+            fprintf(fp, "L %c %d %d\n", s, ev[i].price, ev[i].qty);
+        else if (ev[i].type == 'M')
+            fprintf(fp, "M %c %d\n", s, ev[i].qty);
+        else
+            fprintf(fp, "C %d\n", ev[i].ref);
+    }
+    fclose(fp);
+}
+
+static void apply(book* b, event* e, uint64_t* ids, int i, book_result* r){
+    if (e->type == 'L'){
+        book_limit(b, e->side, e->price, e->qty, r);
+        ids[i] = r->id;
+    } else if (e->type == 'M'){
+        book_market(b, e->side, e->qty, r);
+    } else{
+        book_cancel(b, ids[e->ref]);
+    }
+}
+
+static int cmp_u32(const void* a, const void* b){
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char* name, uint32_t* lat, int n){
+    if (n == 0)
+        return;
+    qsort(lat, n, sizeof(uint32_t), cmp_u32);
+    printf("%-8s %9d %9u %9u %9u %9u\n", name, n,
+           lat[n / 2], lat[(int)(n * 0.99)], lat[(int)(n * 0.999)], lat[n - 1]);
+}
+
+int main(int argc, char **argv)
+{
+    int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+    const char* file = (argc > 2) ? argv[2] : NULL;
+    event* ev;
+    uint64_t* ids;
+    uint32_t* lat[3];
+    int nlat[3] = {0, 0, 0};
+    long filled = 0;
+    book b;
+    book_result r;
+    int loaded = file ? load(file, &ev) : -1;
+
+    if (loaded >= 0){
+        n = loaded;
+        printf("replay %s: %d events\n", file, n);
+    } else{
+        ev = Malloc(n * sizeof(event));
+        generate(ev, n);
+        if (file)
+            save(file, ev, n);
+        printf("generated %d events%s%s\n", n, file ? ", saved to " : "", file ? file : "");
+    }
+    ids = Calloc(n, sizeof(uint64_t));
+    for (int k = 0; k < 3; k++)
+        lat[k] = Malloc(n * sizeof(uint32_t));
+
+    // 1. 전체 replay 시간 (event마다 시계를 읽지 않는다)
+    book_init(&b);
+    double start = now_ns();
+    for (int i = 0; i < n; i++){
+        apply(&b, &ev[i], ids, i, &r);
+        if (ev[i].type != 'C')
+            filled += r.filled;
+    }
+    double total = now_ns() - start;
+    printf("replay: %.1f ns/event, %.2f M events/s, filled %ld, levels bid %d ask %d\n",
+           total / n, n / total * 1e3, filled, b.side[BOOK_BUY].n, b.side[BOOK_SELL].n);
+    book_free(&b);
+
+    // 2. 같은 흐름을 event마다 재서 종류별 분포 (clock_gettime 비용 포함)
+    book_init(&b);
+    memset(ids, 0, n * sizeof(uint64_t));
+    for (int i = 0; i < n; i++){
+        int k = ev[i].type == 'L' ? 0 : ev[i].type == 'M' ? 1 : 2;
+        double t0 = now_ns();
+        apply(&b, &ev[i], ids, i, &r);
+        lat[k][nlat[k]++] = (uint32_t)(now_ns() - t0);
+    }
+    book_free(&b);
+
+    printf("%-8s %9s %9s %9s %9s %9s\n", "event", "count", "p50 ns", "p99 ns", "p999 ns", "max ns");
+    report("limit", lat[0], nlat[0]);
+    report("market", lat[1], nlat[1]);
+    report("cancel", lat[2], nlat[2]);
+
+    for (int k = 0; k < 3; k++)
+        free(lat[k]);
+    free(ids);
+    free(ev);
+    return 0;
+}
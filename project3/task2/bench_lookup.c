@@ -0,0 +1,118 @@
+/*
+ * bench_lookup.c - 주식 ID 탐색 latency 측정
+ *   usage: ./bench_lookup [lookups]
+ *   1K / 100K / 1M 종목에 대해 stock_find()와 기존 BST를 비교한다.
+ *   BST는 stock.txt가 ID 순으로 저장된 경우(save_stock 이후)처럼 정렬 순서로 삽입하면
+ *   연결 리스트로 퇴화하므로, 정렬 삽입은 1K에서만 측정한다.
+ */
+#include "csapp.h"
+#include "stock.h"
+#include <time.h>
+
+typedef struct bst_node {
+    int ID;
+    struct bst_node* left;
+    struct bst_node* right;
+} bst_node;
+
+static bst_node* bst_insert(bst_node* root, bst_node* node){
+    bst_node** p = &root;
+    while (*p)
+        p = (node->ID < (*p)->ID) ? &(*p)->left : &(*p)->right;
+    *p = node;
+    return root;
+}
+
+static bst_node* bst_search(bst_node* root, int ID){
+    while (root && root->ID != ID)
+        root = (ID < root->ID) ? root->left : root->right;
+    return root;
+}
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void shuffle(int* a, int n){
+    for (int i = n - 1; i > 0; i--){
+        int j = rand() % (i + 1);
+        int tmp = a[i]; a[i] = a[j]; a[j] = tmp;
+    }
+}
+
+static double bench_table(int n, const int* keys, int lookups){
+    const char* db = "/tmp/bench_lookup.db";
+    stock_entry* entries = Malloc(n * sizeof(stock_entry));
+    stock_table t;
+    volatile long sink = 0;
+
+    for (int i = 0; i < n; i++){
+        entries[i].ID = i + 1;
+        entries[i].left_stock = 100;
+        entries[i].price = 1000;
+    }
+    if (stock_create(db, entries, n) < 0 || stock_open(&t, db) < 0)
+        unix_error("bench_table");
+    free(entries);
+
+    double start = now_ns();
+    for (int i = 0; i < lookups; i++)
+        sink += t.recs[stock_find(&t, keys[i])].left_stock;
+    double ns = (now_ns() - start) / lookups;
+
+    stock_close(&t);
+    unlink(db);
+    return ns;
+}
+
+static double bench_bst(int n, const int* keys, int lookups, int sorted){
+    bst_node* nodes = Malloc(n * sizeof(bst_node));
+    int* order = Malloc(n * sizeof(int));
+    bst_node* root = NULL;
+    volatile long sink = 0;
+
+    for (int i = 0; i < n; i++)
+        order[i] = i + 1;
+    if (!sorted)
+        shuffle(order, n);
+    for (int i = 0; i < n; i++){
+        nodes[i].ID = order[i];
+        nodes[i].left = nodes[i].right = NULL;
+        root = bst_insert(root, &nodes[i]);
+    }
+
+    double start = now_ns();
+    for (int i = 0; i < lookups; i++)
+        sink += bst_search(root, keys[i])->ID;
+    double ns = (now_ns() - start) / lookups;
+
+    free(order);
+    free(nodes);
+    return ns;
+}
+
+int main(int argc, char **argv)
+{
+    int sizes[] = {1000, 100000, 1000000};
+    int lookups = (argc > 1) ? atoi(argv[1]) : 1000000;
+    int* keys = Malloc(lookups * sizeof(int));
+
+    srand(4100);
+    printf("%10s %14s %14s %14s\n", "stocks", "table(ns)", "bst-rand(ns)", "bst-sorted(ns)");
+    for (int s = 0; s < 3; s++){
+        int n = sizes[s];
+        for (int i = 0; i < lookups; i++)
+            keys[i] = rand() % n + 1;
+
+        double t = bench_table(n, keys, lookups);
+        double r = bench_bst(n, keys, lookups, 0);
+        if (n <= 1000)
+            printf("%10d %14.1f %14.1f %14.1f\n", n, t, r, bench_bst(n, keys, lookups, 1));
+        else
+            printf("%10d %14.1f %14.1f %14s\n", n, t, r, "-");
+    }
+    free(keys);
+    return 0;
+}
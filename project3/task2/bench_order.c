@@ -0,0 +1,155 @@
+/*
+ * bench_order.c - order 한 번 vs 같은 내용의 buy/sell 여러 번
+ *   usage: ./bench_order [rounds] [stocks]
+ *   leg 수마다 서로 다른 종목을 골라 "order buy ..." 로 사고 "order sell ..." 로 되돌리는 것과
+ *   같은 leg들을 "buy ID n" / "sell ID n" 한 줄씩 보내는 것을 비교한다.
+ *   text 요청 파싱 + 실행 + 응답 인코딩 + WAL 기록까지 포함한 basket 하나의 시간을 출력한다.
+ *   (네트워크 왕복은 포함하지 않는다, 실제로는 leg 수만큼의 왕복이 1번으로 줄어든다)
+ *   측정 전에 int32 범위를 넘는 order/sell이 잔량을 바꾸지 않고 거절되는지 확인한다.
+ */
+#include "csapp.h"
+#include "proto.h"
+#include <time.h>
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 서로 다른 종목 ID legs개
+static void pick(int* ids, int legs, int nstocks){
+    for (int i = 0; i < legs; i++){
+        int id, dup;
+        do {
+            id = rand() % nstocks + 1;
+            dup = 0;
+            for (int k = 0; k < i; k++)
+                dup |= (ids[k] == id);
+        } while (dup);
+        ids[i] = id;
+    }
+}
+
+static void run_line(proto_conn* pc, pbuf* out, char* line){
+    proto_handle_line(pc, line, out);
+    if (out->len == 0 || out->data[0] != '[')
+        app_error("bench_order: request failed");
+    pbuf_reset(out);
+}
+
+/*
+같은 ID leg를 합친 delta나 결과 잔량이 int32를 넘는 요청은 실패해야 하고 잔량은 그대로여야 한다
+(합이 wrap 되면 buy가 sell이 된다)
+*/
+static void check_overflow(stock_table* t){
+    static const struct { const char* line; const char* reply; } cases[] = {
+        {"order buy 1 2147483647 buy 1 2147483647\n", "Not enough left stocks\n"},
+        {"order sell 1 2147483647 sell 1 2147483647\n", "Too many left stocks\n"},
+        {"order sell 1 2147483647 buy 2 1\n", "Too many left stocks\n"},
+        {"sell 1 2147483647\n", "Too many left stocks\n"},
+    };
+    proto_conn pc;
+    pbuf out;
+    char line[MAXLINE];
+    Item before = stock_get(t, 0), before2 = stock_get(t, 1);
+
+    proto_conn_init(&pc);
+    pc.version = PROTO_V2;
+    pc.nreq = 1;
+    pbuf_init(&out);
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++){
+        strcpy(line, cases[i].line);
+        proto_handle_line(&pc, line, &out);
+        if (out.len != strlen(cases[i].reply) || memcmp(out.data, cases[i].reply, out.len) != 0
+            || stock_get(t, 0).word != before.word || stock_get(t, 1).word != before2.word){
+            fprintf(stderr, "bench_order: %s", cases[i].line);
+            app_error("bench_order: overflow check failed");
+        }
+        pbuf_reset(&out);
+    }
+    pbuf_free(&out);
+}
+
+// basket 하나 (사고 되돌리기) 당 ns, 요청 문자열은 시간 밖에서 만들어 둔다
+static double run(int legs, int rounds, int nstocks, int batch){
+    proto_conn pc;
+    pbuf out;
+    char* lines[2 * STOCK_ORDER_MAX];
+    int ids[STOCK_ORDER_MAX], nlines;
+    double total = 0;
+
+    proto_conn_init(&pc);
+    pc.version = PROTO_V2;
+    pc.nreq = 1;
+    pbuf_init(&out);
+    for (int i = 0; i < 2 * STOCK_ORDER_MAX; i++)
+        lines[i] = Malloc(MAXLINE);
+    srand(1);
+
+    for (int r = 0; r < rounds; r++){
+        pick(ids, legs, nstocks);
+        nlines = 0;
+        for (int side = 0; side < 2; side++){
+            const char* op = side == 0 ? "buy" : "sell";
+            if (batch){
+                int len = sprintf(lines[nlines], "order");
+                for (int i = 0; i < legs; i++)
+                    len += sprintf(lines[nlines] + len, " %s %d 1", op, ids[i]);
+                strcpy(lines[nlines++] + len, "\n");
+            } else{
+                for (int i = 0; i < legs; i++)
+                    sprintf(lines[nlines++], "%s %d 1\n", op, ids[i]);
+            }
+        }
+        double start = now_ns();
+        for (int i = 0; i < nlines; i++)
+            run_line(&pc, &out, lines[i]);
+        total += now_ns() - start;
+    }
+    for (int i = 0; i < 2 * STOCK_ORDER_MAX; i++)
+        free(lines[i]);
+    pbuf_free(&out);
+    return total / rounds;
+}
+
+int main(int argc, char **argv)
+{
+    const char* db = "/tmp/bench_order.db";
+    int legs[] = {1, 10, 100};
+    stock_table table;
+    char wal[300];
+
+    int rounds = (argc > 1) ? atoi(argv[1]) : 2000;
+    int nstocks = (argc > 2) ? atoi(argv[2]) : 1000;
+    if (nstocks < 100)
+        app_error("bench_order: need at least 100 stocks");
+
+    stock_entry* entries = Malloc(nstocks * sizeof(stock_entry));
+    for (int i = 0; i < nstocks; i++){
+        entries[i].ID = i + 1;
+        entries[i].left_stock = 1000000;
+        entries[i].price = 1000;
+    }
+    // stock_load로 열어야 WAL에 기록한다
+    if (stock_create(db, entries, nstocks) < 0 || stock_load(&table, db, "") < 0)
+        unix_error("bench_order");
+    proto_init(&table);
+    check_overflow(&table);
+
+    printf("rounds=%d stocks=%d (basket = buy + sell back)\n", rounds, nstocks);
+    printf("%6s %16s %16s %8s\n", "legs", "order(us)", "single(us)", "speedup");
+    for (int k = 0; k < 3; k++){
+        double o = run(legs[k], rounds, nstocks, 1);
+        double s = run(legs[k], rounds, nstocks, 0);
+        printf("%6d %16.2f %16.2f %7.1fx\n", legs[k], o / 1e3, s / 1e3, s / o);
+    }
+
+    stock_close(&table);
+    unlink(db);
+    for (uint64_t gen = 1; snprintf(wal, sizeof(wal), "%s.wal.%llu", db, (unsigned long long)gen),
+                           unlink(wal) == 0; gen++)
+        ;
+    free(entries);
+    return 0;
+}
@@ -0,0 +1,164 @@
+/*
+ * bench_proto.c - text / binary protocol 요청 처리 비용 비교
+ *   usage: ./bench_proto [requests] [stocks]
+ *   buy/sell 요청을 미리 wire 형식으로 만들어 두고
+ *     parse: 요청 하나를 proto_req로 파싱하는 시간
+ *     parse+exec: 파싱 + 주식 테이블 갱신 + 응답 인코딩까지의 시간
+ *   을 요청 당 ns로 출력한다. show는 캐시를 다시 만드는 경우와
+ *   캐시를 그대로 쓰는 경우의 응답 준비 시간을 따로 잰다.
+ */
+#include "csapp.h"
+#include "proto.h"
+#include <time.h>
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 요청 n개를 version 형식으로 wire에 이어 붙인다
+static void make_requests(pbuf* wire, int version, int n, int nstocks){
+    char line[64];
+
+    srand(1);
+    for (int i = 0; i < n; i++){
+        int op = (rand() % 2) ? PROTO_OP_BUY : PROTO_OP_SELL;
+        int id = rand() % nstocks + 1;
+        int count = rand() % 10 + 1;
+
+        if (version == PROTO_BIN){
+            unsigned char c = op;
+            pbuf_append(wire, &c, 1);
+            pbuf_put_varint(wire, id);
+            pbuf_put_varint(wire, count);
+        } else{
+            int len = snprintf(line, sizeof(line), "%s %d %d\n", op == PROTO_OP_BUY ? "buy" : "sell", id, count);
+            pbuf_append(wire, line, len);
+        }
+    }
+}
+
+/*
+wire에 담긴 요청을 모두 처리, exec가 0이면 파싱만 한다
+text는 서버처럼 한 줄씩 MAXLINE 버퍼로 복사한 뒤 파싱
+*/
+static double run(pbuf* wire, int version, int n, int exec, size_t* reply_bytes){
+    proto_conn pc;
+    proto_req req;
+    pbuf out;
+    char line[MAXLINE];
+    volatile int sink = 0;
+    size_t off = 0;
+
+    proto_conn_init(&pc);
+    pc.version = version;
+    pc.nreq = 1;
+    pbuf_init(&out);
+
+    double start = now_ns();
+    for (int i = 0; i < n; i++){
+        if (version == PROTO_BIN){
+            off += proto_parse_bin(wire->data + off, wire->len - off, &req);
+        } else{
+            char* nl = memchr(wire->data + off, '\n', wire->len - off);
+            size_t len = nl - (wire->data + off) + 1;
+            memcpy(line, wire->data + off, len);
+            line[len] = '\0';
+            off += len;
+            proto_parse_text(line, &req);
+        }
+        if (exec){
+            proto_execute(&pc, &req, &out);
+            // 응답은 보내졌다고 치고 버퍼만 비운다
+            if (out.total >= 65536){
+                *reply_bytes += out.total;
+                pbuf_reset(&out);
+            }
+        }
+        sink += req.id;
+    }
+    double ns = (now_ns() - start) / n;
+
+    *reply_bytes += out.total;
+    pbuf_free(&out);
+    return ns;
+}
+
+/*
+show 응답 준비 비용
+  cached: 값이 바뀌지 않아 캐시된 snapshot을 그대로 참조
+  rebuild: 매번 sell로 값을 바꿔 snapshot을 다시 직렬화
+*/
+static void bench_show(int version, int reps, int rebuild){
+    proto_conn pc;
+    proto_req req = {PROTO_OP_SHOW, 0, 0};
+    proto_req sell = {PROTO_OP_SELL, 1, 1};
+    pbuf out, dummy;
+
+    proto_conn_init(&pc);
+    pc.version = version;
+    pc.nreq = 1;
+    pbuf_init(&out);
+    pbuf_init(&dummy);
+
+    double start = now_ns();
+    for (int i = 0; i < reps; i++){
+        if (rebuild){
+            proto_execute(&pc, &sell, &dummy);
+            pbuf_reset(&dummy);
+        }
+        pbuf_reset(&out);
+        proto_execute(&pc, &req, &out);
+    }
+    double us = (now_ns() - start) / reps / 1e3;
+    printf("%-6s %10s %14.3f %12s %10zu\n", version == PROTO_BIN ? "binary" : "text",
+           rebuild ? "rebuild" : "cached", us, "", out.total);
+    pbuf_free(&out);
+    pbuf_free(&dummy);
+}
+
+int main(int argc, char **argv)
+{
+    const char* db = "/tmp/bench_proto.db";
+    int n = (argc > 1) ? atoi(argv[1]) : 1000000;
+    int nstocks = (argc > 2) ? atoi(argv[2]) : 1000;
+    int versions[] = {PROTO_V2, PROTO_BIN};
+    stock_entry* entries = Malloc(nstocks * sizeof(stock_entry));
+    stock_table t;
+
+    for (int i = 0; i < nstocks; i++){
+        entries[i].ID = i + 1;
+        entries[i].left_stock = 1000000;
+        entries[i].price = 1000 + i;
+    }
+    if (stock_create(db, entries, nstocks) < 0 || stock_open(&t, db) < 0)
+        unix_error("bench_proto");
+    free(entries);
+    proto_init(&t);
+
+    printf("requests=%d stocks=%d (buy/sell 반반)\n", n, nstocks);
+    printf("%-6s %10s %14s %12s %10s\n", "proto", "req B/op", "parse ns/op", "exec ns/op", "reply B/op");
+    for (int k = 0; k < 2; k++){
+        pbuf wire;
+        size_t reply_bytes = 0, dummy = 0;
+
+        pbuf_init(&wire);
+        make_requests(&wire, versions[k], n, nstocks);
+        double parse = run(&wire, versions[k], n, 0, &dummy);
+        double exec = run(&wire, versions[k], n, 1, &reply_bytes);
+        printf("%-6s %10.2f %14.1f %12.1f %10.2f\n", versions[k] == PROTO_BIN ? "binary" : "text",
+               (double)wire.len / n, parse, exec, (double)reply_bytes / n);
+        pbuf_free(&wire);
+    }
+
+    printf("\n%-6s %10s %14s %12s %10s\n", "proto", "show", "prepare us/op", "", "reply B");
+    for (int k = 0; k < 2; k++){
+        bench_show(versions[k], 200, 1);
+        bench_show(versions[k], 100000, 0);
+    }
+
+    stock_close(&t);
+    unlink(db);
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * bench_sbuf.c - 연결 전달 큐 비교 (세마포어 sbuf vs lock-free MPMC ring)
+ *   usage: ./bench_sbuf [items] [capacity]
+ *   producer가 넣은 시각을 item으로 전달하고, consumer가 꺼낸 시각과의 차이를
+ *   handoff latency로 기록한다. 1P/4C는 acceptor 1개 + worker 4개 구성과 같다.
+ */
+#include "csapp.h"
+#include "sbuf.h"
+#include <time.h>
+
+// 이전 구현과 같은 세마포어 3개짜리 공유 버퍼
+typedef struct{
+    uint64_t* buf;
+    int n;
+    int front;
+    int rear;
+    sem_t mutex;
+    sem_t slots;
+    sem_t items;
+} sem_sbuf_t;
+
+static void sem_sbuf_init(sem_sbuf_t *sp, int n){
+    sp->buf = Calloc(n, sizeof(uint64_t));
+    sp->n = n;
+    sp->front = sp->rear = 0;
+    Sem_init(&sp->mutex, 0, 1);
+    Sem_init(&sp->slots, 0, n);
+    Sem_init(&sp->items, 0, 0);
+}
+
+static void sem_sbuf_insert(sem_sbuf_t *sp, uint64_t item){
+    P(&sp->slots);
+    P(&sp->mutex);
+    sp->buf[(++sp->rear)%(sp->n)] = item;
+    V(&sp->mutex);
+    V(&sp->items);
+}
+
+static uint64_t sem_sbuf_remove(sem_sbuf_t *sp){
+    uint64_t item;
+    P(&sp->items);
+    P(&sp->mutex);
+    item = sp->buf[(++sp->front)%(sp->n)];
+    V(&sp->mutex);
+    V(&sp->slots);
+    return item;
+}
+
+#define STOP UINT64_MAX
+
+static int use_ring;
+static long nitems, per_producer;
+static sem_sbuf_t sem_q;
+static sbuf_t ring_q;
+static uint64_t* lat; // consumer 별 latency 기록 (ns)
+static long lat_n;
+
+static uint64_t now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void q_insert(uint64_t v){
+    if (use_ring) sbuf_insert(&ring_q, v);
+    else sem_sbuf_insert(&sem_q, v);
+}
+
+static uint64_t q_remove(void){
+    return use_ring ? sbuf_remove(&ring_q) : sem_sbuf_remove(&sem_q);
+}
+
+static void* producer(void* vargp){
+    for (long i = 0; i < per_producer; i++)
+        q_insert(now_ns());
+    return NULL;
+}
+
+static void* consumer(void* vargp){
+    uint64_t v;
+    while ((v = q_remove()) != STOP){
+        long k = __atomic_fetch_add(&lat_n, 1, __ATOMIC_RELAXED);
+        lat[k] = now_ns() - v;
+    }
+    return NULL;
+}
+
+static int cmp_u64(const void* a, const void* b){
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char* name, int np, int nc, int cap){
+    pthread_t tids[64];
+    uint64_t start;
+    double sec;
+    int i;
+
+    if (use_ring) sbuf_init(&ring_q, cap);
+    else sem_sbuf_init(&sem_q, cap);
+    per_producer = nitems / np;
+    lat_n = 0;
+
+    start = now_ns();
+    for (i = 0; i < nc; i++)
+        Pthread_create(&tids[i], NULL, consumer, NULL);
+    for (i = 0; i < np; i++)
+        Pthread_create(&tids[nc + i], NULL, producer, NULL);
+    for (i = 0; i < np; i++)
+        Pthread_join(tids[nc + i], NULL);
+    for (i = 0; i < nc; i++)
+        q_insert(STOP);
+    for (i = 0; i < nc; i++)
+        Pthread_join(tids[i], NULL);
+    sec = (now_ns() - start) / 1e9;
+
+    qsort(lat, lat_n, sizeof(uint64_t), cmp_u64);
+    printf("%-6s %2dP/%-2dC %12.2f %10.0f %10.0f %12.0f\n", name, np, nc,
+           lat_n / sec / 1e6, (double)lat[lat_n / 2], (double)lat[lat_n * 99 / 100],
+           (double)lat[lat_n - 1]);
+
+    if (use_ring) sbuf_deinit(&ring_q);
+    else Free(sem_q.buf);
+}
+
+int main(int argc, char **argv)
+{
+    int configs[][2] = {{1, 1}, {1, 4}, {4, 4}, {8, 8}};
+    int cap;
+
+    nitems = (argc > 1) ? atol(argv[1]) : 1000000;
+    cap = (argc > 2) ? atoi(argv[2]) : 1024;
+    lat = Malloc(nitems * sizeof(uint64_t));
+
+    printf("items=%ld capacity=%d\n", nitems, cap);
+    printf("%-6s %7s %12s %10s %10s %12s\n", "queue", "threads", "Mitems/s", "p50(ns)", "p99(ns)", "max(ns)");
+    for (int k = 0; k < 4; k++){
+        use_ring = 0;
+        run("sem", configs[k][0], configs[k][1], cap);
+        use_ring = 1;
+        run("mpmc", configs[k][0], configs[k][1], cap);
+    }
+    free(lat);
+    return 0;
+}
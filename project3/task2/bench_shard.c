@@ -0,0 +1,156 @@
+/*
+ * bench_shard.c - 공유 테이블 vs shard 전담 thread (--shards)
+ *   usage: ./bench_shard [stocks] [ops per thread] [shards]
+ *   각 thread는 buy 1 / sell 1을 번갈아 보내고 (잔량은 그대로), 종목은
+ *   uniform 또는 Zipf(s=0.99, 인기 순위는 종목에 무작위로 배정) 분포에서 고른다.
+ *   공유 테이블은 thread가 proto_execute로 직접 CAS 하고,
+ *   shard는 shard_execute로 종목의 shard thread에 넘기고 기다린다 (서버의 worker와 같은 경로).
+ *   종목 선택은 시간 밖에서 미리 해 둔다. WAL은 쓰지 않는다.
+ */
+#include "csapp.h"
+#include "shard.h"
+#include <math.h>
+#include <time.h>
+
+static int nstocks, nops, sharded;
+static int** picks; // thread별 종목 ID 순서
+
+static double now_sec(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// rank k (0부터)의 누적 확률 cdf[k] = sum_{j<=k} 1/(j+1)^s / H
+static double* zipf_cdf(int n, double s){
+    double* cdf = Malloc(n * sizeof(double));
+    double sum = 0;
+
+    for (int k = 0; k < n; k++)
+        cdf[k] = (sum += 1.0 / pow(k + 1, s));
+    for (int k = 0; k < n; k++)
+        cdf[k] /= sum;
+    return cdf;
+}
+
+static int zipf_rank(double* cdf, int n, double u){
+    int lo = 0, hi = n - 1;
+
+    while (lo < hi){
+        int mid = (lo + hi) / 2;
+        if (cdf[mid] < u)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// thread마다 nops개의 종목 ID, zipf면 순위 -> 종목 배정은 무작위 순열
+static void make_picks(int nthreads, int zipf){
+    double* cdf = zipf ? zipf_cdf(nstocks, 0.99) : NULL;
+    int* perm = Malloc(nstocks * sizeof(int));
+    unsigned int seed = 1;
+
+    for (int i = 0; i < nstocks; i++)
+        perm[i] = i;
+    for (int i = nstocks - 1; i > 0; i--){
+        int j = rand_r(&seed) % (i + 1), t = perm[i];
+        perm[i] = perm[j];
+        perm[j] = t;
+    }
+    for (int t = 0; t < nthreads; t++){
+        for (int n = 0; n < nops; n++){
+            int idx = zipf ? perm[zipf_rank(cdf, nstocks, rand_r(&seed) / (RAND_MAX + 1.0))]
+                           : rand_r(&seed) % nstocks;
+            picks[t][n] = idx + 1;
+        }
+    }
+    free(perm);
+    free(cdf);
+}
+
+static void* worker(void* vargp){
+    int* ids = picks[(long)vargp];
+    proto_conn pc;
+    proto_req req;
+    pbuf out;
+
+    proto_conn_init(&pc);
+    pc.version = PROTO_V2;
+    pc.nreq = 1;
+    pbuf_init(&out);
+    for (int n = 0; n < nops; n++){
+        req.op = (n & 1) ? PROTO_OP_SELL : PROTO_OP_BUY;
+        req.id = ids[n];
+        req.count = 1;
+        if (sharded)
+            shard_execute(&pc, &req, &out);
+        else
+            proto_execute(&pc, &req, &out);
+        pbuf_reset(&out);
+    }
+    pbuf_free(&out);
+    return NULL;
+}
+
+static double run(int nthreads){
+    pthread_t tids[64];
+    double start = now_sec();
+
+    for (long i = 0; i < nthreads; i++)
+        Pthread_create(&tids[i], NULL, worker, (void*)i);
+    for (int i = 0; i < nthreads; i++)
+        Pthread_join(tids[i], NULL);
+    return (double)nthreads * nops / (now_sec() - start) / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    const char* db = "/tmp/bench_shard.db";
+    const char* dist[] = {"uniform", "zipf"};
+    int threads[] = {4, 16};
+    stock_table table;
+
+    nstocks = (argc > 1) ? atoi(argv[1]) : 10000;
+    nops = (argc > 2) ? atoi(argv[2]) : 200000;
+    int nshards = (argc > 3) ? atoi(argv[3]) : 4;
+    if (nstocks < 1 || nshards < 1 || nshards > SHARD_MAX)
+        app_error("bench_shard: bad arguments");
+
+    stock_entry* entries = Malloc(nstocks * sizeof(stock_entry));
+    for (int i = 0; i < nstocks; i++){
+        entries[i].ID = i + 1;
+        entries[i].left_stock = 1000000;
+        entries[i].price = 1000;
+    }
+    if (stock_create(db, entries, nstocks) < 0 || stock_open(&table, db) < 0)
+        unix_error("bench_shard");
+    proto_init(&table);
+    shard_init(&table, nshards);
+
+    picks = Malloc(64 * sizeof(int*));
+    for (int t = 0; t < 64; t++)
+        picks[t] = Malloc(nops * sizeof(int));
+
+    printf("stocks=%d ops/thread=%d shards=%d cpus=%ld\n", nstocks, nops, nshards, sysconf(_SC_NPROCESSORS_ONLN));
+    printf("%8s %8s %16s %16s %8s\n", "dist", "threads", "shared(Mops/s)", "sharded(Mops/s)", "ratio");
+    for (int d = 0; d < 2; d++){
+        for (int k = 0; k < 2; k++){
+            make_picks(threads[k], d);
+            sharded = 0;
+            double s = run(threads[k]);
+            sharded = 1;
+            double h = run(threads[k]);
+            printf("%8s %8d %16.2f %16.2f %7.2fx\n", dist[d], threads[k], s, h, h / s);
+        }
+    }
+
+    stock_close(&table);
+    unlink(db);
+    for (int t = 0; t < 64; t++)
+        free(picks[t]);
+    free(picks);
+    free(entries);
+    return 0;
+}
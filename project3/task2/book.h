@@ -0,0 +1,75 @@
+/*
+ * book.h - 종목 하나의 limit order book (price-time priority 매칭)
+ *
+ * 가격마다 price level이 있고, level 안의 주문은 list_elem으로 엮인 시간 순 FIFO다.
+ * side마다 level 포인터를 가격 순으로 정렬된 배열에 두고 가장 좋은 가격을 맨 뒤에 둔다.
+ *   - bid: 가격 오름차순 (맨 뒤가 최고 매수가)
+ *   - ask: 가격 내림차순 (맨 뒤가 최저 매도가)
+ * 따라서 top-of-book 매칭과 level 삭제는 배열 끝에서 끝나고, 새 level만 이진 탐색 + memmove.
+ *
+ * 주문 node는 chunk 단위로 늘어나는 pool에서 꺼내고 free list로 재사용한다 (malloc 없음).
+ * order id = (book 안의 일련번호 << 32) | pool slot 번호 이므로 취소는 hash 없이 O(1)이고,
+ * 이미 체결/취소되어 재사용된 slot의 옛 id는 일련번호가 달라 거부된다.
+ *
+ * lock을 잡지 않는다. 여러 thread가 쓰면 호출하는 쪽이 book마다 직렬화한다.
+ */
+#ifndef __BOOK_H__
+#define __BOOK_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "list.h"
+
+#define BOOK_BUY 0
+#define BOOK_SELL 1
+#define BOOK_CHUNK 4096 // pool이 한 번에 늘리는 주문 node 수
+
+struct book_level;
+
+typedef struct {
+    struct list_elem elem; // level 안의 시간 순서 (pool에서는 free list)
+    uint64_t id; // 0이면 빈 node
+    int side;
+    int32_t price;
+    int32_t qty; // 남은 수량
+    struct book_level* level;
+} book_order;
+
+typedef struct book_level {
+    struct list orders;
+    int32_t price;
+    int64_t qty; // level 전체 잔량
+} book_level;
+
+typedef struct {
+    book_level** levels; // 가장 좋은 가격이 맨 뒤
+    int n, cap;
+} book_side;
+
+typedef struct {
+    book_side side[2];
+    book_order** chunks; // pool, slot s는 chunks[s / BOOK_CHUNK][s % BOOK_CHUNK]
+    int nchunks;
+    uint32_t used; // 한 번이라도 꺼낸 slot 수
+    struct list free_orders;
+    book_level** free_levels;
+    int nfree_levels, free_cap;
+    uint32_t seq; // order id 일련번호
+} book;
+
+// 주문 하나의 처리 결과
+typedef struct {
+    uint64_t id; // book에 남은 주문의 id, 전부 체결되었거나 market이면 0
+    int32_t filled; // 체결 수량
+    int32_t last_price; // 마지막 체결 가격 (filled > 0일 때)
+    int fills; // 체결된 상대 주문 수
+} book_result;
+
+void book_init(book*);
+void book_free(book*);
+void book_limit(book*, int, int32_t, int32_t, book_result*);
+void book_market(book*, int, int32_t, book_result*);
+int book_cancel(book*, uint64_t);
+int book_top(book*, int, int32_t*, int64_t*);
+
+#endif /* __BOOK_H__ */
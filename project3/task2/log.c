@@ -0,0 +1,216 @@
+/*
+ * log.c - 비동기 로그 (thread 별 lock-free ring + background writer)
+ */
+#include "csapp.h"
+#include "log.h"
+#include <stdarg.h>
+#include <time.h>
+
+static int log_fd = -1;
+static int log_level = LOG_OFF;
+static log_ring* rings; // 모든 thread의 ring, 새 ring은 앞에 붙인다
+static __thread log_ring* my;
+static pthread_key_t ring_key;
+static pthread_t writer_tid;
+static int stopping;
+static pthread_mutex_t drain_mutex = PTHREAD_MUTEX_INITIALIZER; // writer와 log_flush 사이
+
+static const char* level_names[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+// 자식 process에는 writer가 없으므로 로그를 끈다
+static void log_atfork_child(void){
+    log_fd = -1;
+    log_level = LOG_OFF;
+    my = NULL;
+}
+
+// thread가 끝나면 ring을 writer에게 넘긴다 (남은 메시지를 쓴 뒤 free)
+// 이후 다른 key의 destructor가 log_write를 부르면 freed ring 대신 새 ring을 받도록 my를 비운다
+static void ring_release(void* p){
+    my = NULL;
+    __atomic_store_n(&((log_ring*)p)->dead, 1, __ATOMIC_RELEASE);
+}
+
+static log_ring* ring_get(void){
+    log_ring* r = my;
+
+    if (r == NULL){
+        r = Calloc(1, sizeof(log_ring));
+        r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            ;
+        pthread_setspecific(ring_key, r);
+        my = r;
+    }
+    return r;
+}
+
+static uint64_t realtime_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// "YYYY-mm-dd HH:MM:SS.uuuuuu LEVEL msg\n", 같은 초는 localtime_r을 다시 하지 않는다
+static size_t format_line(char* buf, uint64_t ts, int level, const char* msg, int len){
+    static time_t last_sec = -1;
+    static char sec_str[32];
+    time_t sec = ts / 1000000000ull;
+    struct tm tm;
+
+    if (sec != last_sec){
+        localtime_r(&sec, &tm);
+        strftime(sec_str, sizeof(sec_str), "%Y-%m-%d %H:%M:%S", &tm);
+        last_sec = sec;
+    }
+    return sprintf(buf, "%s.%06u %s %.*s\n", sec_str, (unsigned)(ts % 1000000000ull / 1000),
+                   level_names[level], len, msg);
+}
+
+static void write_all(char* buf, size_t n){
+    while (n > 0){
+        ssize_t w = write(log_fd, buf, n);
+        if (w < 0){
+            if (errno == EINTR)
+                continue;
+            return; // 로그 fd 에러는 무시
+        }
+        buf += w;
+        n -= w;
+    }
+}
+
+// 모든 ring을 비워서 batch 단위로 write, 처리한 메시지 수 반환
+static int drain(void){
+    static char batch[LOG_BATCH];
+    size_t len = 0;
+    int count = 0;
+    log_ring* prev = NULL;
+    log_ring* r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+
+    while (r){
+        // dead를 먼저 읽어야 종료 직전에 쓴 메시지까지 head에 포함된다
+        int dead = __atomic_load_n(&r->dead, __ATOMIC_ACQUIRE);
+        size_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        size_t tail = r->tail;
+
+        while (tail != head){
+            log_rec* rec = &r->recs[tail & (LOG_RING_SLOTS - 1)];
+            if (len + LOG_MSG_MAX + 64 > LOG_BATCH){
+                write_all(batch, len);
+                len = 0;
+            }
+            len += format_line(batch + len, rec->ts, rec->level, rec->msg, rec->len);
+            // 다 읽은 slot을 producer에게 돌려준다
+            __atomic_store_n(&r->tail, ++tail, __ATOMIC_RELEASE);
+            count++;
+        }
+        if (dropped != r->dropped_seen){
+            char msg[64];
+            int n = snprintf(msg, sizeof(msg), "log: %llu messages dropped",
+                             (unsigned long long)(dropped - r->dropped_seen));
+            if (len + LOG_MSG_MAX + 64 > LOG_BATCH){
+                write_all(batch, len);
+                len = 0;
+            }
+            len += format_line(batch + len, realtime_ns(), LOG_WARN, msg, n);
+            r->dropped_seen = dropped;
+        }
+
+        // 끝난 thread의 ring은 떼어내서 free (맨 앞은 새 ring을 붙이는 자리라 두고 넘어간다)
+        log_ring* next = r->next;
+        if (dead && prev != NULL){
+            prev->next = next;
+            free(r);
+        } else{
+            prev = r;
+        }
+        r = next;
+    }
+    if (len > 0)
+        write_all(batch, len);
+    return count;
+}
+
+static void* writer_thread(void* vargp){
+    struct timespec idle = {0, LOG_FLUSH_MS * 1000000L};
+    sigset_t mask;
+
+    (void)vargp;
+    // 로그 writer는 signal을 받지 않는다
+    Sigfillset(&mask);
+    pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    while (!__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)){
+        pthread_mutex_lock(&drain_mutex);
+        int n = drain();
+        pthread_mutex_unlock(&drain_mutex);
+        if (n == 0)
+            nanosleep(&idle, NULL);
+    }
+    return NULL;
+}
+
+// fd로 level 이상의 로그를 내보낸다
+void log_init(int fd, int level){
+    log_fd = fd;
+    log_level = level;
+    pthread_key_create(&ring_key, ring_release);
+    pthread_atfork(NULL, NULL, log_atfork_child);
+    Pthread_create(&writer_tid, NULL, writer_thread, NULL);
+}
+
+void log_set_level(int level){
+    __atomic_store_n(&log_level, level, __ATOMIC_RELAXED);
+}
+
+int log_enabled(int level){
+    return level >= __atomic_load_n(&log_level, __ATOMIC_RELAXED);
+}
+
+// 절대 block 하지 않는다: ring이 가득 차면 버리고 개수만 센다
+void log_write(int level, const char* fmt, ...){
+    log_ring* r;
+    log_rec* rec;
+    size_t head;
+    va_list ap;
+    int n;
+
+    if (!log_enabled(level))
+        return;
+    r = ring_get();
+    head = r->head;
+    if (head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == LOG_RING_SLOTS){
+        __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+        return;
+    }
+    rec = &r->recs[head & (LOG_RING_SLOTS - 1)];
+    rec->ts = realtime_ns();
+    rec->level = level;
+    va_start(ap, fmt);
+    n = vsnprintf(rec->msg, LOG_MSG_MAX, fmt, ap);
+    va_end(ap);
+    rec->len = n < 0 ? 0 : n < LOG_MSG_MAX ? n : LOG_MSG_MAX - 1;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// 지금까지 들어온 로그를 바로 내보낸다 (종료 직전 등)
+void log_flush(void){
+    if (log_fd < 0)
+        return;
+    pthread_mutex_lock(&drain_mutex);
+    drain();
+    pthread_mutex_unlock(&drain_mutex);
+}
+
+void log_shutdown(void){
+    if (log_fd < 0)
+        return;
+    __atomic_store_n(&stopping, 1, __ATOMIC_RELEASE);
+    Pthread_join(writer_tid, NULL);
+    pthread_mutex_lock(&drain_mutex); // 동시에 부른 log_flush와 겹치지 않게
+    drain();
+    pthread_mutex_unlock(&drain_mutex);
+    log_fd = -1;
+    log_level = LOG_OFF;
+}
@@ -0,0 +1,60 @@
+/*
+ * log.h - 비동기 로그 (thread 별 lock-free ring + background writer)
+ *
+ * log_write()는 자기 thread의 ring에 timestamp와 메시지를 넣기만 하고 바로 반환한다.
+ * ring은 thread 하나(producer)와 writer thread 하나(consumer)만 쓰므로 lock이 필요 없다.
+ * writer가 모든 ring을 모아 "시각 level 메시지" 줄들로 만들어 write() 한 번에 내보낸다.
+ * ring이 가득 차면 기다리지 않고 버린 뒤, 버린 개수를 나중에 로그로 남긴다.
+ * 한 thread의 메시지 순서는 지켜지고, thread 사이의 순서는 timestamp로 본다.
+ *
+ * fork된 자식 process에서는 writer thread가 없으므로 로그가 꺼진다.
+ * signal handler 안에서는 쓰지 않는다 (vsnprintf가 async-signal-safe가 아님).
+ */
+#ifndef __LOG_H__
+#define __LOG_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+#define LOG_OFF 4
+
+#define LOG_RING_SLOTS 512 // thread 당 대기할 수 있는 메시지 수 (2의 거듭제곱)
+#define LOG_MSG_MAX 200 // 메시지 최대 길이, 넘으면 잘린다
+#define LOG_FLUSH_MS 10 // 쌓인 메시지가 없을 때 writer가 쉬는 시간
+#define LOG_BATCH 65536 // write() 한 번에 보내는 최대 byte
+
+typedef struct {
+    uint64_t ts; // CLOCK_REALTIME ns
+    int level;
+    int len;
+    char msg[LOG_MSG_MAX];
+} log_rec;
+
+typedef struct log_ring {
+    log_rec recs[LOG_RING_SLOTS];
+    size_t head; // producer만 증가
+    char pad[64];
+    size_t tail; // writer만 증가
+    uint64_t dropped; // 가득 차서 버린 개수 (producer)
+    uint64_t dropped_seen; // 이미 보고한 개수 (writer)
+    int dead; // thread 종료, 비우고 나면 writer가 free
+    struct log_ring* next;
+} log_ring;
+
+void log_init(int fd, int level);
+void log_set_level(int level);
+int log_enabled(int level);
+void log_write(int level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+void log_flush(void);
+void log_shutdown(void);
+
+#define log_debug(...) log_write(LOG_DEBUG, __VA_ARGS__)
+#define log_info(...) log_write(LOG_INFO, __VA_ARGS__)
+#define log_warn(...) log_write(LOG_WARN, __VA_ARGS__)
+#define log_error(...) log_write(LOG_ERROR, __VA_ARGS__)
+
+#endif /* __LOG_H__ */
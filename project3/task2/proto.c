@@ -0,0 +1,684 @@
+/*
+ * proto.c - stock server 요청 처리 & 응답 framing
+ */
+#include "csapp.h"
+#include "proto.h"
+#include "stats.h"
+#include "book.h"
+#include "feed.h"
+
+#define SNAP_TEXT 0
+#define SNAP_BIN 1
+
+static stock_table* stocks;
+
+// 종목별 order book, 처음 쓰일 때 만든다 (book_locks[i]가 books[i]를 보호)
+static book** books;
+static pthread_mutex_t* book_locks;
+
+// 형식별 show 캐시, mutex는 캐시 교체와 중복 rebuild를 막는다
+static proto_snap* snap_cache[2];
+static pthread_mutex_t snap_mutex[2] = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_MUTEX_INITIALIZER};
+
+void proto_snap_put(proto_snap* snap){
+    if (__atomic_sub_fetch(&snap->refcnt, 1, __ATOMIC_ACQ_REL) == 0)
+        free(snap);
+}
+
+void pbuf_init(pbuf* b){
+    memset(b, 0, sizeof(*b));
+}
+
+// 내용만 비우고 버퍼는 재사용
+void pbuf_reset(pbuf* b){
+    for (int i = 0; i < b->nrefs; i++)
+        proto_snap_put(b->refs[i].snap);
+    b->nrefs = 0;
+    b->len = b->total = 0;
+}
+
+void pbuf_free(pbuf* b){
+    pbuf_reset(b);
+    free(b->data);
+    free(b->refs);
+    pbuf_init(b);
+}
+
+void pbuf_append(pbuf* b, const void* p, size_t n){
+    if (b->len + n > b->cap){
+        b->cap = (b->len + n) * 2;
+        b->data = Realloc(b->data, b->cap);
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+    b->total += n;
+}
+
+// 참조를 넘겨받아 현재 위치에 snapshot을 끼워 넣는다
+void pbuf_append_snap(pbuf* b, proto_snap* snap){
+    if (b->nrefs == b->ref_cap){
+        b->ref_cap = b->ref_cap ? b->ref_cap * 2 : 4;
+        b->refs = Realloc(b->refs, b->ref_cap * sizeof(pbuf_ref));
+    }
+    b->refs[b->nrefs].pos = b->len;
+    b->refs[b->nrefs].snap = snap;
+    b->nrefs++;
+    b->total += snap->len;
+}
+
+// 논리 위치 off 이후의 구간들을 iov에 채운다, 채운 개수 반환
+int pbuf_iov(pbuf* b, size_t off, struct iovec* iov, int max){
+    size_t pos = 0, dpos = 0;
+    int n = 0;
+
+    for (int i = 0; i <= b->nrefs && n < max; i++){
+        char* seg[2];
+        size_t seglen[2];
+
+        // data[dpos..ref 위치] 다음에 snapshot (마지막은 data의 나머지만)
+        seg[0] = b->data + dpos;
+        seglen[0] = (i < b->nrefs ? b->refs[i].pos : b->len) - dpos;
+        seg[1] = i < b->nrefs ? b->refs[i].snap->data : NULL;
+        seglen[1] = i < b->nrefs ? b->refs[i].snap->len : 0;
+        if (i < b->nrefs)
+            dpos = b->refs[i].pos;
+
+        for (int k = 0; k < 2 && n < max; k++){
+            if (off < pos + seglen[k]){
+                size_t skip = off > pos ? off - pos : 0;
+                iov[n].iov_base = seg[k] + skip;
+                iov[n].iov_len = seglen[k] - skip;
+                n++;
+            }
+            pos += seglen[k];
+        }
+    }
+    return n;
+}
+
+// uint32 LEB128: 하위 7bit부터, 이어지는 byte가 있으면 최상위 bit를 켠다
+void pbuf_put_varint(pbuf* b, uint32_t v){
+    unsigned char tmp[5];
+    size_t n = 0;
+
+    while (v >= 0x80){
+        tmp[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    tmp[n++] = v;
+    pbuf_append(b, tmp, n);
+}
+
+// 읽은 byte 수, 데이터가 모자라면 0, 5 byte를 넘으면 -1
+int proto_get_varint(const unsigned char* p, size_t n, uint32_t* v){
+    uint32_t x = 0;
+
+    for (size_t i = 0; i < n && i < 5; i++){
+        x |= (uint32_t)(p[i] & 0x7f) << (7 * i);
+        if (!(p[i] & 0x80)){
+            *v = x;
+            return i + 1;
+        }
+    }
+    return n < 5 ? 0 : -1;
+}
+
+void proto_init(stock_table* t){
+    stocks = t;
+    books = Calloc(t->count ? t->count : 1, sizeof(book*));
+    book_locks = Malloc((t->count ? t->count : 1) * sizeof(pthread_mutex_t));
+    for (int i = 0; i < t->count; i++)
+        pthread_mutex_init(&book_locks[i], NULL);
+    feed_init(t);
+    stats_init();
+}
+
+void proto_conn_init(proto_conn* pc){
+    pc->version = PROTO_V1;
+    pc->nreq = 0;
+    pc->sub_idx = NULL;
+    pc->sub_n = 0;
+}
+
+// 한 줄 응답: v1은 MAXLINE으로 채우고, v2는 길이 그대로
+static void reply(proto_conn* pc, pbuf* out, const char* msg){
+    size_t n = strlen(msg);
+
+    if (pc->version == PROTO_V1){
+        size_t start = out->len;
+        pbuf_append(out, msg, n);
+        pbuf_append(out, "", 1);
+        // 나머지는 0으로 채움
+        while (out->len - start < MAXLINE){
+            static const char zeros[512];
+            size_t k = MAXLINE - (out->len - start);
+            pbuf_append(out, zeros, k < sizeof(zeros) ? k : sizeof(zeros));
+        }
+    } else{
+        pbuf_append(out, msg, n);
+    }
+}
+
+// binary 응답 status 1 byte
+static void reply_status(pbuf* out, int status){
+    unsigned char st = status;
+    pbuf_append(out, &st, 1);
+}
+
+// 현재 값으로 show 응답을 새로 직렬화 (header 자리를 비워두고 이어서 쓴다)
+static proto_snap* snap_build(int fmt){
+    pbuf b;
+    char line[64];
+    proto_snap hdr = {1, 0};
+
+    pbuf_init(&b);
+    pbuf_append(&b, &hdr, sizeof(hdr));
+    if (fmt == SNAP_BIN){
+        // bulk snapshot frame: 개수 + (ID, 잔량, 가격) varint 나열
+        unsigned char st = PROTO_ST_SNAPSHOT;
+        pbuf_append(&b, &st, 1);
+        pbuf_put_varint(&b, stocks->count);
+    }
+    for (int i = 0; i < stocks->count; i++){
+        // (잔량, 가격)을 한 번에 읽으므로 lock 없이도 일관된 값
+        Item item = stock_get(stocks, i);
+        if (fmt == SNAP_BIN){
+            pbuf_put_varint(&b, (uint32_t)stocks->ids[i]);
+            pbuf_put_varint(&b, (uint32_t)item.left_stock);
+            pbuf_put_varint(&b, (uint32_t)item.price);
+        } else{
+            int n = snprintf(line, sizeof(line), "%d %d %d\n", stocks->ids[i], item.left_stock, item.price);
+            pbuf_append(&b, line, n);
+        }
+    }
+    if (fmt == SNAP_TEXT)
+        pbuf_append(&b, PROTO_END, strlen(PROTO_END));
+
+    proto_snap* snap = (proto_snap*)b.data;
+    snap->len = b.len - sizeof(hdr);
+    return snap;
+}
+
+// 최신 show 응답의 참조를 얻는다 (다 쓰면 proto_snap_put)
+static proto_snap* snap_get(int fmt){
+    proto_snap* snap;
+
+    pthread_mutex_lock(&snap_mutex[fmt]);
+    // 마지막 rebuild 이후 buy/sell이 있었을 때만 다시 만든다
+    if (stock_take_dirty(stocks, 1u << fmt) || snap_cache[fmt] == NULL){
+        if (snap_cache[fmt])
+            proto_snap_put(snap_cache[fmt]);
+        snap_cache[fmt] = snap_build(fmt);
+    }
+    snap = snap_cache[fmt];
+    __atomic_add_fetch(&snap->refcnt, 1, __ATOMIC_RELAXED);
+    pthread_mutex_unlock(&snap_mutex[fmt]);
+    return snap;
+}
+
+static void show(proto_conn* pc, pbuf* out){
+    char line[64];
+
+    if (pc->version != PROTO_V1){
+        pbuf_append_snap(out, snap_get(pc->version == PROTO_BIN ? SNAP_BIN : SNAP_TEXT));
+        return;
+    }
+
+    // 기존 client는 MAXLINE만 읽으므로 그 안에 들어가는 만큼만 보낸다
+    char response[MAXLINE];
+    size_t len = 0;
+    for (int i = 0; i < stocks->count; i++){
+        Item item = stock_get(stocks, i);
+        int n = snprintf(line, sizeof(line), "%d %d %d\n", stocks->ids[i], item.left_stock, item.price);
+        if (len + n >= MAXLINE)
+            break;
+        memcpy(response + len, line, n);
+        len += n;
+    }
+    response[len] = '\0';
+    reply(pc, out, response);
+}
+
+/*
+"order buy 1 5 sell 3 2 ..." 의 leg들, 형식이 틀리면 0
+수량은 1 이상이어야 하고 leg 뒤에 다른 내용이 있으면 안 된다
+*/
+static int parse_order(char* buf, proto_req* req){
+    char* p = buf + strspn(buf, " \t") + 5; // "order" 다음
+    char* end;
+
+    req->nlegs = 0;
+    while (*(p += strspn(p, " \t\r")) != '\0'){
+        proto_leg* leg = &req->legs[req->nlegs];
+
+        // sscanf는 호출마다 남은 문자열 길이를 다시 재므로 leg가 많으면 직접 자른다
+        if (strncmp(p, "buy", 3) == 0 && isspace((unsigned char)p[3]))
+            leg->op = PROTO_OP_BUY, p += 3;
+        else if (strncmp(p, "sell", 4) == 0 && isspace((unsigned char)p[4]))
+            leg->op = PROTO_OP_SELL, p += 4;
+        else
+            return 0;
+        if (req->nlegs == PROTO_ORDER_MAX)
+            return 0;
+        leg->id = strtol(p, &end, 10);
+        if (end == p)
+            return 0;
+        leg->count = strtol(p = end, &end, 10);
+        if (end == p || leg->count < 1 || !(isspace((unsigned char)*end) || *end == '\0'))
+            return 0;
+        p = end;
+        req->nlegs++;
+    }
+    return req->nlegs > 0;
+}
+
+// "subscribe 1 2 3" 의 ID들을 legs[].id에 (없어도 된다), 숫자가 아니거나 너무 많으면 0
+static int parse_ids(char* buf, proto_req* req){
+    char* p = buf + strspn(buf, " \t");
+    char* end;
+
+    p += strcspn(p, " \t"); // 명령어 다음
+    req->nlegs = 0;
+    while (*(p += strspn(p, " \t\r")) != '\0'){
+        if (req->nlegs == PROTO_ORDER_MAX)
+            return 0;
+        req->legs[req->nlegs++].id = strtol(p, &end, 10);
+        if (end == p || !(isspace((unsigned char)*end) || *end == '\0'))
+            return 0;
+        p = end;
+    }
+    return 1;
+}
+
+// "buy" / "sell" -> BOOK_BUY / BOOK_SELL, 아니면 -1
+static int parse_side(const char* s){
+    return strcmp(s, "buy") == 0 ? BOOK_BUY : strcmp(s, "sell") == 0 ? BOOK_SELL : -1;
+}
+
+// limit / market / cancel / book, 형식이 틀리면 PROTO_OP_BADARGS
+static int parse_book_cmd(char* buf, const char* command, proto_req* req){
+    char side[8];
+    unsigned long long oid;
+
+    if (strcmp(command, "limit") == 0){
+        if (sscanf(buf, "limit %7s %d %d %d", side, &req->id, &req->price, &req->count) != 4
+            || (req->side = parse_side(side)) < 0 || req->price < 0 || req->count < 1)
+            return PROTO_OP_BADARGS;
+        return PROTO_OP_LIMIT;
+    }
+    if (strcmp(command, "market") == 0){
+        if (sscanf(buf, "market %7s %d %d", side, &req->id, &req->count) != 3
+            || (req->side = parse_side(side)) < 0 || req->count < 1)
+            return PROTO_OP_BADARGS;
+        return PROTO_OP_MARKET;
+    }
+    if (strcmp(command, "cancel") == 0){
+        if (sscanf(buf, "cancel %d %llu", &req->id, &oid) != 2)
+            return PROTO_OP_BADARGS;
+        req->oid = oid;
+        return PROTO_OP_CANCEL;
+    }
+    return sscanf(buf, "book %d", &req->id) == 1 ? PROTO_OP_BOOK : PROTO_OP_BADARGS;
+}
+
+// text 요청 한 줄 파싱
+void proto_parse_text(char* buf, proto_req* req){
+    char command[MAXLINE];
+
+    buf[strcspn(buf, "\n")] = 0;
+    req->op = PROTO_OP_UNKNOWN;
+
+    if (sscanf(buf, "%s", command) != 1)
+        return;
+
+    if (strcmp(command, "hello") == 0){
+        if (sscanf(buf, "hello %d", &req->count) == 1)
+            req->op = PROTO_OP_HELLO;
+    }
+    else if (strcmp(command, "show") == 0)
+        req->op = PROTO_OP_SHOW;
+    else if (strncmp(command, "buy", 3) == 0)
+        // binary와 같이 수량은 1 이상 (음수 buy는 잔량 확인 없는 sell이 된다)
+        req->op = (sscanf(buf, "buy %d %d", &req->id, &req->count) == 2 && req->count >= 1) ? PROTO_OP_BUY : PROTO_OP_BADARGS;
+    else if (strncmp(command, "sell", 4) == 0)
+        req->op = (sscanf(buf, "sell %d %d", &req->id, &req->count) == 2 && req->count >= 1) ? PROTO_OP_SELL : PROTO_OP_BADARGS;
+    else if (strcmp(command, "exit") == 0)
+        req->op = PROTO_OP_EXIT;
+    else if (strcmp(command, "order") == 0)
+        req->op = parse_order(buf, req) ? PROTO_OP_ORDER : PROTO_OP_BADARGS;
+    else if (strcmp(command, "stats") == 0)
+        req->op = PROTO_OP_STATS;
+    else if (strcmp(command, "limit") == 0 || strcmp(command, "market") == 0
+             || strcmp(command, "cancel") == 0 || strcmp(command, "book") == 0)
+        req->op = parse_book_cmd(buf, command, req);
+    else if (strcmp(command, "subscribe") == 0)
+        req->op = parse_ids(buf, req) ? PROTO_OP_SUBSCRIBE : PROTO_OP_BADARGS;
+    else if (strcmp(command, "unsubscribe") == 0)
+        req->op = parse_ids(buf, req) ? PROTO_OP_UNSUBSCRIBE : PROTO_OP_BADARGS;
+}
+
+// order frame: opcode + varint leg 수 + leg마다 (opcode, varint ID, varint 수량)
+static int parse_order_bin(const unsigned char* p, size_t n, proto_req* req){
+    uint32_t nlegs, id, count;
+    size_t off = 1;
+    int k;
+
+    if ((k = proto_get_varint(p + off, n - off, &nlegs)) <= 0)
+        return k;
+    if (nlegs == 0 || nlegs > PROTO_ORDER_MAX)
+        return -1;
+    off += k;
+    for (req->nlegs = 0; req->nlegs < (int)nlegs; req->nlegs++){
+        proto_leg* leg = &req->legs[req->nlegs];
+
+        if (off == n)
+            return 0;
+        leg->op = p[off++];
+        if (leg->op != PROTO_OP_BUY && leg->op != PROTO_OP_SELL)
+            return -1;
+        if ((k = proto_get_varint(p + off, n - off, &id)) <= 0)
+            return k;
+        off += k;
+        if ((k = proto_get_varint(p + off, n - off, &count)) <= 0)
+            return k;
+        off += k;
+        if (count < 1 || count > INT32_MAX)
+            return -1;
+        leg->id = (int)id;
+        leg->count = (int)count;
+    }
+    return off;
+}
+
+// binary frame 하나 파싱, 사용한 byte 수 (모자라면 0, 잘못된 frame이면 -1)
+int proto_parse_bin(const char* buf, size_t n, proto_req* req){
+    const unsigned char* p = (const unsigned char*)buf;
+    uint32_t id, count;
+    int k1, k2;
+
+    if (n == 0)
+        return 0;
+    req->op = p[0];
+    if (req->op == PROTO_OP_SHOW || req->op == PROTO_OP_EXIT)
+        return 1;
+    if (req->op == PROTO_OP_ORDER)
+        return parse_order_bin(p, n, req);
+    if (req->op != PROTO_OP_BUY && req->op != PROTO_OP_SELL)
+        return -1;
+
+    if ((k1 = proto_get_varint(p + 1, n - 1, &id)) <= 0)
+        return k1;
+    if ((k2 = proto_get_varint(p + 1 + k1, n - 1 - k1, &count)) <= 0)
+        return k2;
+    if (count < 1 || count > INT32_MAX)
+        return -1;
+    req->id = (int)id;
+    req->count = (int)count;
+    return 1 + k1 + k2;
+}
+
+// 결과 문자열(text) 또는 status(binary)로 응답
+static void reply_result(proto_conn* pc, pbuf* out, int status){
+    static const char* msg[] = {
+        [PROTO_ST_NOSTOCK] = "Not enough left stocks\n",
+        [PROTO_ST_BADID] = "Invalid stock ID\n",
+        [PROTO_ST_FULL] = "Too many left stocks\n",
+    };
+
+    if (pc->version == PROTO_BIN)
+        reply_status(out, status);
+    else if (status != PROTO_ST_OK)
+        reply(pc, out, msg[status]);
+}
+
+// stats - 모든 thread의 counter를 합쳐서 출력
+static void stats(proto_conn* pc, pbuf* out){
+    char buf[MAXLINE];
+
+    stats_format(buf, sizeof(buf));
+    if (pc->version == PROTO_V1){
+        reply(pc, out, buf);
+        return;
+    }
+    pbuf_append(out, buf, strlen(buf));
+    pbuf_append(out, PROTO_END, strlen(PROTO_END));
+}
+
+// order - 모든 leg를 한 번에 반영하거나 하나도 반영하지 않는다
+static void order(proto_conn* pc, proto_req* req, pbuf* out){
+    stock_leg legs[PROTO_ORDER_MAX];
+    int ok;
+
+    for (int i = 0; i < req->nlegs; i++){
+        if ((legs[i].idx = stock_find(stocks, req->legs[i].id)) < 0){
+            reply_result(pc, out, PROTO_ST_BADID);
+            return;
+        }
+        legs[i].delta = req->legs[i].op == PROTO_OP_BUY ? -req->legs[i].count : req->legs[i].count;
+    }
+    if ((ok = stock_order(stocks, legs, req->nlegs)) <= 0){
+        if (ok == 0)
+            stats_buy_fail();
+        reply_result(pc, out, ok == 0 ? PROTO_ST_NOSTOCK : PROTO_ST_FULL);
+        return;
+    }
+    for (int i = 0; i < req->nlegs; i++)
+        feed_changed(legs[i].idx);
+    if (pc->version == PROTO_BIN)
+        reply_status(out, PROTO_ST_OK);
+    else
+        reply(pc, out, "[order] success\n");
+}
+
+// idx 종목의 book을 잠그고 반환 (다 쓰면 book_unlock)
+static book* book_lock(int idx){
+    pthread_mutex_lock(&book_locks[idx]);
+    if (books[idx] == NULL){
+        books[idx] = Malloc(sizeof(book));
+        book_init(books[idx]);
+    }
+    return books[idx];
+}
+
+static void book_unlock(int idx){
+    pthread_mutex_unlock(&book_locks[idx]);
+}
+
+// limit / market / cancel / book 요청 처리 (종목 ID는 이미 확인됨)
+static void book_request(proto_conn* pc, proto_req* req, int idx, pbuf* out){
+    char line[96];
+    book_result r;
+    book* b = book_lock(idx);
+
+    switch (req->op){
+    case PROTO_OP_LIMIT:
+    case PROTO_OP_MARKET:
+        if (req->op == PROTO_OP_LIMIT)
+            book_limit(b, req->side, req->price, req->count, &r);
+        else
+            book_market(b, req->side, req->count, &r);
+        // 체결가 반영도 book lock 안에서 해야 체결 순서대로 가격이 남는다
+        if (r.filled > 0)
+            stock_set_price(stocks, idx, r.last_price);
+        book_unlock(idx);
+        if (r.filled > 0)
+            feed_changed(idx);
+        if (req->op == PROTO_OP_LIMIT)
+            snprintf(line, sizeof(line), "[limit] filled %d id %llu\n", r.filled, (unsigned long long)r.id);
+        else
+            snprintf(line, sizeof(line), "[market] filled %d\n", r.filled);
+        reply(pc, out, line);
+        return;
+
+    case PROTO_OP_CANCEL:{
+        int ok = book_cancel(b, req->oid);
+        book_unlock(idx);
+        reply(pc, out, ok ? "[cancel] success\n" : "Invalid order ID\n");
+        return;
+    }
+    }
+
+    // book: side마다 최우선 가격부터 PROTO_BOOK_DEPTH개 level
+    pbuf tmp;
+    pbuf_init(&tmp);
+    for (int s = BOOK_SELL; s >= BOOK_BUY; s--){
+        book_side* bs = &b->side[s];
+        for (int i = bs->n - 1; i >= 0 && i >= bs->n - PROTO_BOOK_DEPTH; i--){
+            int n = snprintf(line, sizeof(line), "%s %d %lld\n", s == BOOK_SELL ? "ask" : "bid",
+                             bs->levels[i]->price, (long long)bs->levels[i]->qty);
+            pbuf_append(&tmp, line, n);
+        }
+    }
+    book_unlock(idx);
+    if (pc->version == PROTO_V1){
+        pbuf_append(&tmp, "", 1);
+        reply(pc, out, tmp.data);
+    } else{
+        if (tmp.len > 0)
+            pbuf_append(out, tmp.data, tmp.len);
+        pbuf_append(out, PROTO_END, strlen(PROTO_END));
+    }
+    pbuf_free(&tmp);
+}
+
+/*
+subscribe - 종목 idx들을 pc에 남기고 PROTO_SUBSCRIBE를 반환한다
+연결을 feed로 넘기는 것은 호출한 쪽 (worker / reactor / feed thread 자신)
+unsubscribe는 feed thread가 직접 처리하므로 여기까지 오면 구독 중이 아닌 연결이다
+*/
+static int subscribe(proto_conn* pc, proto_req* req, pbuf* out){
+    int n = req->nlegs ? req->nlegs : stocks->count;
+    int* idx = Malloc((n ? n : 1) * sizeof(int));
+
+    for (int i = 0; i < n; i++){
+        idx[i] = req->nlegs ? stock_find(stocks, req->legs[i].id) : i;
+        if (idx[i] < 0){
+            free(idx);
+            reply_result(pc, out, PROTO_ST_BADID);
+            return PROTO_OK;
+        }
+    }
+    free(pc->sub_idx);
+    pc->sub_idx = idx;
+    pc->sub_n = n;
+    reply(pc, out, "[subscribe] success\n");
+    return PROTO_SUBSCRIBE;
+}
+
+static int execute(proto_conn* pc, proto_req* req, pbuf* out){
+    int first = (pc->nreq++ == 0);
+    int idx;
+
+    switch (req->op){
+    // hello - protocol version 협상 (연결 직후에만)
+    case PROTO_OP_HELLO:
+        if (!first)
+            break;
+        pc->version = req->count < PROTO_V1 ? PROTO_V1 : req->count > PROTO_BIN ? PROTO_BIN : req->count;
+        char msg[32];
+        snprintf(msg, sizeof(msg), "hello %d\n", pc->version);
+        pbuf_append(out, msg, strlen(msg));
+        return PROTO_OK;
+
+    // show - 전체 주식 목록 출력
+    case PROTO_OP_SHOW:
+        show(pc, out);
+        return PROTO_OK;
+
+    case PROTO_OP_BUY:
+        if ((idx = stock_find(stocks, req->id)) < 0)
+            reply_result(pc, out, PROTO_ST_BADID);
+        // 잔량이 충분할 때만 CAS로 차감
+        else if (!stock_buy(stocks, idx, req->count)){
+            stats_buy_fail();
+            reply_result(pc, out, PROTO_ST_NOSTOCK);
+        }
+        else{
+            feed_changed(idx);
+            if (pc->version == PROTO_BIN)
+                reply_status(out, PROTO_ST_OK);
+            else
+                reply(pc, out, "[buy] success\n");
+        }
+        return PROTO_OK;
+
+    case PROTO_OP_SELL:
+        if ((idx = stock_find(stocks, req->id)) < 0){
+            reply_result(pc, out, PROTO_ST_BADID);
+        } else if (!stock_sell(stocks, idx, req->count)){
+            reply_result(pc, out, PROTO_ST_FULL);
+        } else{
+            feed_changed(idx);
+            if (pc->version == PROTO_BIN)
+                reply_status(out, PROTO_ST_OK);
+            else
+                reply(pc, out, "[sell] success\n");
+        }
+        return PROTO_OK;
+
+    case PROTO_OP_ORDER:
+        order(pc, req, out);
+        return PROTO_OK;
+
+    case PROTO_OP_LIMIT:
+    case PROTO_OP_MARKET:
+    case PROTO_OP_CANCEL:
+    case PROTO_OP_BOOK:
+        if (pc->version == PROTO_BIN)
+            break;
+        if ((idx = stock_find(stocks, req->id)) < 0)
+            reply_result(pc, out, PROTO_ST_BADID);
+        else
+            book_request(pc, req, idx, out);
+        return PROTO_OK;
+
+    case PROTO_OP_SUBSCRIBE:
+        if (pc->version != PROTO_V2)
+            break;
+        return subscribe(pc, req, out);
+
+    case PROTO_OP_EXIT:
+        return PROTO_CLOSE;
+
+    case PROTO_OP_STATS:
+        if (pc->version == PROTO_BIN)
+            break;
+        stats(pc, out);
+        return PROTO_OK;
+
+    case PROTO_OP_BADARGS:
+        // v1은 빈 응답을 MAXLINE만큼 보내던 동작 유지
+        reply(pc, out, pc->version == PROTO_V1 ? "" : "Invalid command\n");
+        return PROTO_OK;
+    }
+
+    // 알 수 없는 요청: binary는 stream 동기가 깨졌으므로 연결 종료
+    if (pc->version == PROTO_BIN){
+        reply_status(out, PROTO_ST_BADREQ);
+        return PROTO_CLOSE;
+    }
+    if (pc->version == PROTO_V2)
+        reply(pc, out, "Invalid command\n");
+    return PROTO_OK;
+}
+
+// 파싱된 요청 하나 처리, 응답은 out 뒤에 붙인다
+int proto_execute(proto_conn* pc, proto_req* req, pbuf* out){
+    int ret;
+
+    stats_request(req->op);
+    if (!stats_sample())
+        return execute(pc, req, out);
+    uint64_t start = stats_now_ns();
+    ret = execute(pc, req, out);
+    stats_latency(stats_now_ns() - start);
+    return ret;
+}
+
+// text 요청 한 줄 처리
+int proto_handle_line(proto_conn* pc, char* buf, pbuf* out){
+    proto_req req;
+
+    proto_parse_text(buf, &req);
+    return proto_execute(pc, &req, out);
+}
@@ -0,0 +1,157 @@
+/*
+ * proto.h - stock server 요청 처리 & 응답 framing
+ *
+ * v1 (기존 client): 모든 응답을 MAXLINE byte로 채워서 보낸다.
+ * v2: 연결 직후 client가 "hello 2"를 보내면 서버가 "hello 2"로 답하고,
+ *     이후 응답은 정확한 길이로 보낸다.
+ *       - buy/sell 등 일반 응답: '\n'으로 끝나는 한 줄
+ *       - show: "ID 잔량 가격" 줄들 + 종료 표시 ".\n"
+ *       - exit 외의 모든 요청은 정확히 하나의 응답을 받는다.
+ * v3 (binary): "hello 3" -> "hello 3\n" 이후로는 양방향 모두 binary frame.
+ *       - 요청: opcode 1 byte + (buy/sell이면) varint ID, varint 수량
+ *               order는 varint leg 수 + leg마다 (buy/sell opcode 1 byte, varint ID, varint 수량)
+ *       - 응답: status 1 byte, show는 PROTO_ST_SNAPSHOT + varint 개수
+ *               + 종목마다 varint (ID, 잔량, 가격)
+ *       - varint는 uint32 LEB128 (7bit씩, 최대 5 byte), 음수는 uint32로 변환해서 보낸다
+ *       - 알 수 없는 opcode는 PROTO_ST_BADREQ 응답 후 연결 종료
+ *
+ * text/binary 모두 proto_req로 파싱한 뒤 같은 proto_execute()로 처리한다.
+ *
+ * order: "order buy 1 5 sell 3 2 ..." 처럼 여러 leg를 한 요청으로 보내면
+ *        모두 반영되거나 하나도 반영되지 않는다 (stock_order). 응답은 buy 하나와 같은 형식.
+ *
+ * 종목마다 limit order book이 있다 (book.h, text 전용).
+ *   limit buy|sell ID 가격 수량  -> "[limit] filled 체결수량 id 주문id" (남은 주문이 없으면 id 0)
+ *   market buy|sell ID 수량     -> "[market] filled 체결수량"
+ *   cancel ID 주문id            -> "[cancel] success" / "Invalid order ID"
+ *   book ID                     -> 최우선부터 "ask 가격 잔량", "bid 가격 잔량" 줄들 (show처럼 ".\n"으로 끝남)
+ *   체결이 있으면 종목의 가격을 마지막 체결가로 바꾼다. 잔량(left_stock)은 바뀌지 않는다.
+ *
+ * subscribe (v2 전용, feed.h):
+ *   subscribe [ID ...]   -> "[subscribe] success" 후 종목마다 현재 값 "ID 잔량 가격" 한 줄,
+ *                           이후 잔량이나 가격이 바뀔 때마다 같은 형식의 줄을 push (ID가 없으면 전체)
+ *   unsubscribe [ID ...] -> "[unsubscribe] success" (ID가 없으면 전체 해지)
+ *   subscribe 이후 연결은 feed thread가 맡고, 다른 요청도 그대로 처리한다.
+ *   push는 요청 응답 사이에 끼어들 수 있고, 느린 연결에는 종목마다 최신 값만 보낸다.
+ *
+ * show 응답(v2, binary)은 형식별로 한 번 직렬화해 두고 모든 연결이 참조 카운트로 공유한다.
+ * buy/sell로 값이 바뀐 뒤 처음 들어온 show가 다시 만든다.
+ * 응답 버퍼(pbuf)에는 복사하지 않고 위치만 기록해 두었다가 writev로 함께 보낸다.
+ */
+#ifndef __PROTO_H__
+#define __PROTO_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include "stock.h"
+
+#define PROTO_V1 1
+#define PROTO_V2 2
+#define PROTO_BIN 3
+#define PROTO_END ".\n" // v2 show 종료 표시
+
+#define PROTO_OK 0
+#define PROTO_CLOSE 1 // exit 요청
+#define PROTO_SUBSCRIBE 2 // subscribe 요청, 호출한 쪽이 연결을 feed_attach로 넘긴다
+
+// 요청 종류, SHOW~EXIT는 binary opcode 값과 같다
+#define PROTO_OP_SHOW 1
+#define PROTO_OP_BUY 2
+#define PROTO_OP_SELL 3
+#define PROTO_OP_EXIT 4
+#define PROTO_OP_HELLO 5 // text 전용
+#define PROTO_OP_BADARGS 6 // buy/sell 인자 오류 (text)
+#define PROTO_OP_UNKNOWN 7 // 빈 줄, 알 수 없는 명령
+#define PROTO_OP_STATS 8 // text 전용, 응답 형식은 show와 같다 (v2는 ".\n"으로 끝남)
+#define PROTO_OP_ORDER 9
+#define PROTO_OP_LIMIT 10 // 10~13은 text 전용
+#define PROTO_OP_MARKET 11
+#define PROTO_OP_CANCEL 12
+#define PROTO_OP_BOOK 13
+#define PROTO_OP_SUBSCRIBE 14 // 14~15는 v2 전용
+#define PROTO_OP_UNSUBSCRIBE 15
+
+#define PROTO_BOOK_DEPTH 10 // book 응답에 보여주는 side 당 level 수
+
+// binary 응답 status
+#define PROTO_ST_OK 0
+#define PROTO_ST_NOSTOCK 1 // 잔량 부족
+#define PROTO_ST_BADID 2
+#define PROTO_ST_BADREQ 3
+#define PROTO_ST_FULL 4 // sell/order 후 잔량이 int32 범위를 넘음
+#define PROTO_ST_SNAPSHOT 16
+
+#define PROTO_ORDER_MAX STOCK_ORDER_MAX
+#define PROTO_BIN_MAXREQ (6 + PROTO_ORDER_MAX * 11) // order: opcode + varint + leg마다 (opcode + varint 2개)
+#define PROTO_IOV_MAX 64 // writev 한 번에 넘기는 최대 구간 수
+
+// 직렬화된 show 응답
+typedef struct {
+    int refcnt;
+    size_t len;
+    char data[];
+} proto_snap;
+
+// 응답 버퍼의 pos 위치에 snap 전체가 들어간다
+typedef struct {
+    size_t pos;
+    proto_snap* snap;
+} pbuf_ref;
+
+// 응답을 모아두는 가변 버퍼
+typedef struct {
+    char* data;
+    size_t len;
+    size_t cap;
+    pbuf_ref* refs;
+    int nrefs;
+    int ref_cap;
+    size_t total; // 보낼 전체 byte 수 (data + snapshot)
+} pbuf;
+
+// 연결 별 protocol 상태
+typedef struct {
+    int version;
+    int nreq; // 지금까지 처리한 요청 수 (hello는 첫 요청일 때만 유효)
+    int* sub_idx; // PROTO_SUBSCRIBE를 반환한 요청의 종목 idx들 (feed가 가져간다)
+    int sub_n;
+} proto_conn;
+
+// order의 leg 하나
+typedef struct {
+    int op; // PROTO_OP_BUY / PROTO_OP_SELL
+    int id;
+    int count;
+} proto_leg;
+
+// 파싱된 요청
+typedef struct {
+    int op;
+    int id;
+    int count; // hello면 요청한 version
+    int side; // limit/market: BOOK_BUY / BOOK_SELL
+    int price; // limit
+    uint64_t oid; // cancel
+    int nlegs; // order, subscribe/unsubscribe는 legs[].id만 쓴다
+    proto_leg legs[PROTO_ORDER_MAX];
+} proto_req;
+
+void pbuf_init(pbuf*);
+void pbuf_free(pbuf*);
+void pbuf_reset(pbuf*);
+void pbuf_append(pbuf*, const void*, size_t);
+void pbuf_append_snap(pbuf*, proto_snap*);
+void proto_snap_put(proto_snap*);
+int pbuf_iov(pbuf*, size_t, struct iovec*, int);
+void pbuf_put_varint(pbuf*, uint32_t);
+int proto_get_varint(const unsigned char*, size_t, uint32_t*);
+
+void proto_init(stock_table*);
+void proto_conn_init(proto_conn*);
+void proto_parse_text(char*, proto_req*);
+int proto_parse_bin(const char*, size_t, proto_req*);
+int proto_execute(proto_conn*, proto_req*, pbuf*);
+int proto_handle_line(proto_conn*, char*, pbuf*);
+
+#endif /* __PROTO_H__ */
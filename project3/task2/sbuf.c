@@ -0,0 +1,167 @@
+/*
+ * sbuf.c - bounded MPMC lock-free queue (Vyukov sequence number 방식) + futex parking
+ */
+#include "csapp.h"
+#include "sbuf.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <time.h>
+
+// timeout이 NULL이면 무한 대기
+static void futex_wait(uint32_t* addr, uint32_t val, const struct timespec* timeout){
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, timeout, NULL, 0);
+}
+
+static void futex_wake(uint32_t* addr){
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// capacity는 n 이상의 2의 거듭제곱으로 올림
+void sbuf_init(sbuf_t *sp, int n){
+    size_t cap = 2;
+
+    while (cap < (size_t)n)
+        cap <<= 1;
+    memset(sp, 0, sizeof(*sp));
+    sp->buf = Malloc(cap * sizeof(sbuf_cell));
+    sp->mask = cap - 1;
+    for (size_t i = 0; i < cap; i++)
+        sp->buf[i].seq = i;
+}
+
+void sbuf_deinit(sbuf_t *sp){
+    Free(sp->buf);
+}
+
+// 가득 찼으면 0
+int sbuf_try_insert(sbuf_t *sp, uint64_t item){
+    size_t pos = __atomic_load_n(&sp->enq_pos, __ATOMIC_RELAXED);
+    sbuf_cell* cell;
+
+    while (1){
+        cell = &sp->buf[pos & sp->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+        if (diff == 0){
+            // 빈 slot: 위치를 CAS로 차지
+            if (__atomic_compare_exchange_n(&sp->enq_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0){
+            return 0; // 한 바퀴 전 데이터가 아직 소비되지 않음
+        } else{
+            pos = __atomic_load_n(&sp->enq_pos, __ATOMIC_RELAXED);
+        }
+    }
+    cell->data = item;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&sp->items_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sp->consumers_waiting, __ATOMIC_SEQ_CST))
+        futex_wake(&sp->items_seq);
+    return 1;
+}
+
+// 비었으면 0
+int sbuf_try_remove(sbuf_t *sp, uint64_t *item){
+    size_t pos = __atomic_load_n(&sp->deq_pos, __ATOMIC_RELAXED);
+    sbuf_cell* cell;
+
+    while (1){
+        cell = &sp->buf[pos & sp->mask];
+        size_t seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+        if (diff == 0){
+            if (__atomic_compare_exchange_n(&sp->deq_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (diff < 0){
+            return 0;
+        } else{
+            pos = __atomic_load_n(&sp->deq_pos, __ATOMIC_RELAXED);
+        }
+    }
+    *item = cell->data;
+    // 다음 바퀴의 producer가 쓸 수 있도록 seq를 capacity만큼 전진
+    __atomic_store_n(&cell->seq, pos + sp->mask + 1, __ATOMIC_RELEASE);
+
+    __atomic_add_fetch(&sp->slots_seq, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sp->producers_waiting, __ATOMIC_SEQ_CST))
+        futex_wake(&sp->slots_seq);
+    return 1;
+}
+
+/*
+가득 차 있으면 빈 slot이 생길 때까지 대기
+waiting 증가 -> 재시도 -> futex_wait 순서라서, 그 사이에 생긴 slot은
+slots_seq 값이 바뀌어 futex_wait가 바로 반환되므로 wakeup을 놓치지 않는다
+*/
+void sbuf_insert(sbuf_t *sp, uint64_t item){
+    for (int i = 0; i < SBUF_SPIN; i++){
+        if (sbuf_try_insert(sp, item))
+            return;
+    }
+    while (1){
+        uint32_t seq = __atomic_load_n(&sp->slots_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&sp->producers_waiting, 1, __ATOMIC_SEQ_CST);
+        if (sbuf_try_insert(sp, item)){
+            __atomic_sub_fetch(&sp->producers_waiting, 1, __ATOMIC_SEQ_CST);
+            return;
+        }
+        futex_wait(&sp->slots_seq, seq, NULL);
+        __atomic_sub_fetch(&sp->producers_waiting, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+// 비어 있으면 데이터가 들어올 때까지 대기
+uint64_t sbuf_remove(sbuf_t *sp){
+    uint64_t item;
+
+    sbuf_remove_timed(sp, &item, -1);
+    return item;
+}
+
+/*
+sbuf_remove와 같지만 timeout_ms가 지나도록 비어 있으면 0 (음수면 무한 대기)
+idle worker가 스스로 종료할 때 쓴다
+*/
+int sbuf_remove_timed(sbuf_t *sp, uint64_t *item, long timeout_ms){
+    struct timespec now, left;
+    long long deadline = 0;
+
+    for (int i = 0; i < SBUF_SPIN; i++){
+        if (sbuf_try_remove(sp, item))
+            return 1;
+    }
+    if (timeout_ms >= 0){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline = now.tv_sec * 1000000000ll + now.tv_nsec + timeout_ms * 1000000ll;
+    }
+    while (1){
+        uint32_t seq = __atomic_load_n(&sp->items_seq, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&sp->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+        if (sbuf_try_remove(sp, item)){
+            __atomic_sub_fetch(&sp->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+            return 1;
+        }
+        if (timeout_ms >= 0){
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            long long ns = deadline - (now.tv_sec * 1000000000ll + now.tv_nsec);
+            if (ns <= 0){
+                __atomic_sub_fetch(&sp->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+                return 0;
+            }
+            left.tv_sec = ns / 1000000000ll;
+            left.tv_nsec = ns % 1000000000ll;
+        }
+        futex_wait(&sp->items_seq, seq, timeout_ms >= 0 ? &left : NULL);
+        __atomic_sub_fetch(&sp->consumers_waiting, 1, __ATOMIC_SEQ_CST);
+    }
+}
+
+// 대략적인 큐 길이 (동시에 변하는 값이므로 통계용)
+size_t sbuf_size(sbuf_t *sp){
+    size_t deq = __atomic_load_n(&sp->deq_pos, __ATOMIC_RELAXED);
+    size_t enq = __atomic_load_n(&sp->enq_pos, __ATOMIC_RELAXED);
+    return enq > deq ? enq - deq : 0;
+}
@@ -0,0 +1,46 @@
+/*
+ * sbuf.h - bounded MPMC lock-free queue (Vyukov sequence number 방식)
+ *
+ * 각 slot은 sequence 번호를 가지고, producer/consumer는 자신의 위치(pos)와
+ * slot의 seq를 비교해 CAS 한 번으로 slot을 차지한다. 빠른 경로에는 syscall이 없다.
+ * 큐가 비었거나 가득 찬 경우에만 futex로 thread를 재운다.
+ */
+#ifndef __SBUF_H__
+#define __SBUF_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define SBUF_CACHELINE 64
+#define SBUF_SPIN 64 // futex로 잠들기 전 재시도 횟수
+
+typedef struct {
+    size_t seq;
+    uint64_t data;
+} sbuf_cell;
+
+typedef struct {
+    sbuf_cell* buf;
+    size_t mask; // capacity - 1 (capacity는 2의 거듭제곱)
+    char pad0[SBUF_CACHELINE];
+    size_t enq_pos;
+    char pad1[SBUF_CACHELINE];
+    size_t deq_pos;
+    char pad2[SBUF_CACHELINE];
+    uint32_t items_seq; // enqueue 때마다 증가, 빈 큐에서 기다리는 consumer의 futex word
+    uint32_t consumers_waiting;
+    char pad3[SBUF_CACHELINE];
+    uint32_t slots_seq; // dequeue 때마다 증가, 가득 찬 큐에서 기다리는 producer의 futex word
+    uint32_t producers_waiting;
+} sbuf_t;
+
+void sbuf_init(sbuf_t* sp, int n);
+void sbuf_deinit(sbuf_t* sp);
+int sbuf_try_insert(sbuf_t* sp, uint64_t item);
+int sbuf_try_remove(sbuf_t* sp, uint64_t* item);
+void sbuf_insert(sbuf_t* sp, uint64_t item);
+uint64_t sbuf_remove(sbuf_t* sp);
+int sbuf_remove_timed(sbuf_t* sp, uint64_t* item, long timeout_ms);
+size_t sbuf_size(sbuf_t* sp);
+
+#endif /* __SBUF_H__ */
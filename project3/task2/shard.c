@@ -0,0 +1,104 @@
+/*
+ * shard.c - shard 전담 thread와 buy/sell 전달
+ */
+#include "csapp.h"
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include "shard.h"
+#include "sbuf.h"
+
+static stock_table* stocks;
+static int nshards; // 0이면 shard 없이 worker가 직접 처리
+static sbuf_t queues[SHARD_MAX];
+
+static void futex_wait(uint32_t* addr, uint32_t val){
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(uint32_t* addr){
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+int shard_of(int idx){
+    size_t off = (char*)&stocks->recs[idx] - stocks->map; // 파일에서 레코드의 offset
+
+    return (off / SHARD_LINE) % nshards;
+}
+
+/*
+허용된 CPU 중 i번째 (CPU보다 shard가 많으면 돌아가며)에 고정
+cpu_set_t 매크로는 _GNU_SOURCE가 필요한데 csapp.h와 충돌하므로 syscall에 bit 배열을 직접 넘긴다
+*/
+static void pin_self(int i){
+    unsigned long allowed[SHARD_CPU_WORDS] = {0}, one[SHARD_CPU_WORDS] = {0};
+    const int bits = 8 * sizeof(unsigned long);
+    int n = 0;
+
+    if (syscall(SYS_sched_getaffinity, 0, sizeof(allowed), allowed) < 0)
+        return;
+    for (int cpu = 0; cpu < SHARD_CPU_WORDS * bits; cpu++)
+        n += (allowed[cpu / bits] >> (cpu % bits)) & 1;
+    if (n == 0)
+        return;
+    i %= n;
+    for (int cpu = 0; cpu < SHARD_CPU_WORDS * bits; cpu++){
+        if (((allowed[cpu / bits] >> (cpu % bits)) & 1) && i-- == 0){
+            one[cpu / bits] = 1ul << (cpu % bits);
+            syscall(SYS_sched_setaffinity, 0, sizeof(one), one); // 0은 호출한 thread
+            return;
+        }
+    }
+}
+
+static void *shard_thread(void *vargp){
+    int i = (int)(long)vargp;
+
+    Pthread_detach(pthread_self());
+    pin_self(i);
+    while (1){
+        shard_req* r = (shard_req*)(uintptr_t)sbuf_remove(&queues[i]);
+
+        r->ret = proto_execute(r->pc, r->req, r->out);
+        // 이후로 r은 worker가 반환해 버릴 수 있다 (wake는 주소만 쓰므로 괜찮다)
+        if (__atomic_exchange_n(&r->done, SHARD_DONE, __ATOMIC_ACQ_REL) == SHARD_SLEEPING)
+            futex_wake(&r->done);
+    }
+    return NULL;
+}
+
+// n개의 shard thread 시작 (proto_init 이후, n이 0이면 아무것도 하지 않는다)
+void shard_init(stock_table* t, int n){
+    pthread_t tid;
+
+    stocks = t;
+    nshards = n;
+    for (long i = 0; i < n; i++){
+        sbuf_init(&queues[i], SHARD_QUEUE);
+        Pthread_create(&tid, NULL, shard_thread, (void*)i);
+    }
+}
+
+/*
+proto_execute 대신 호출: 있는 종목의 buy/sell이면 shard thread가 처리하고 끝날 때까지 기다린다
+잠깐 기다려 보고, 그래도 안 끝났으면 futex로 잠든다
+*/
+int shard_execute(proto_conn* pc, proto_req* req, pbuf* out){
+    shard_req r = {pc, req, out, PROTO_OK, SHARD_PENDING};
+    uint32_t pending = SHARD_PENDING;
+    int idx;
+
+    if (nshards == 0 || (req->op != PROTO_OP_BUY && req->op != PROTO_OP_SELL)
+        || (idx = stock_find(stocks, req->id)) < 0)
+        return proto_execute(pc, req, out);
+
+    sbuf_insert(&queues[shard_of(idx)], (uint64_t)(uintptr_t)&r);
+    for (int i = 0; i < SHARD_SPIN; i++){
+        if (__atomic_load_n(&r.done, __ATOMIC_ACQUIRE) == SHARD_DONE)
+            return r.ret;
+    }
+    if (__atomic_compare_exchange_n(&r.done, &pending, SHARD_SLEEPING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+        while (__atomic_load_n(&r.done, __ATOMIC_ACQUIRE) != SHARD_DONE)
+            futex_wait(&r.done, SHARD_SLEEPING);
+    }
+    return r.ret;
+}
@@ -0,0 +1,47 @@
+/*
+ * shard.h - 종목을 shard로 나눠 shard마다 전담 thread가 buy/sell 처리 (--shards N)
+ *
+ * 종목은 레코드가 들어 있는 cache line 단위로 돌아가며 shard에 배정된다:
+ *   shard = ((recs_off + idx * sizeof(Item)) / 64) % N
+ * (map은 page 정렬이므로 파일 offset의 64 byte 구간이 곧 cache line이다. recs_off는 8 byte 정렬뿐이라
+ *  idx / 8로 나누면 한 line이 두 shard에 걸친다)
+ * 한 cache line의 종목은 모두 같은 shard이므로 shard thread끼리 line을 주고받지 않고,
+ * 인기 종목이 모인 구간도 여러 shard로 흩어진다.
+ * shard thread는 CPU 하나에 고정되어 자기 종목의 line을 자기 cache에 계속 둔다.
+ *
+ * worker는 buy/sell 요청을 그 종목 shard의 큐(sbuf)에 넣고 끝날 때까지 기다린다.
+ * 큐에는 worker 스택의 shard_req 주소가 들어가고, 응답은 shard thread가 worker의 pbuf에 바로 쓴다.
+ * show/order/book 등 나머지 요청은 지금처럼 worker가 처리한다.
+ * shard thread도 CAS로 쓰므로 (경합이 없어 한 번에 성공) order의 lock bit와 섞여도 안전하다.
+ */
+#ifndef __SHARD_H__
+#define __SHARD_H__
+
+#include <stdint.h>
+#include "stock.h"
+#include "proto.h"
+
+#define SHARD_MAX 64 // --shards 최대값
+#define SHARD_QUEUE 1024 // shard 큐 크기, 가득 차면 worker가 기다린다
+#define SHARD_LINE 64 // cache line 크기 (byte)
+#define SHARD_SPIN 256 // futex로 잠들기 전 완료를 확인하는 횟수
+#define SHARD_CPU_WORDS 16 // affinity mask 크기 (unsigned long 16개 = CPU 1024개)
+
+// shard_req.done
+#define SHARD_PENDING 0
+#define SHARD_DONE 1
+#define SHARD_SLEEPING 2 // worker가 futex로 잠듦, 끝나면 깨워야 한다
+
+typedef struct {
+    proto_conn* pc;
+    proto_req* req;
+    pbuf* out;
+    int ret;
+    uint32_t done;
+} shard_req;
+
+void shard_init(stock_table*, int);
+int shard_of(int);
+int shard_execute(proto_conn*, proto_req*, pbuf*);
+
+#endif /* __SHARD_H__ */
@@ -0,0 +1,123 @@
+/*
+ * stock.h - mmap 기반 주식 테이블 + write-ahead log
+ *
+ * stock.db 파일 구조 (모든 필드 little-endian, 고정 폭)
+ *   [stock_db_hdr][int32 ids[count]][padding][Item recs[count]]
+ * ids[]는 오름차순으로 정렬되어 있고, recs[i]가 ids[i]에 대응한다.
+ * 서버는 시작 시 파일을 그대로 mmap 하므로 종목 수와 무관하게 O(1)로 로드된다.
+ *
+ * 영속성
+ *   stock.db는 스냅샷이며 실행 중에는 절대 덮어쓰지 않는다 (MAP_PRIVATE).
+ *   buy/sell은 잔량 변화량(delta)만 <db>.wal.<gen> 세그먼트에 append 한다.
+ *   백그라운드 thread가 주기적으로 세그먼트를 fdatasync 하고, 세그먼트가 충분히 커지면
+ *   새 세그먼트로 교체한 뒤 (이전 스냅샷 + 닫힌 세그먼트)로 새 스냅샷을 만들어 rename 한다.
+ *   시작 시에는 스냅샷의 wal_gen 이후 세그먼트를 순서대로 replay 한다.
+ *   order(여러 종목 일괄 처리)는 leg 수를 담은 header 레코드와 leg 레코드들을 write 한 번으로
+ *   붙이고, replay는 header 뒤의 leg가 모두 온전할 때만 반영한다 (전부 아니면 전무).
+ *
+ * order 동안에는 각 레코드의 STOCK_LOCKED bit를 ID 순서로 잡는다.
+ * 순서가 같으므로 order끼리 deadlock이 없고, buy/sell/show는 bit가 풀릴 때까지 기다린다.
+ */
+#ifndef __STOCK_H__
+#define __STOCK_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#define STOCK_DB_MAGIC 0x42445453 /* "STDB" */
+#define STOCK_DB_VERSION 1
+#define STOCK_WAL_MAGIC 0x4c415753 /* "SWAL" */
+#define STOCK_WAL_BATCH_MAGIC 0x48425753 /* "SWBH" */
+#define STOCK_WAL_PRICE_MAGIC 0x52505753 /* "SWPR" */
+#define STOCK_ORDER_MAX 128 // order 한 번의 최대 leg 수
+#define STOCK_SYNC_MS 1000 // WAL fdatasync 주기
+#define STOCK_COMPACT_BYTES (1 << 20) // 세그먼트가 이 크기를 넘으면 스냅샷으로 compaction
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t count;
+    uint64_t ids_off;  // 파일 시작부터 ids[]까지의 offset
+    uint64_t recs_off; // 파일 시작부터 recs[]까지의 offset (8 byte 정렬)
+    uint64_t wal_gen;  // 이 스냅샷에 반영된 마지막 WAL 세그먼트 번호
+    uint64_t reserved[3];
+} stock_db_hdr;
+
+/*
+고정 폭 레코드, ID는 ids[]에 따로 저장
+두 필드는 8 byte 정렬된 하나의 word이므로 lock 없이 통째로 읽고 CAS 한다
+*/
+typedef union item{
+    struct {
+        int32_t left_stock;
+        int32_t price;
+    };
+    uint64_t word;
+} Item;
+
+#define STOCK_LOCKED (1ull << 63) // order가 잡고 있는 레코드 (price의 부호 bit, price는 음수가 아니다)
+
+// import 시 사용하는 (ID, 잔량, 가격) 묶음
+typedef struct {
+    int32_t ID;
+    int32_t left_stock;
+    int32_t price;
+} stock_entry;
+
+// WAL 레코드, check가 맞지 않거나 잘린 레코드는 replay 하지 않는다
+// order의 header는 ID에 leg 수, delta는 0, check는 STOCK_WAL_BATCH_MAGIC 기준
+// 가격 변경(체결가)은 delta에 새 가격, check는 STOCK_WAL_PRICE_MAGIC 기준
+typedef struct {
+    int32_t ID;
+    int32_t delta;
+    uint32_t check;
+} stock_wal_rec;
+
+// order의 leg 하나 (idx는 stock_find 결과, buy는 음수)
+typedef struct {
+    int idx;
+    int delta;
+} stock_leg;
+
+typedef struct {
+    char* map;
+    size_t maplen;
+    int count;
+    int32_t* ids;
+    Item* recs;
+
+    char db[256];
+    uint64_t snap_gen; // 현재 stock.db에 반영된 세그먼트 번호
+    uint64_t wal_gen;  // append 중인 세그먼트 번호
+    int wal_fd;
+    off_t wal_size;
+    int wal_dirty;
+    pthread_rwlock_t wal_lock; // append(read) / 세그먼트 교체(write)
+    pthread_mutex_t compact_mutex;
+    pthread_mutex_t price_mutex; // 가격 변경의 CAS와 WAL append 순서를 맞춘다
+    pthread_t tid;
+    uint32_t show_dirty; // 변경 후 아직 다시 만들지 않은 show 캐시 (형식별 bit)
+} stock_table;
+
+int stock_create(const char*, stock_entry*, int);
+int stock_import_text(const char*, const char*);
+int stock_export_text(stock_table*, const char*);
+
+int stock_open(stock_table*, const char*);
+int stock_load(stock_table*, const char*, const char*);
+void stock_start_sync(stock_table*);
+void stock_log(stock_table*, int, int);
+int stock_flush(stock_table*);
+int stock_compact(stock_table*);
+void stock_close(stock_table*);
+int stock_find(stock_table*, int);
+Item stock_get(stock_table*, int);
+int stock_buy(stock_table*, int, int);
+int stock_sell(stock_table*, int, int);
+int stock_order(stock_table*, stock_leg*, int);
+void stock_set_price(stock_table*, int, int);
+int stock_take_dirty(stock_table*, uint32_t);
+
+#endif /* __STOCK_H__ */
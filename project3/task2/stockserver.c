@@ -4,377 +4,707 @@
 /* $begin echoserverimain */
 #include "csapp.h"
 #include <semaphore.h>
-#define MAX_STOCKS 1000
-#define NTHREADS 4 // 서버 시작 시 미리 생성되는 thread 수
-#define SBUFSIZE 100 // 공유 버퍼의 최대 크기, 최대로 연결할 수 있는 client 수
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include "stock.h"
+#include "sbuf.h"
+#include "proto.h"
+#include "stats.h"
+#include "log.h"
+#include "feed.h"
+#include "shard.h"
+#include "timer.h"
+#define MIN_THREADS 4 // 항상 유지하는 worker 수 (--min-threads)
+#define MAX_THREADS 128 // worker 수 상한 (--max-threads)
+#define IDLE_MS 10000 // 이만큼 연결을 받지 못한 worker는 종료, min 초과분만 (--idle-ms)
+#define SPAWN_WAIT_MS 5 // 큐에서 이보다 오래 기다린 연결이 있으면 worker 추가 (--spawn-wait-ms)
+#define SBUFSIZE 1024 // 공유 버퍼의 기본 크기 (--queue), 대기할 수 있는 최대 연결 수
+#define PIPE_FLUSH_BYTES 65536 // pipelining 중 모인 응답이 이보다 크면 바로 전송
+#define LINGER_MS 5 // 입력이 끊긴 연결을 worker가 직접 기다려 보는 시간, 지나면 poller로 (--linger-ms)
+#define IDLE_TIMEOUT_MS 300000 // 요청 없이 이만큼 지나면 연결 종료 (--idle-timeout-ms)
+#define READ_TIMEOUT_MS 10000 // 시작된 요청(줄/frame)은 이 안에 끝까지 와야 한다 (--read-timeout-ms)
+#define WRITE_TIMEOUT_MS 30000 // 응답이 밀린 채 이만큼 전혀 보내지지 않으면 종료 (--write-timeout-ms)
+#define FD_RESERVE 64 // --max-conns 기본값 = fd limit - 이 값 (db, WAL, epoll 등)
+#define MAX_FDS (1 << 20) // 연결 table 크기 (fd 번호로 찾는다), fd limit도 여기까지만 올린다
+#define POLL_MAXEVENTS 1024 // poller의 epoll_wait 한 번에 받는 최대 event 수
 /*
-트리 자료구조
+주식 테이블
 */
-typedef struct item{
-    int ID;
-    int left_stock;
-    int price;
-    int readcnt;
-    sem_t mutex; // readcnt 보호
-    sem_t w; // writer 보호
-} Item;
-
-typedef struct TreeNode {
-    Item data;
-    struct TreeNode* left;
-    struct TreeNode* right;
-} TreeNode;
-
-Item create_item(int, int, int);
-TreeNode* insert(TreeNode*, TreeNode*);
-void free_tree(TreeNode*);
-TreeNode* search(TreeNode*, int);
-TreeNode* load_stock_file(const char*);
+void load_stock_file(const char*);
 void save_stock(char*);
 
+void *signal_thread(void *vargp);
+
+/*
+연결 상태: worker가 처리하는 동안에도, poller에서 기다리는 동안에도 이 struct가 들고 있다
+입력이 끊기면 worker는 연결을 poller에 맡기고 (park) 다음 연결로 가므로
+idle 연결은 thread 없이 이 struct만 차지한다 (읽다 만 입력이 없으면 rio 버퍼도 반환).
+*/
+typedef struct conn conn_t;
+struct conn {
+    int fd;
+    proto_conn pc;
+    rio_t* rio; // 아직 처리하지 않은 입력
+    pbuf out; // 아직 보내지 못한 응답
+    size_t out_off;
+    int closing; // exit 요청 또는 EOF, 남은 응답을 보낸 뒤 종료
+    int eof; // 남은 입력만 처리하고 종료
+    int events; // park 할 때 기다리는 event (EPOLLIN / EPOLLOUT)
+    int registered; // poller epoll에 등록됨
+    int in_nreq; // in_since를 정했을 때의 pc.nreq (그 뒤 요청이 끝났으면 새 요청)
+    uint64_t in_since; // 읽다 만 요청이 처음 보인 시각 (ms)
+    uint64_t deadline; // ms
+    timer_node timer; // poller 전용
+    conn_t* next; // park 대기열
+};
+
 /*
-shared buffer 자료구조
+연결 제한
+max_conns를 넘거나 큐가 가득 찬 (worker를 max까지 늘렸는데도 밀린) 연결은
+받자마자 (poller에서 깨어난 연결이면 그때) "Server busy"를 보내고 닫는다
+(accept thread와 poller가 큐에서 막혀 있지 않는다)
 */
-typedef struct{
-    int* buf;
-    int n;
-    int front;
-    int rear;
-    sem_t mutex;
-    sem_t slots;
-    sem_t items;
-} sbuf_t;
-
-void sbuf_init(sbuf_t* sp, int n);
-void sbuf_deinit(sbuf_t* sp);
-void sbuf_insert(sbuf_t* sp, int item);
-int sbuf_remove(sbuf_t* sp);
-
-void sigint_handler(int signo);
-int handle_stock_command(int , char* , char*);
+static struct {
+    int max_conns; // 0이면 fd limit에서 정한다
+    int linger_ms;
+    long idle_ms, read_ms, write_ms;
+    int conns; // 열린 연결 수 (feed로 넘어간 연결은 빠진다)
+    int parked, timeouts, shed; // stats gauge
+} limits = {0, LINGER_MS, IDLE_TIMEOUT_MS, READ_TIMEOUT_MS, WRITE_TIMEOUT_MS};
+
+/*
+poller: 입력이나 보낼 자리를 기다리는 연결들을 epoll 하나로 지켜보는 thread
+준비된 연결은 다시 큐에 넣어 worker가 이어서 처리하고, deadline이 지난 연결은 닫는다.
+worker는 mutex 아래 대기열에 넣고 eventfd로 깨우기만 하며 (feed_attach와 같은 방식)
+epoll 등록과 timer는 poller thread만 건드린다.
+*/
+static struct {
+    int epfd, evfd;
+    int signaled; // eventfd에 이미 썼음
+    pthread_mutex_t mutex;
+    conn_t* park; // worker가 맡긴 연결 (mutex)
+    timer_wheel wheel;
+    conn_t** conns; // fd -> 연결 상태, 연결을 가진 쪽 (worker 또는 poller)만 쓴다
+    int nfds;
+} poller = {.mutex = PTHREAD_MUTEX_INITIALIZER};
 
 /*
 global variables
 */
-int stock_count = 0;
 sbuf_t sbuf;
-TreeNode* stock_root;
-TreeNode* stock_array[MAX_STOCKS];
+stock_table stocks;
+
+static int start_level = LOG_INFO; // --verbose면 요청마다 DEBUG 로그까지
 
-static int active_clients = 0;
-static sem_t client_count_mutex;
+/*
+worker pool
+worker는 처리할 입력이 있는 동안 연결 하나를 맡는다 (입력이 끊기면 poller로). 큐에 쌓인 연결이
+쉬고 있는 worker보다 많아지면 max까지 늘리고 오래 쉰 worker는 min까지 줄인다.
+큐에는 connfd와 넣은 시각(us, 하위 32bit)을 같이 넣어 기다린 시간을 잰다.
+*/
+static struct {
+    int min, max;
+    long idle_ms, spawn_wait_ms;
+    int workers; // 살아 있는 worker
+    int idle; // 큐에서 연결을 기다리는 worker
+    int queued; // 큐에서 worker를 기다리는 연결
+} pool = {MIN_THREADS, MAX_THREADS, IDLE_MS, SPAWN_WAIT_MS};
 /*
 thread functions
 */
 void *thread(void *vargp);
-void echo_cnt(int connfd);
-static void init_echo_cnt(void);
+int echo_cnt(conn_t* c);
+void raise_fd_limit(void);
+void poller_start(void);
+void *poller_thread(void *vargp);
+int dispatch(int connfd);
+void reject_client(int connfd);
+conn_t* conn_get(int connfd);
+void conn_close(conn_t* c);
+void conn_shed(conn_t* c);
+int park(conn_t* c, int events);
 void increment_client_count(void);
 void decrement_client_count(void);
 
-static int byte_cnt;
-static sem_t mutex_byte_cnt;
 
 void echo(int connfd);
 
+static void usage(char* prog){
+    fprintf(stderr, "usage: %s <port> [--queue N] [--min-threads N] [--max-threads N]\n"
+                    "\t[--idle-ms MS] [--spawn-wait-ms MS] [--shards N] [--max-conns N] [--linger-ms MS]\n"
+                    "\t[--idle-timeout-ms MS] [--read-timeout-ms MS] [--write-timeout-ms MS] [--verbose]\n", prog);
+    exit(0);
+}
+
+static uint32_t now_us(void){
+    return (uint32_t)(stats_now_ns() / 1000);
+}
+
+// max를 넘지 않으면 worker 하나 추가 (새 worker는 idle로 센다)
+static int pool_spawn(void){
+    int n = __atomic_load_n(&pool.workers, __ATOMIC_RELAXED);
+    pthread_t tid;
+
+    do {
+        if (n >= pool.max)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&pool.workers, &n, n + 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    __atomic_add_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+    Pthread_create(&tid, NULL, thread, NULL);
+    log_debug("worker spawned (%d)", n + 1);
+    return 1;
+}
+
+/*
+min보다 많으면 idle worker 하나를 줄인다, 종료해도 되면 1
+acceptor는 queued를 올린 뒤 idle을 보고, 여기서는 idle을 내린 뒤 queued를 보므로
+그 사이에 들어온 연결은 둘 중 한 쪽이 반드시 알아챈다
+*/
+static int pool_retire(void){
+    int n = __atomic_load_n(&pool.workers, __ATOMIC_RELAXED);
+
+    do {
+        if (n <= pool.min)
+            return 0;
+    } while (!__atomic_compare_exchange_n(&pool.workers, &n, n - 1, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    __atomic_sub_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&pool.queued, __ATOMIC_SEQ_CST) > 0){
+        __atomic_add_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+        __atomic_add_fetch(&pool.workers, 1, __ATOMIC_SEQ_CST);
+        return 0;
+    }
+    log_debug("worker retired (%d)", n - 1);
+    return 1;
+}
+
 int main(int argc, char **argv) 
 {
-    Signal(SIGINT, sigint_handler);
-    stock_root = load_stock_file("stock.txt");
-
-    int i, listenfd, connfd;
+    int i, opt, listenfd, connfd;
+    int queue_size = SBUFSIZE;
+    int nshards = 0; // 0이면 worker가 buy/sell도 직접 처리 (공유 테이블)
+    static struct option options[] = {
+        {"queue", required_argument, NULL, 'q'},
+        {"min-threads", required_argument, NULL, 'm'},
+        {"max-threads", required_argument, NULL, 'M'},
+        {"idle-ms", required_argument, NULL, 'i'},
+        {"spawn-wait-ms", required_argument, NULL, 'w'},
+        {"shards", required_argument, NULL, 's'},
+        {"max-conns", required_argument, NULL, 'c'},
+        {"linger-ms", required_argument, NULL, 'l'},
+        {"idle-timeout-ms", required_argument, NULL, 'I'},
+        {"read-timeout-ms", required_argument, NULL, 'r'},
+        {"write-timeout-ms", required_argument, NULL, 'W'},
+        {"verbose", no_argument, NULL, 'v'},
+        {NULL, 0, NULL, 0}
+    };
     socklen_t clientlen;
     struct sockaddr_storage clientaddr;  /* Enough space for any address */  //line:netp:echoserveri:sockaddrstorage
     pthread_t tid;
+    sigset_t mask;
+
+    // SIGINT는 signal_thread에서만 sigwait로 받는다 (모든 thread가 mask 상속)
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGINT);
+    Sigprocmask(SIG_BLOCK, &mask, NULL);
+    Signal(SIGPIPE, SIG_IGN); // 끊긴 연결에 쓰면 process 종료 대신 write 에러
+    load_stock_file("stock.txt");
     
     char client_hostname[MAXLINE], client_port[MAXLINE];
 
-    if (argc != 2) {
-	    fprintf(stderr, "usage: %s <port>\n", argv[0]);
-	    exit(0);
-    } // 포트 전달하지 않으면 에러 메세지 출력 & 종료
+    while ((opt = getopt_long(argc, argv, "", options, NULL)) != -1){
+        switch (opt){
+        case 'q': queue_size = atoi(optarg); break;
+        case 'm': pool.min = atoi(optarg); break;
+        case 'M': pool.max = atoi(optarg); break;
+        case 'i': pool.idle_ms = atol(optarg); break;
+        case 'w': pool.spawn_wait_ms = atol(optarg); break;
+        case 's': nshards = atoi(optarg); break;
+        case 'c': limits.max_conns = atoi(optarg); break;
+        case 'l': limits.linger_ms = atoi(optarg); break;
+        case 'I': limits.idle_ms = atol(optarg); break;
+        case 'r': limits.read_ms = atol(optarg); break;
+        case 'W': limits.write_ms = atol(optarg); break;
+        case 'v': start_level = LOG_DEBUG; break;
+        default: usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1 || queue_size < 1 || pool.min < 1 || pool.max < pool.min
+        || pool.idle_ms < 0 || pool.spawn_wait_ms < 0 || nshards < 0 || nshards > SHARD_MAX
+        || limits.max_conns < 0 || limits.linger_ms < 0 || limits.idle_ms < 1 || limits.read_ms < 1 || limits.write_ms < 1)
+        usage(argv[0]); // 포트 전달하지 않으면 에러 메세지 출력 & 종료
+
+    log_init(STDOUT_FILENO, start_level);
 
     // client 접속 대기
-    listenfd = Open_listenfd(argv[1]);
-    sbuf_init(&sbuf, SBUFSIZE);
-    Sem_init(&client_count_mutex, 0, 1);
+    raise_fd_limit();
+    listenfd = Open_listenfd(argv[optind]);
+    sbuf_init(&sbuf, queue_size);
+
+    stock_start_sync(&stocks);
+    shard_init(&stocks, nshards);
+    feed_start();
+    poller_start();
+    Pthread_create(&tid, NULL, signal_thread, NULL);
+
+    stats_gauge("workers", &pool.workers);
+    stats_gauge("workers_idle", &pool.idle);
+    stats_gauge("queue_len", &pool.queued);
+    stats_gauge("conns_parked", &limits.parked);
+    stats_gauge("conn_timeouts", &limits.timeouts);
+    stats_gauge("conns_shed", &limits.shed);
 
     // create worker threads
-    for (i=0; i<NTHREADS; i++){
-        Pthread_create(&tid, NULL, thread, NULL);
+    for (i=0; i<pool.min; i++){
+        pool_spawn();
     }
 
     while (1) {
         clientlen = sizeof(struct sockaddr_storage);
         // 클라이언트가 연결 요청 보내면, 수락
-        connfd = Accept(listenfd, (SA *)&clientaddr, &clientlen);
-        Getnameinfo((SA *) &clientaddr, clientlen, client_hostname, MAXLINE, 
-                    client_port, MAXLINE, 0);
-        printf("Connected to (%s, %s)\n", client_hostname, client_port);
+        connfd = accept(listenfd, (SA *)&clientaddr, &clientlen);
+        if (connfd < 0){
+            if (errno != EINTR && errno != ECONNABORTED){
+                perror("accept error");
+                usleep(1000); // EMFILE 등: 연결이 닫힐 때까지 잠깐 쉬었다 다시
+            }
+            continue;
+        }
+        // accept thread가 DNS 조회로 멈추지 않도록 숫자 주소만 얻는다
+        if (log_enabled(LOG_INFO)){
+            Getnameinfo((SA *) &clientaddr, clientlen, client_hostname, MAXLINE, 
+                        client_port, MAXLINE, NI_NUMERICHOST | NI_NUMERICSERV);
+            log_info("Connected to (%s, %s)", client_hostname, client_port);
+        }
+        if (connfd >= poller.nfds || __atomic_load_n(&limits.conns, __ATOMIC_RELAXED) >= limits.max_conns){
+            reject_client(connfd);
+            continue;
+        }
+        __atomic_add_fetch(&limits.conns, 1, __ATOMIC_RELAXED);
         increment_client_count();
-        sbuf_insert(&sbuf, connfd);
+        // 큐가 가득 찼으면 기다리게 하지 않고 거절
+        if (!dispatch(connfd)){
+            __atomic_sub_fetch(&limits.conns, 1, __ATOMIC_RELAXED);
+            decrement_client_count();
+            reject_client(connfd);
+        }
     }
     return 0;
 }
 
 /////////////////////////////////////////
-// item 생성 & 초기화
-// 서버 시작 시, txt 파일 -> 트리
-// 클라이언트의 insert 요청 시
-Item create_item(int ID, int left_stock, int price){
-    Item newItem;
-    newItem.ID = ID;
-    newItem.left_stock = left_stock;
-    newItem.price = price;
-    newItem.readcnt = 0;
-    Sem_init(&newItem.mutex, 0, 1);
-    Sem_init(&newItem.w, 0, 1);
-    return newItem;
-}
-
-// tree 삽입
-TreeNode* insert(TreeNode* root, TreeNode* node){
-    if (root == NULL){
-        return node;
-    }
-
-    if (node->data.ID < root->data.ID)
-        root->left = insert(root->left, node);
-    else if (node->data.ID > root->data.ID)
-        root->right = insert(root->right, node);
-    return root;
-}
-
-// 메모리 해제 & 세마포어 파괴
-void free_tree(TreeNode* root){
-    if (root == NULL) return;
-    free_tree(root->left);
-    free_tree(root->right);
-    free(root);
-}
-
-// 이진 트리 검색
-TreeNode* search(TreeNode* root, int ID){
-    if (root == NULL) return NULL;
-
-    if (ID == root->data.ID)
-        return root;
-    else if (ID < root->data.ID)
-        return search(root->left, ID);
-    else
-        return search(root->right, ID);
-}
-
-// txt 파일 읽고, BST 구성
-TreeNode* load_stock_file(const char* filename){
-    FILE* fp = fopen(filename, "r");
-    if (fp == NULL){
-        perror("Failed to open file");
+// stock.db를 map (없으면 txt 파일을 import)
+void load_stock_file(const char* filename){
+    if (stock_load(&stocks, "stock.db", filename) < 0){
+        perror("Failed to load stock file");
         exit(1);
     }
+    proto_init(&stocks);
+}
 
-    TreeNode* root = NULL;
-    int id, stock, price;
-
-    while (fscanf(fp, "%d %d %d", &id, &stock, &price) != EOF){
-        Item item = create_item(id, stock, price);
-
-        TreeNode* node = (TreeNode*)malloc(sizeof(TreeNode));
-        node->data = item;
-        node->left = node->right = NULL;
+// signal handler 대신 sigwait로 받아서 일반 thread 문맥에서 종료 처리
+void *signal_thread(void *vargp){
+    sigset_t mask;
+    int signo;
 
-        stock_array[stock_count++] = node;
-        root = insert(root, node);
-    }
-    fclose(fp);
-    return root;
-}
+    Pthread_detach(pthread_self());
+    Sigemptyset(&mask);
+    Sigaddset(&mask, SIGINT);
+    sigwait(&mask, &signo);
 
-void sigint_handler(int signo)
-{
+    log_info("shutting down");
     save_stock("stock.txt");
-    free_tree(stock_root);
+    stock_close(&stocks);
+    log_shutdown();
     exit(1);
 }
 
+// WAL을 스냅샷(stock.db)으로 compaction, 기존 도구를 위해 txt로도 export
 void save_stock(char* file){
-    FILE *fp = fopen(file, "w");
-    if (fp != NULL){
-        for (int i=0; i<stock_count; i++){
-            TreeNode* node = stock_array[i];
-            fprintf(fp, "%d %d %d\n", node->data.ID, node->data.left_stock, node->data.price);
+    if (stock_compact(&stocks) < 0)
+        perror("stock_compact");
+    if (stock_export_text(&stocks, file) < 0)
+        perror("stock_export_text");
+}
+
+void *thread(void *vargp){
+    uint64_t item;
+
+    Pthread_detach(pthread_self());
+    while(1){
+        if (!sbuf_remove_timed(&sbuf, &item, pool.idle_ms)){
+            if (pool_retire())
+                return NULL;
+            continue;
         }
-        fclose(fp);
+        __atomic_sub_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
+        __atomic_sub_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+
+        // 오래 기다린 연결이 있었으면 아직 밀려 있을 수 있으니 하나 더 (남은 연결이 있을 때만)
+        uint32_t waited = now_us() - (uint32_t)(item >> 32);
+        stats_queue_wait(waited * 1000ull);
+        if (waited >= pool.spawn_wait_ms * 1000 && __atomic_load_n(&pool.queued, __ATOMIC_SEQ_CST) > 0)
+            pool_spawn();
+
+        conn_t* c = conn_get((int)(uint32_t)item);
+        // 입력이 끊긴 연결은 poller가, subscribe 연결은 feed thread가 가져가므로 닫지 않는다
+        if (!echo_cnt(c))
+            conn_close(c);
+        __atomic_add_fetch(&pool.idle, 1, __ATOMIC_SEQ_CST);
     }
 }
 
-void sbuf_init(sbuf_t *sp, int n){
-    sp->buf = Calloc(n, sizeof(int));
-    sp->n = n;
-    sp->front = sp->rear = 0;
-    Sem_init(&sp->mutex, 0, 1);
-    Sem_init(&sp->slots, 0, n);
-    Sem_init(&sp->items, 0, 0);
+// 연결 수가 fd soft limit(보통 1024)에 막히지 않도록 올림 (연결 table 크기 때문에 MAX_FDS까지)
+void raise_fd_limit(void){
+    struct rlimit rl;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+        unix_error("getrlimit error");
+    rl.rlim_cur = rl.rlim_max < MAX_FDS ? rl.rlim_max : MAX_FDS;
+    setrlimit(RLIMIT_NOFILE, &rl);
+    if (getrlimit(RLIMIT_NOFILE, &rl) < 0)
+        unix_error("getrlimit error");
+    poller.nfds = rl.rlim_cur < MAX_FDS ? rl.rlim_cur : MAX_FDS;
+    // --max-conns가 없으면 fd가 바닥나 accept가 실패하기 전에 거절하도록
+    if (limits.max_conns == 0)
+        limits.max_conns = poller.nfds > 2 * FD_RESERVE ? poller.nfds - FD_RESERVE : FD_RESERVE;
 }
 
-void sbuf_deinit(sbuf_t *sp){
-    Free(sp->buf);
+void poller_start(void){
+    struct epoll_event ev;
+    pthread_t tid;
+
+    poller.conns = Calloc(poller.nfds, sizeof(conn_t*));
+    if ((poller.epfd = epoll_create1(0)) < 0)
+        unix_error("poller: epoll_create1 error");
+    if ((poller.evfd = eventfd(0, EFD_NONBLOCK)) < 0)
+        unix_error("poller: eventfd error");
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(poller.epfd, EPOLL_CTL_ADD, poller.evfd, &ev) < 0)
+        unix_error("poller: epoll_ctl error");
+    timer_init(&poller.wheel, timer_now_ms());
+    Pthread_create(&tid, NULL, poller_thread, NULL);
 }
 
-void sbuf_insert(sbuf_t *sp, int item){
-    P(&sp->slots); // 빈 슬롯 감소
-    P(&sp->mutex);
-    sp->buf[(++sp->rear)%(sp->n)] = item;
-    V(&sp->mutex);
-    V(&sp->items); // 데이터 증가
+/*
+연결을 큐에 넣어 worker에게 (큐에서 기다린 시간을 재도록 넣은 시각도 함께)
+accept thread와 poller는 큐에서 막히면 안 되므로 worker를 max까지 늘렸는데도 가득 찼으면 0
+*/
+int dispatch(int connfd){
+    // 쉬고 있는 worker보다 기다리는 연결이 많아지면 늘린다 (큐가 가득 차기 전에)
+    if (__atomic_add_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST) > __atomic_load_n(&pool.idle, __ATOMIC_SEQ_CST))
+        pool_spawn();
+    if (sbuf_try_insert(&sbuf, (uint64_t)now_us() << 32 | (uint32_t)connfd))
+        return 1;
+    __atomic_sub_fetch(&pool.queued, 1, __ATOMIC_SEQ_CST);
+    return 0;
 }
 
-int sbuf_remove(sbuf_t *sp){
-    int item;
-    P(&sp->items); // 데이터 감소
-    P(&sp->mutex);
-    item = sp->buf[(++sp->front)%(sp->n)];
-    V(&sp->mutex);
-    V(&sp->slots); // 빈 슬롯 증가
-    return item;
+// 한도를 넘은 연결: 이유를 한 줄 보내고 바로 닫는다 (client는 기다리지 않고 나중에 다시 시도)
+void reject_client(int connfd){
+    static const char msg[] = "Server busy\n";
+
+    if (write(connfd, msg, sizeof(msg) - 1) < 0)
+        ; // 보내지 못해도 닫기만 하면 된다
+    Close(connfd);
+    __atomic_add_fetch(&limits.shed, 1, __ATOMIC_RELAXED);
+    log_debug("connection shed");
 }
 
-void *thread(void *vargp){
-    Pthread_detach(pthread_self());
-    while(1){
-        int connfd = sbuf_remove(&sbuf);
-        echo_cnt(connfd);
-        Close(connfd);
-        decrement_client_count();
+/*
+fd의 연결 상태, 처음 받은 연결이면 만든다
+socket은 blocking으로 두고 읽기는 최대 linger_ms까지만 기다리게 한다 (SO_RCVTIMEO):
+입력을 기다릴 때 read 한 번으로 끝나고, 기다리면 안 될 때는 MSG_DONTWAIT, 쓰기는 항상 MSG_DONTWAIT
+*/
+conn_t* conn_get(int connfd){
+    conn_t* c = poller.conns[connfd];
+    struct timeval tv = {limits.linger_ms / 1000, limits.linger_ms % 1000 * 1000};
+
+    if (c == NULL){
+        c = Calloc(1, sizeof(conn_t));
+        c->fd = connfd;
+        proto_conn_init(&c->pc);
+        pbuf_init(&c->out);
+        if (limits.linger_ms > 0 && setsockopt(connfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) < 0)
+            perror("setsockopt error");
+        poller.conns[connfd] = c;
     }
+    return c;
 }
 
-static void init_echo_cnt(void){
-    Sem_init(&mutex_byte_cnt, 0, 1);
-    byte_cnt = 0;
+static void conn_free(conn_t* c){
+    free(c->rio);
+    pbuf_free(&c->out);
+    free(c);
+    __atomic_sub_fetch(&limits.conns, 1, __ATOMIC_RELAXED);
 }
 
-// thread-safe client handler
-void echo_cnt(int connfd){
-    int n;
-    char buf[MAXLINE];
-    char response[MAXLINE] = "";
+// table을 먼저 비운다: close 뒤에 같은 fd 번호로 들어온 연결이 옛 상태를 보지 않도록
+void conn_close(conn_t* c){
+    int fd = c->fd;
 
-    rio_t rio;
-    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    poller.conns[fd] = NULL;
+    conn_free(c);
+    Close(fd); // poller epoll에 등록돼 있었으면 같이 빠진다
+    decrement_client_count();
+}
 
-    Pthread_once(&once, init_echo_cnt);
-    Rio_readinitb(&rio, connfd);
+// 큐가 가득 차서 worker에게 넘기지 못한 연결: conn_close처럼 정리하고 "Server busy"로 닫는다
+void conn_shed(conn_t* c){
+    int fd = c->fd;
 
-    while((n = Rio_readlineb(&rio, buf, MAXLINE)) != 0){
-        // client의 요청 한 줄씩 읽음
-        P(&mutex_byte_cnt);
-        byte_cnt += n;
-        printf("server recieved %d bytes\n", n);
-        fflush(stdout);
-        V(&mutex_byte_cnt);
+    poller.conns[fd] = NULL;
+    conn_free(c);
+    decrement_client_count();
+    reject_client(fd);
+}
 
-        //Rio_writen(connfd, buf, MAXLINE); // echo 동작
-        if (handle_stock_command(connfd, buf, response) == 1){
-            break;
+/*
+입력이나 보낼 자리를 기다리는 연결을 poller에 맡긴다, worker는 바로 다음 연결로
+deadline: 응답이 밀렸으면 write timeout, 요청이 반쯤 왔으면 그 요청이 처음 보인 때부터 read timeout
+(byte가 조금씩 더 와도 늘어나지 않는다, slowloris), 그 외에는 idle timeout
+*/
+int park(conn_t* c, int events){
+    uint64_t one = 1, now = timer_now_ms();
+
+    c->events = events;
+    if (events == EPOLLOUT){
+        c->deadline = now + limits.write_ms;
+    } else if (c->rio && c->rio->rio_cnt > 0){
+        if (c->in_since == 0 || c->in_nreq != c->pc.nreq){
+            c->in_since = now;
+            c->in_nreq = c->pc.nreq;
         }
+        c->deadline = c->in_since + limits.read_ms;
+    } else{
+        c->deadline = now + limits.idle_ms;
     }
+    // 기다리는 동안 필요 없는 버퍼는 반환
+    if (c->rio && c->rio->rio_cnt == 0){
+        free(c->rio);
+        c->rio = NULL;
+    }
+    if (c->out_off == c->out.total)
+        pbuf_free(&c->out);
+
+    pthread_mutex_lock(&poller.mutex);
+    c->next = poller.park;
+    poller.park = c;
+    pthread_mutex_unlock(&poller.mutex);
+    if (!__atomic_exchange_n(&poller.signaled, 1, __ATOMIC_ACQ_REL)
+        && write(poller.evfd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+        perror("poller: eventfd write");
+    return 1;
 }
 
-int handle_stock_command(int connfd, char* buf, char* response){
-    char command[MAXLINE];
-    int id, count;
-
-    response[0] = '\0'; // 응답 버퍼 초기화
-    buf[strcspn(buf, "\n")] = 0;
-
-    if (sscanf(buf, "%s", command) != 1)
-        return 0;
+// timer 만료: poller에서 기다리던 연결의 deadline이 지남
+static void conn_expired(timer_node* t, void* arg){
+    conn_t* c = (conn_t*)((char*)t - offsetof(conn_t, timer));
 
-    // show - 전체 주식 목록 출력
-    if (strcmp(command, "show") == 0){
+    log_info("connection timed out (%s)", c->events == EPOLLOUT ? "write" : c->rio ? "read" : "idle");
+    __atomic_add_fetch(&limits.timeouts, 1, __ATOMIC_RELAXED);
+    __atomic_sub_fetch(&limits.parked, 1, __ATOMIC_RELAXED);
+    conn_close(c);
+}
 
-        for (int i = 0; i < stock_count; i++){
-            TreeNode* node = stock_array[i];
+void *poller_thread(void *vargp){
+    struct epoll_event events[POLL_MAXEVENTS], ev;
+    uint64_t now, cnt;
+    conn_t* c;
+    int i, n;
 
-            // reader entry
-            P(&node->data.mutex);
-            node->data.readcnt++;
-            if (node->data.readcnt == 1){
-                P(&node->data.w);
-            }
-            V(&node->data.mutex);
-
-            // read - critical
-            char line[100];
-            sprintf(line, "%d %d %d\n", node->data.ID, node->data.left_stock, node->data.price);
-            strcat(response, line);
-
-            // reader exit
-            P(&node->data.mutex);
-            node->data.readcnt--;
-            if (node->data.readcnt == 0){
-                V(&node->data.w);
+    Pthread_detach(pthread_self());
+    while (1){
+        n = epoll_wait(poller.epfd, events, POLL_MAXEVENTS, timer_wait_ms(&poller.wheel, timer_now_ms()));
+        if (n < 0){
+            if (errno == EINTR) continue;
+            unix_error("poller: epoll_wait error");
+        }
+        now = timer_now_ms();
+
+        // 준비된 연결은 다시 worker에게 (EPOLLONESHOT이라 다시 맡길 때까지 event가 오지 않는다)
+        for (i = 0; i < n; i++){
+            c = events[i].data.ptr;
+            if (c == NULL){
+                if (read(poller.evfd, &cnt, sizeof(cnt)) < 0 && errno != EAGAIN)
+                    perror("poller: eventfd read");
+                continue;
             }
-            V(&node->data.mutex);
+            timer_del(&poller.wheel, &c->timer);
+            __atomic_sub_fetch(&limits.parked, 1, __ATOMIC_RELAXED);
+            // poller가 큐에서 기다리면 다른 연결의 timer와 등록이 멈추므로 넘기지 못하면 닫는다
+            if (!dispatch(c->fd))
+                conn_shed(c);
         }
-        Rio_writen(connfd, response, MAXLINE);
-    }
-    
-    else if (strncmp(command, "buy", 3) == 0){
-        if (sscanf(buf, "buy %d %d", &id, &count) == 2){
-            TreeNode* node = search(stock_root, id);
-            if (node){
-                P(&node->data.w);
-                // write - critical
-                if (node->data.left_stock >= count){
-                    node->data.left_stock -= count;
-                    strcpy(response, "[buy] success\n");
-                } else{
-                    strcpy(response, "Not enough left stocks\n");
-                }
-                V(&node->data.w);
+
+        // worker가 맡긴 연결 등록, 등록 시점에 이미 준비돼 있으면 바로 event가 온다 (level-triggered)
+        __atomic_store_n(&poller.signaled, 0, __ATOMIC_SEQ_CST);
+        pthread_mutex_lock(&poller.mutex);
+        c = poller.park;
+        poller.park = NULL;
+        pthread_mutex_unlock(&poller.mutex);
+        while (c){
+            conn_t* next = c->next;
+
+            ev.events = c->events | EPOLLRDHUP | EPOLLONESHOT;
+            ev.data.ptr = c;
+            if (epoll_ctl(poller.epfd, c->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, c->fd, &ev) < 0){
+                perror("poller: epoll_ctl");
+                conn_close(c);
             } else{
-                strcpy(response, "Invalid stock ID\n");
+                c->registered = 1;
+                timer_add(&poller.wheel, &c->timer, c->deadline);
+                __atomic_add_fetch(&limits.parked, 1, __ATOMIC_RELAXED);
             }
+            c = next;
         }
-        Rio_writen(connfd, response, MAXLINE);
+        timer_advance(&poller.wheel, now, conn_expired, NULL);
     }
-    
-    else if (strncmp(command, "sell", 4) == 0){
-        if (sscanf(buf, "sell %d %d", &id, &count) == 2){
-            TreeNode* node = search(stock_root, id);
-            if (node){
-                P(&node->data.w);
-                // wirte - critical
-                node->data.left_stock += count;
-                strcpy(response, "[sell] success\n");
-                V(&node->data.w);
-            } else{
-                strcpy(response, "Invalid stock ID\n");
-            }
+    return NULL;
+}
+
+// rio 버퍼에 '\n'까지 온 요청이 더 남아 있으면 1 (read 없이 바로 처리 가능)
+static int rio_has_line(rio_t* rp){
+    return rp->rio_cnt > 0 && memchr(rp->rio_bufptr, '\n', rp->rio_cnt) != NULL;
+}
+
+// 받은 byte는 thread 별 counter에 더하고, 로그는 ring에 넣기만 한다 (--verbose일 때)
+static void count_bytes(int n){
+    stats_bytes_in(n);
+    log_debug("server recieved %d bytes", n);
+}
+
+/*
+쌓인 응답을 sendmsg로 전송 (show snapshot은 복사 없이 공유 버퍼를 그대로 보낸다)
+0: 다 보냄, 1: socket 버퍼가 가득 참 (out_off부터 나중에 이어서), -1: 연결 에러
+*/
+static int flush_out(conn_t* c){
+    struct iovec iov[PROTO_IOV_MAX];
+    struct msghdr msg = {.msg_iov = iov};
+
+    while (c->out_off < c->out.total){
+        msg.msg_iovlen = pbuf_iov(&c->out, c->out_off, iov, PROTO_IOV_MAX);
+        ssize_t n = sendmsg(c->fd, &msg, MSG_DONTWAIT);
+        if (n < 0){
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return 1;
+            return -1;
         }
-        Rio_writen(connfd, response, MAXLINE);
+        stats_bytes_out(n);
+        c->out_off += n;
     }
-    else if (strcmp(command, "exit") == 0) {
-        return 1;
+    pbuf_reset(&c->out);
+    c->out_off = 0;
+    return 0;
+}
+
+/*
+rio 버퍼에 남은 입력을 앞으로 당기고 뒤에 이어 읽는다 (frame이 버퍼 끝에 걸쳐도 이어 붙는다)
+다른 연결이 worker를 기다리지 않으면 linger_ms까지 기다려 본다
+(요청 사이 간격이 짧은 연결은 poller를 거치지 않는다)
+읽은 byte 수, EOF/에러면 0, 아직 온 것이 없으면 -1
+*/
+static int fill_in(conn_t* c){
+    rio_t* rp = c->rio;
+    int wait = limits.linger_ms > 0 && __atomic_load_n(&pool.queued, __ATOMIC_RELAXED) == 0;
+    ssize_t n;
+
+    if (rp->rio_cnt > 0 && rp->rio_bufptr != rp->rio_buf)
+        memmove(rp->rio_buf, rp->rio_bufptr, rp->rio_cnt);
+    rp->rio_bufptr = rp->rio_buf;
+    while ((n = recv(c->fd, rp->rio_buf + rp->rio_cnt, RIO_BUFSIZE - rp->rio_cnt, wait ? 0 : MSG_DONTWAIT)) < 0){
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return -1;
+        if (errno != EINTR)
+            return 0;
     }
+    rp->rio_cnt += n;
+    return n;
+}
+
+/*
+thread-safe client handler
+pipelining: 버퍼에 있는 요청을 모두 처리하고 응답은 모아서 한 번에 보낸다
+text 줄과 binary frame 모두 rio 버퍼 안에서 바로 파싱하므로 read에서 block되지 않는다.
+입력이 끊기거나 응답이 밀리면 poller에 맡기고, subscribe면 feed thread에 넘기고 1
+밀린 응답을 다 보내기 전에는 새 요청을 처리하지 않으므로 연결 당 보내지 못한 응답은
+PIPE_FLUSH_BYTES 정도로 제한된다 (나머지 요청은 socket 버퍼에 남아 client가 더 보내지 못한다)
+연결을 닫아야 하면 0
+*/
+int echo_cnt(conn_t* c){
+    char buf[MAXLINE];
+    proto_req req;
+    rio_t* rp;
+    int k, ret;
+
+    if ((ret = flush_out(c)) != 0)
+        return ret > 0 ? park(c, EPOLLOUT) : 0;
+    if (c->rio == NULL){
+        c->rio = Malloc(sizeof(rio_t));
+        Rio_readinitb(c->rio, c->fd);
+    }
+    rp = c->rio;
+
+    while (!c->closing){
+        k = 0;
+        if (c->pc.version == PROTO_BIN){
+            // hello 3 이후로는 binary frame
+            if ((k = proto_parse_bin(rp->rio_bufptr, rp->rio_cnt, &req)) > 0){
+                rp->rio_bufptr += k;
+                rp->rio_cnt -= k;
+                count_bytes(k);
+            } else if (k < 0){
+                req.op = PROTO_OP_UNKNOWN;
+            }
+        } else if (rio_has_line(rp) || rp->rio_cnt >= MAXLINE - 1 || (c->eof && rp->rio_cnt > 0)){
+            // client의 요청 한 줄 (버퍼 안에서 끝나므로 read 하지 않는다)
+            k = rio_readlineb(rp, buf, MAXLINE);
+            count_bytes(k);
+            proto_parse_text(buf, &req);
+        }
+
+        if (k == 0){
+            // 처리할 요청이 더 없으면 응답을 보내고 더 읽는다
+            if (c->eof)
+                break;
+            if ((ret = flush_out(c)) != 0)
+                return ret > 0 ? park(c, EPOLLOUT) : 0;
+            if ((ret = fill_in(c)) < 0)
+                return park(c, EPOLLIN);
+            if (ret == 0)
+                c->eof = 1;
+            continue;
+        }
+
+        ret = shard_execute(&c->pc, &req, &c->out);
+        if (ret == PROTO_SUBSCRIBE){
+            // 남은 응답과 읽어 둔 입력째로 넘긴다, 이후 fd는 feed thread 것
+            poller.conns[c->fd] = NULL;
+            feed_attach(c->fd, &c->pc, &c->out, c->out_off, rp->rio_bufptr, rp->rio_cnt);
+            conn_free(c);
+            return 1;
+        }
+        c->closing = (ret == PROTO_CLOSE);
+        // 응답이 너무 쌓였으면 먼저 보낸다
+        if (c->out.total - c->out_off >= PIPE_FLUSH_BYTES && (ret = flush_out(c)) != 0)
+            return ret > 0 ? park(c, EPOLLOUT) : 0;
+    }
+    // exit 또는 EOF: 남은 응답을 보낸 뒤 닫는다
+    c->closing = 1;
+    if ((ret = flush_out(c)) > 0)
+        return park(c, EPOLLOUT);
     return 0;
 }
 
 void increment_client_count(void){
-    P(&client_count_mutex);
-    active_clients++;
-    V(&client_count_mutex);
+    stats_conn(1);
 }
 
 void decrement_client_count(void){
-    P(&client_count_mutex);
-    active_clients--;
-    V(&client_count_mutex);
-
-    if(active_clients == 0){
-        save_stock("stock.txt");
-    }
+    stats_conn(-1);
 }
 /* $end echoserverimain */
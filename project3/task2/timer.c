@@ -0,0 +1,127 @@
+/*
+ * timer.c - 계층형 timer wheel
+ */
+#include <time.h>
+#include "timer.h"
+
+#define TIMER_MASK (TIMER_SLOTS - 1)
+#define TIMER_SPAN (1ull << (TIMER_BITS * TIMER_LEVELS)) // wheel 전체가 담는 tick 수
+
+uint64_t timer_now_ms(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void timer_init(timer_wheel* tw, uint64_t now_ms){
+    tw->now = now_ms / TIMER_TICK_MS;
+    tw->count = 0;
+    for (int l = 0; l < TIMER_LEVELS; l++)
+        for (int s = 0; s < TIMER_SLOTS; s++)
+            list_init(&tw->slots[l][s]);
+}
+
+// 남은 tick 수로 level을 고르고, 그 level에서 만료 tick이 속한 slot에 넣는다
+static void place(timer_wheel* tw, timer_node* t){
+    uint64_t e = t->expires < tw->now ? tw->now : t->expires; // 이미 지났으면 다음 처리 때 만료
+    uint64_t delta = e - tw->now;
+    int l;
+
+    for (l = 0; l < TIMER_LEVELS - 1; l++){
+        if (delta < 1ull << (TIMER_BITS * (l + 1)))
+            break;
+    }
+    if (delta >= TIMER_SPAN)
+        e = tw->now + TIMER_SPAN - 1; // 너무 멀면 마지막 level 끝에 두었다가 cascade 때 다시 고른다
+    list_push_back(&tw->slots[l][(e >> (TIMER_BITS * l)) & TIMER_MASK], &t->elem);
+}
+
+// ms까지 만료되도록 건다 (이미 걸려 있으면 옮긴다)
+void timer_add(timer_wheel* tw, timer_node* t, uint64_t ms){
+    if (t->armed)
+        list_remove(&t->elem);
+    else
+        tw->count++;
+    t->expires = (ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS;
+    t->armed = 1;
+    place(tw, t);
+}
+
+/*
+ms 이전에 만료되도록 이미 걸려 있으면 그대로 둔다
+deadline이 늦춰질 때마다 옮기지 않고, 만료됐을 때 호출한 쪽이 실제 deadline을 보고 다시 건다
+*/
+void timer_arm(timer_wheel* tw, timer_node* t, uint64_t ms){
+    if (!t->armed || (ms + TIMER_TICK_MS - 1) / TIMER_TICK_MS < t->expires)
+        timer_add(tw, t, ms);
+}
+
+void timer_del(timer_wheel* tw, timer_node* t){
+    if (t->armed){
+        list_remove(&t->elem);
+        t->armed = 0;
+        tw->count--;
+    }
+}
+
+// level l에서 지금 tick이 가리키는 slot을 비우고 아래 level로 다시 나눠 넣는다, slot 번호를 반환
+static int cascade(timer_wheel* tw, int l){
+    int idx = (tw->now >> (TIMER_BITS * l)) & TIMER_MASK;
+    struct list* slot = &tw->slots[l][idx];
+    struct list moved;
+
+    list_init(&moved);
+    list_splice(list_end(&moved), list_begin(slot), list_end(slot));
+    while (!list_empty(&moved))
+        place(tw, list_entry(list_pop_front(&moved), timer_node, elem));
+    return idx;
+}
+
+// now_ms까지의 tick을 처리하며 만료된 timer마다 fn 호출
+void timer_advance(timer_wheel* tw, uint64_t now_ms, timer_fn fn, void* arg){
+    uint64_t cur = now_ms / TIMER_TICK_MS;
+
+    while (tw->now <= cur){
+        if (tw->count == 0){
+            tw->now = cur + 1; // 빈 wheel은 돌릴 필요 없이 건너뛴다
+            return;
+        }
+        int idx = tw->now & TIMER_MASK;
+        struct list* slot = &tw->slots[0][idx];
+
+        // level 0이 한 바퀴 돌았으면 위 level에서 내려온다 (위 level도 한 바퀴면 그 위에서도)
+        if (idx == 0){
+            for (int l = 1; l < TIMER_LEVELS && cascade(tw, l) == 0; l++)
+                ;
+        }
+        // fn이 같은 tick으로 다시 걸어도 이 loop에서 처리된다
+        while (!list_empty(slot)){
+            timer_node* t = list_entry(list_pop_front(slot), timer_node, elem);
+
+            t->armed = 0;
+            tw->count--;
+            fn(t, arg);
+        }
+        tw->now++;
+    }
+}
+
+/*
+epoll_wait timeout: 다음에 할 일 (level 0의 가장 가까운 timer 또는 다음 cascade)까지 남은 ms
+걸린 timer가 없으면 -1 (무한 대기)
+*/
+int timer_wait_ms(timer_wheel* tw, uint64_t now_ms){
+    uint64_t next, ms;
+
+    if (tw->count == 0)
+        return -1;
+    next = (tw->now + TIMER_MASK) & ~(uint64_t)TIMER_MASK;
+    for (uint64_t t = tw->now; t < next; t++){
+        if (!list_empty(&tw->slots[0][t & TIMER_MASK])){
+            next = t;
+            break;
+        }
+    }
+    ms = next * TIMER_TICK_MS;
+    return ms > now_ms ? (int)(ms - now_ms) : 0;
+}
@@ -0,0 +1,159 @@
+/*
+ * bench_mt.c - 멀티스레드 trace 재생으로 mm_malloc과 glibc malloc 비교
+ *   build: gcc -O2 -pthread -o bench_mt bench_mt.c mm.c memlib.c (malloc lab의 memlib.c, config.h)
+ *   usage: ./bench_mt [ops per thread] [max threads]
+ *   thread마다 seed만 다른 같은 trace를 재생한다: 슬롯 LIVE개 중 하나를 골라 비어 있으면 할당,
+ *   차 있으면 free한다. 크기는 16~64 byte가 대부분이고 1/16은 1KB까지 (서버의 요청/응답 버퍼 정도)
+ *   free할 블록의 1/8은 옆 thread에게 넘겨서 그 thread가 free한다 (다른 arena 블록의 free)
+ *   thread 수 1, 2, 4, ..., max마다 두 allocator의 초당 연산 수를 출력한다
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define LIVE 512 // thread당 살아 있는 블록 수 상한
+#define RING 1024 // 옆 thread로 넘기는 SPSC ring 크기
+#define HANDOFF 8 // free 8번 중 1번은 옆 thread로
+
+typedef struct {
+    const char *name;
+    void *(*alloc)(size_t);
+    void (*release)(void *);
+} allocator_t;
+
+typedef struct {
+    void *buf[RING];
+    size_t head; // consumer가 읽을 위치
+    size_t tail; // producer가 쓸 위치
+    char pad[64];
+} ring_t;
+
+static allocator_t allocs[] = {
+    { "mm", mm_malloc, mm_free },
+    { "glibc", malloc, free },
+};
+
+static allocator_t *cur;
+static ring_t *rings; // rings[i]: thread i -> thread i+1
+static int nthreads;
+static long nops;
+static pthread_barrier_t start_bar, end_bar;
+
+static unsigned next_rand(unsigned *seed){
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 1;
+}
+
+static int ring_push(ring_t *r, void *p){
+    size_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED);
+
+    if (tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RING) return 0;
+    r->buf[tail % RING] = p;
+    __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+// 옆 thread가 넘긴 블록을 모두 free
+static void ring_drain(ring_t *r){
+    size_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+    size_t tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; head++)
+        cur->release(r->buf[head % RING]);
+    __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+}
+
+static void *worker(void *arg){
+    int id = (int)(long)arg;
+    ring_t *out = &rings[id];
+    ring_t *in = &rings[(id + nthreads - 1) % nthreads];
+    void *slot[LIVE] = { NULL };
+    unsigned seed = id * 7919 + 1;
+    long k;
+    int s;
+
+    pthread_barrier_wait(&start_bar);
+    for (k = 0; k < nops; k++) {
+        unsigned r = next_rand(&seed);
+
+        s = r % LIVE;
+        if (slot[s] == NULL) {
+            size_t size = (r >> 16) % 16 ? 16 + (r >> 20) % 49 : 64 + (r >> 20) % 961;
+
+            if ((slot[s] = cur->alloc(size)) == NULL) {
+                fprintf(stderr, "%s: out of memory\n", cur->name);
+                exit(1);
+            }
+            memset(slot[s], id, 16);
+        }
+        else {
+            if (nthreads == 1 || (r >> 12) % HANDOFF || !ring_push(out, slot[s]))
+                cur->release(slot[s]);
+            slot[s] = NULL;
+        }
+        if ((k & 63) == 0)
+            ring_drain(in);
+    }
+    for (s = 0; s < LIVE; s++)
+        if (slot[s] != NULL)
+            cur->release(slot[s]);
+
+    // 모든 thread가 넘기기를 끝낸 뒤 남은 것 정리
+    pthread_barrier_wait(&end_bar);
+    ring_drain(in);
+    pthread_barrier_wait(&end_bar);
+    return NULL;
+}
+
+static double run(allocator_t *a, int n){
+    pthread_t tid[n];
+    struct timespec t0, t1;
+    int i;
+
+    cur = a;
+    nthreads = n;
+    rings = calloc(n, sizeof(ring_t));
+    if (a->alloc == mm_malloc) {
+        mem_reset_brk();
+        if (mm_init() < 0) {
+            fprintf(stderr, "mm_init failed\n");
+            exit(1);
+        }
+    }
+    pthread_barrier_init(&start_bar, NULL, n + 1);
+    pthread_barrier_init(&end_bar, NULL, n + 1);
+    for (i = 0; i < n; i++)
+        pthread_create(&tid[i], NULL, worker, (void *)(long)i);
+
+    pthread_barrier_wait(&start_bar);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pthread_barrier_wait(&end_bar);
+    pthread_barrier_wait(&end_bar);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (i = 0; i < n; i++)
+        pthread_join(tid[i], NULL);
+    pthread_barrier_destroy(&start_bar);
+    pthread_barrier_destroy(&end_bar);
+    free(rings);
+
+    return (double)n * nops / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9) / 1e6;
+}
+
+int main(int argc, char **argv){
+    int max = argc > 2 ? atoi(argv[2]) : 32;
+    int n;
+
+    nops = argc > 1 ? atol(argv[1]) : 1000000;
+    mem_init();
+
+    printf("%8s %12s %12s\n", "threads", "mm Mops/s", "glibc Mops/s");
+    for (n = 1; n <= max; n *= 2)
+        printf("%8d %12.2f %12.2f\n", n, run(&allocs[0], n), run(&allocs[1], n));
+    return 0;
+}
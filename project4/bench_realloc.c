@@ -0,0 +1,180 @@
+/*
+ * bench_realloc.c - realloc이 많은 trace로 mm_realloc과 glibc realloc 비교
+ *   build: gcc -O2 -pthread -o bench_realloc bench_realloc.c mm.c memlib.c (malloc lab의 memlib.c, config.h)
+ *   usage: ./bench_realloc [ops]
+ *   append: malloc lab의 realloc-bal 모양. 버퍼 하나를 GROW byte씩 늘리면서, 늘릴 때마다 작은 블록을
+ *           하나 할당하고 바로 전의 작은 블록을 free한다 (MAX_BUF를 넘으면 free하고 처음부터)
+ *   mixed:  버퍼 BUFS개에 1~GROW byte씩 이어 붙이고, 그 사이사이 작은 블록 LIVE개를 할당/해제한다
+ *           (요청 버퍼를 키우면서 다른 요청을 처리하는 서버 모양)
+ *   포인터가 바뀐 realloc 수와 그때 옮긴 byte 수, 초당 연산 수, mm 힙 사용률을 출력한다
+ *   사용률은 malloc lab과 같이 가장 많이 살아 있던 payload 합 / mm 힙 크기
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+#define BUFS 16
+#define GROW 64
+#define MAX_BUF (64 * 1024)
+#define LIVE 4096
+#define SMALL 128 // append에서 버퍼 사이에 끼우는 블록 크기
+
+typedef struct {
+    const char *name;
+    void *(*alloc)(size_t);
+    void *(*resize)(void *, size_t);
+    void (*release)(void *);
+} allocator_t;
+
+typedef struct {
+    long reallocs, moves;
+    double copied; // 포인터가 바뀐 realloc에서 옮긴 byte 수
+    size_t cur, peak; // 살아 있는 payload 합
+} stat_t;
+
+static allocator_t allocs[] = {
+    { "mm", mm_malloc, mm_realloc, mm_free },
+    { "glibc", malloc, realloc, free },
+};
+
+static long nops;
+
+static unsigned next_rand(unsigned *seed){
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 1;
+}
+
+static void oom(allocator_t *a){
+    fprintf(stderr, "%s: out of memory\n", a->name);
+    exit(1);
+}
+
+// p를 len에서 n byte로 늘리고 통계를 센다
+static void *grow(allocator_t *a, stat_t *st, void *p, size_t len, size_t n){
+    void *q;
+
+    if ((q = a->resize(p, n)) == NULL) oom(a);
+    memset((char *)q + len, 1, n - len);
+    if (p != NULL) {
+        st->reallocs++;
+        if (q != p) {
+            st->moves++;
+            st->copied += len;
+        }
+    }
+    if ((st->cur += n - len) > st->peak) st->peak = st->cur;
+    return q;
+}
+
+static void trace_append(allocator_t *a, stat_t *st){
+    void *buf = NULL, *small = NULL, *p;
+    size_t len = 0;
+    long k;
+
+    for (k = 0; k < nops; k++) {
+        if (len > MAX_BUF) {
+            a->release(buf);
+            buf = NULL;
+            st->cur -= len;
+            len = 0;
+        }
+        buf = grow(a, st, buf, len, len + GROW);
+        len += GROW;
+
+        if ((p = a->alloc(SMALL)) == NULL) oom(a);
+        if (small != NULL) a->release(small);
+        else st->cur += SMALL;
+        small = p;
+    }
+    a->release(buf);
+    a->release(small);
+}
+
+static void trace_mixed(allocator_t *a, stat_t *st){
+    void *buf[BUFS] = { NULL };
+    size_t len[BUFS] = { 0 };
+    void **small = calloc(LIVE, sizeof(void *));
+    size_t *small_len = calloc(LIVE, sizeof(size_t));
+    unsigned seed = 1;
+    long k;
+    int i;
+
+    for (k = 0; k < nops; k++) {
+        unsigned r = next_rand(&seed);
+
+        if (r % 4 == 0) {
+            i = (r >> 2) % LIVE;
+            if (small[i] == NULL) {
+                small_len[i] = 16 + (r >> 16) % 113;
+                if ((small[i] = a->alloc(small_len[i])) == NULL) oom(a);
+                if ((st->cur += small_len[i]) > st->peak) st->peak = st->cur;
+            }
+            else {
+                a->release(small[i]);
+                small[i] = NULL;
+                st->cur -= small_len[i];
+            }
+        }
+        else {
+            i = (r >> 2) % BUFS;
+            if (len[i] > MAX_BUF) {
+                a->release(buf[i]);
+                buf[i] = NULL;
+                st->cur -= len[i];
+                len[i] = 0;
+                continue;
+            }
+            size_t n = len[i] + 1 + (r >> 16) % GROW;
+
+            buf[i] = grow(a, st, buf[i], len[i], n);
+            len[i] = n;
+        }
+    }
+
+    for (i = 0; i < BUFS; i++)
+        a->release(buf[i]);
+    for (i = 0; i < LIVE; i++)
+        if (small[i] != NULL)
+            a->release(small[i]);
+    free(small);
+    free(small_len);
+}
+
+static void run(allocator_t *a, const char *trace, void (*fn)(allocator_t *, stat_t *)){
+    stat_t st = { 0 };
+    struct timespec t0, t1;
+
+    if (a->alloc == mm_malloc) {
+        mem_reset_brk();
+        if (mm_init() < 0) {
+            fprintf(stderr, "mm_init failed\n");
+            exit(1);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    fn(a, &st);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    printf("%7s %6s %10.2f %10ld %10ld %10.1f", trace, a->name,
+           nops / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9) / 1e6,
+           st.reallocs, st.moves, st.copied / (1 << 20));
+    if (a->alloc == mm_malloc) printf(" %7.1f%%\n", 100.0 * st.peak / mem_heapsize());
+    else printf(" %8s\n", "-");
+}
+
+int main(int argc, char **argv){
+    nops = argc > 1 ? atol(argv[1]) : 2000000;
+    mem_init();
+
+    printf("%7s %6s %10s %10s %10s %10s %8s\n", "trace", "alloc", "Mops/s", "reallocs", "moves", "MB copied", "util");
+    run(&allocs[0], "append", trace_append);
+    run(&allocs[1], "append", trace_append);
+    run(&allocs[0], "mixed", trace_mixed);
+    run(&allocs[1], "mixed", trace_mixed);
+    return 0;
+}
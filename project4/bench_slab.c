@@ -0,0 +1,97 @@
+/*
+ * bench_slab.c - 요청 크기별 mm_malloc/mm_free throughput과 힙 사용률 (glibc malloc과 비교)
+ *   build: gcc -O2 -pthread -o bench_slab bench_slab.c mm.c memlib.c (malloc lab의 memlib.c, config.h)
+ *   usage: ./bench_slab [ops] [live]
+ *   크기마다 힙을 새로 만들고, 슬롯 live개 중 하나를 골라 비어 있으면 그 크기로 할당, 차 있으면 free한다
+ *   slab class (8~64 byte)마다 하나, 그 위로 경계 태그 블록 크기 몇 개를 잰다
+ *   사용률은 malloc lab과 같이 가장 많이 살아 있던 payload 합 / mm 힙 크기
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+
+typedef struct {
+    void *(*alloc)(size_t);
+    void (*release)(void *);
+} allocator_t;
+
+static allocator_t allocs[] = {
+    { mm_malloc, mm_free },
+    { malloc, free },
+};
+
+static size_t sizes[] = { 8, 16, 24, 32, 40, 48, 56, 64, 96, 128, 256, 1024 };
+
+static long nops;
+static int live;
+static size_t peak; // 마지막 run에서 가장 많이 살아 있던 payload 합
+
+static unsigned next_rand(unsigned *seed){
+    *seed = *seed * 1103515245 + 12345;
+    return *seed >> 1;
+}
+
+static double run(allocator_t *a, size_t size){
+    void **slot = calloc(live, sizeof(void *));
+    unsigned seed = 1;
+    size_t cur = 0;
+    struct timespec t0, t1;
+    long k;
+    int s;
+
+    if (a->alloc == mm_malloc) {
+        mem_reset_brk();
+        if (mm_init() < 0) {
+            fprintf(stderr, "mm_init failed\n");
+            exit(1);
+        }
+    }
+    peak = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (k = 0; k < nops; k++) {
+        s = next_rand(&seed) % live;
+        if (slot[s] == NULL) {
+            if ((slot[s] = a->alloc(size)) == NULL) {
+                fprintf(stderr, "out of memory\n");
+                exit(1);
+            }
+            *(char *)slot[s] = 1;
+            if ((cur += size) > peak) peak = cur;
+        }
+        else {
+            a->release(slot[s]);
+            slot[s] = NULL;
+            cur -= size;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    for (s = 0; s < live; s++)
+        if (slot[s] != NULL)
+            a->release(slot[s]);
+    free(slot);
+
+    return nops / ((t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9) / 1e6;
+}
+
+int main(int argc, char **argv){
+    size_t i;
+
+    nops = argc > 1 ? atol(argv[1]) : 4000000;
+    live = argc > 2 ? atoi(argv[2]) : 20000;
+    mem_init();
+
+    printf("%6s %12s %12s %8s\n", "size", "mm Mops/s", "glibc Mops/s", "mm util");
+    for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double mm = run(&allocs[0], sizes[i]);
+        double util = 100.0 * peak / mem_heapsize();
+
+        printf("%6zu %12.2f %12.2f %7.1f%%\n", sizes[i], mm, run(&allocs[1], sizes[i]), util);
+    }
+    return 0;
+}
@@ -1,19 +1,19 @@
 /*
- * mm-naive.c - The fastest, least memory-efficient malloc package.
- * 
- * In this naive approach, a block is allocated by simply incrementing
- * the brk pointer.  A block is pure payload. There are no headers or
- * footers.  Blocks are never coalesced or reused. Realloc is
- * implemented directly using mm_malloc and mm_free.
+ * mm.c - segregated free list + arena + slab 기반 malloc package
  *
- * NOTE TO STUDENTS: Replace this header comment with your own header
- * comment that gives a high level description of your solution.
+ * 블록은 4 byte 헤더 (크기, 할당 비트, 이전 블록 할당 비트, arena 번호)를 가지고
+ * 풋터는 free block에만 둔다. free block은 크기 class별 리스트에 넣고 free 할 때 이웃과 병합한다.
+ * thread마다 arena를 배정해 lock을 나눠 잡고, SLAB_MAX 이하 요청은 page 단위 run의 slot으로,
+ * 자주 쓰는 작은 크기는 thread cache에서 lock 없이 준다.
+ * realloc은 이웃 free block이나 힙 끝으로 제자리에서 늘리고, 안 되면 힙 끝 쪽으로 옮긴다.
+ * 자세한 구조는 아래 각 구현의 주석 참고.
  */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
 #include <string.h>
+#include <pthread.h>
 
 #include "mm.h"
 #include "memlib.h"
@@ -35,7 +35,7 @@ team_t team = {
 #define ALIGNMENT 8
 #define WSIZE 4
 #define DSIZE (WSIZE*2) // block size는 항상 8의 배수이므로, 하위 3비트는 flag로 활용 가능
-#define MIN_BLOCK (DSIZE*2)
+#define MIN_BLOCK (DSIZE*2) // 헤더 + next/prev offset + free block의 풋터
 #define CHUNKSIZE (1<<13) // 초기 블록 & 힙 확장 기본 크기
 
 #define ALIGN(size) (((size) + (ALIGNMENT-1)) & ~0x7)
@@ -43,105 +43,298 @@ team_t team = {
 #define PACK(size, alloc) ((size) | (alloc)) // 크기와 할당 비트 통합
 #define GET(p) (*(unsigned int *)(p)) // p가 참조하는 워드 리턴
 #define PUT(p,val) (*(unsigned int *)(p) = (val)) // p가 참조하는 워드에 val 저장
-#define GET_SIZE(p) (GET(p) & ~0x7) // 헤더와 풋터에서 size만 리턴
+#define GET_SIZE(p) (GET(p) & SIZE_MASK) // 헤더와 풋터에서 size만 리턴
 #define GET_ALLOC(p) (GET(p) & 0x1) // 할당 비트만 리턴
 
+/*
+할당된 블록은 풋터 없이 헤더만 두고, 대신 다음 블록 헤더의 PREV_ALLOC 비트에 할당 여부를 적는다
+풋터는 free block에만 있으므로 PREV_BLKP는 PREV_ALLOC 비트가 0일 때만 쓸 수 있다
+*/
+#define PREV_ALLOC 0x2
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC) // 이전 블록 할당 비트만 리턴
+#define SET_PREV_ALLOC(p) PUT_HDR(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p) PUT_HDR(p, GET(p) & ~PREV_ALLOC)
+
+/*
+할당된 블록 헤더의 상위 ARENA_BITS 비트에는 블록이 속한 arena 번호를 적는다 (free 때 돌려줄 곳)
+chunk 하나를 MAX_BLOCK보다 작게 유지하므로 블록 크기가 이 비트까지 올라오지 않는다
+*/
+#define ARENA_BITS 4
+#define ARENA_SHIFT (32 - ARENA_BITS)
+#define MAX_BLOCK (1u << ARENA_SHIFT) // 256MB
+#define SIZE_MASK ((MAX_BLOCK - 1) & ~0x7)
+#define GET_ARENA(p) (GET(p) >> ARENA_SHIFT) // 할당된 블록의 arena 번호만 리턴
+#define PACK_ARENA(id) ((unsigned int)(id) << ARENA_SHIFT)
+
+/*
+할당된 블록 헤더의 PREV_ALLOC 비트는 앞 블록을 다루는 다른 thread가 arena lock을 잡고 바꿀 수 있다
+헤더를 쓰는 쪽은 항상 그 arena lock을 잡고 있으므로, 이웃 헤더의 비트는 원자적 store로만 바꾸고
+lock 없이 크기와 arena 번호를 볼 때는 (할당된 동안 바뀌지 않는다) 헤더를 원자적으로 한 번 읽는다
+*/
+#define PUT_HDR(p, val) __atomic_store_n((unsigned int *)(p), (val), __ATOMIC_RELAXED)
+#define GET_HDR(bp) __atomic_load_n((unsigned int *)HDRP(bp), __ATOMIC_RELAXED)
+
 #define HDRP(bp) ((char *)(bp)-WSIZE) // 블록 포인터 -> 블록 헤더 포인터 리턴
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE) // 블록 포인터 -> 블록 풋터 포인터
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE))) // 다음 블록 bp 리턴
-#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE))) // 이전 블록 bp 리턴
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE))) // 이전 블록 bp 리턴 (이전 블록이 free일 때만)
 
-void *extend_heap(size_t words); // 힙 부족 시, (words*4) 만큼 힙 확장
-static void *coalesce(void *bp); // free된 블록과 인접한 블록들을 병합
-static void *first_fit(size_t asize); // free block 탐색 방식 - first fit
-static void *next_fit(size_t asize);
-static void allocate(void *bp, size_t asize); // 블록을 할당하고, 필요시 분할
-int mm_check(void); // heap consistency 점검
-
-static char *heap_listp; // 첫 블럭 가리키는 포인터
-static void *last_fit = NULL;
-
-// ---- explicit free list 구현을 위한 변수, 매크로, 함수 ------
-static void *free_listp;
-#define NEXT(bp) (*(void **)(bp)) // free block 내부 next 포인터
-#define PREV(bp) (*(void **)((char *)(bp) +WSIZE)) // free block 내부 prev 포인터
-#define SET_PTR(p, val) (*(void **)(p) = (val)) // p 위치에 val 포인터 값 지정
+// ---- segregated free list 구현을 위한 매크로 ------
+/*
+ * free block은 크기에 따라 NUM_CLASSES개의 class 리스트로 나눠 관리한다
+ *   - SMALL_LIMIT 미만: 8 byte 간격으로 크기 하나당 class 하나 (16, 24, ..., 120 -> class 0~13)
+ *   - SMALL_LIMIT 이상: 2의 거듭제곱 구간을 2^SUB_BITS 등분 ([128,160), [160,192), ... -> class 14~62)
+ *   - 마지막 class에는 그보다 큰 블록을 모두 넣는다
+ * 비어 있지 않은 class는 seg_bitmap에 bit로 표시해 두고, 요청 크기의 class에 맞는 블록이 없으면
+ * 더 큰 class 중 첫 번째를 bitmap에서 바로 찾는다 (그 class의 블록은 모두 요청보다 크다)
+ * class head 배열과 bitmap은 arena마다 따로 있다 (arena 구조체는 힙 안에 둔다)
+ */
+#define NUM_CLASSES 64 // seg_bitmap의 bit 수
+#define SMALL_LIMIT 128
+#define SMALL_CLASSES (SMALL_LIMIT / DSIZE - 2)
+#define SUB_BITS 2
+#define FIT_SCAN 16 // 요청 크기의 class에서 first fit으로 살펴보는 최대 블록 수
 
-static void put_free_block(void *bp); // 리스트에 free block 삽입
-static void remove_free_block(void *bp); // 리스트에서 free block 제거
+/*
+free block 내부 next/prev는 포인터 대신 힙 시작(heap_base)으로부터의 4 byte offset으로 저장한다
+64-bit에서도 8 byte 포인터 두 개가 겹치거나 풋터를 덮지 않고, 최소 블록도 16 byte로 유지된다
+offset 0은 NULL (힙 맨 앞은 arena 표라 블록이 올 수 없다), 힙은 4GB를 넘지 않는다
+*/
+#define LINK(off) ((off) ? (void *)(heap_base + (off)) : NULL) // offset -> 블록 포인터
+#define OFFSET(bp) ((bp) ? (unsigned int)((char *)(bp) - heap_base) : 0) // 블록 포인터 -> offset
+#define NEXT(bp) LINK(GET(bp)) // free block 내부 next 블록
+#define PREV(bp) LINK(GET((char *)(bp) + WSIZE)) // free block 내부 prev 블록
+#define SET_NEXT(bp, p) PUT(bp, OFFSET(p))
+#define SET_PREV(bp, p) PUT((char *)(bp) + WSIZE, OFFSET(p))
+
+// ---- slab 구현을 위한 매크로 ------
+/*
+ * SLAB_MAX byte 이하 요청은 경계 태그 블록 대신 slab의 slot으로 준다 (slot 8, 16, ..., 64 -> class 0~7)
+ * run은 payload가 RUN_SIZE로 정렬된 RUN_SIZE byte짜리 경계 태그 블록으로, 맨 앞 run_t 뒤를 같은 크기
+ * slot으로 나눈다 (page의 마지막 워드는 다음 블록 헤더라 run끼리 빈틈 없이 이어 붙는다). slot에는 헤더가 없고 run의 bitmap 한 bit로 사용 여부만 센다
+ * 새 run은 앞에서부터 bump pointer로 나눠 주고, 끝까지 간 뒤에는 bitmap에서 빈 slot을 찾는다
+ * 포인터가 slot인지는 run_map (힙 page마다 1 bit, 64MB마다 leaf 하나를 필요할 때 만든다)으로 가리고,
+ * slot의 run은 주소를 RUN_SIZE로 내림하면 나온다
+ * 빈 slot이 있는 run은 arena의 class별 partial 리스트에 두고, 다 빈 run은 같은 class에 다른 run이
+ * 있으면 경계 태그 힙으로 돌려준다
+ */
+#define SLAB_MAX 64
+#define SLAB_CLASSES (SLAB_MAX / DSIZE)
+#define RUN_SHIFT 12
+#define RUN_SIZE (1 << RUN_SHIFT) // page 하나
+#define RUN_MAP_WORDS 8 // slot bitmap 워드 수 (8 byte slot도 RUN_SIZE / 8 = 512개 이하)
+#define RUN_SLOTS_BYTES (RUN_SIZE - WSIZE - RUN_HDR) // slot으로 나누는 크기
+#define LEAF_SHIFT 14 // leaf 하나가 2^14 page (64MB)
+#define LEAF_BYTES ((1 << LEAF_SHIFT) / 8)
+#define MAP_TOP (1 << (32 - RUN_SHIFT - LEAF_SHIFT)) // 4GB 힙까지의 leaf 수
+#define RUN_HDR ALIGN(sizeof(run_t)) // 첫 slot의 run 안 위치
+#define RUN_OF(p) ((run_t *)((unsigned long)(p) & ~(unsigned long)(RUN_SIZE - 1))) // slot -> run
+#define SLOT(r, i) ((char *)(r) + RUN_HDR + (size_t)(i) * (r)->slot) // run의 i번째 slot
+
+typedef struct run {
+    struct run *next, *prev; // class별 partial 리스트
+    unsigned short slot; // slot 크기
+    unsigned short nslots;
+    unsigned short nfree;
+    unsigned short bump; // 아직 한 번도 나눠 주지 않은 첫 slot
+    unsigned short hint; // 빈 slot이 있을 수 있는 첫 bitmap 워드
+    unsigned char cls;
+    unsigned char arena;
+    unsigned long long map[RUN_MAP_WORDS]; // bit i: slot i 사용 중 (nslots 뒤의 bit는 항상 1)
+} run_t;
+
+// ---- arena, thread cache 구현을 위한 변수, 매크로 ------
+/*
+ * thread마다 arena 하나를 round-robin으로 배정한다 (NUM_ARENAS보다 thread가 많으면 나눠 쓴다)
+ * arena는 자기 lock과 segregated free list, chunk 리스트를 가지고, 블록은 자기 arena 안에서만 병합된다
+ * chunk는 arena가 mem_sbrk로 받은 연속 영역으로, 처음 4 워드는 예전 mm_init의 힙 모양과 같다
+ *   [이전 chunk offset][prologue 헤더][prologue 풋터][블록들 ...][epilogue 헤더]
+ * 가장 최근 chunk가 sbrk 끝에 있으면 새 chunk 대신 그 chunk를 늘린다
+ *
+ * slab slot과 작은 블록(SMALL_LIMIT 미만)은 free해도 arena로 바로 돌려주지 않고 thread cache (tcache)에
+ * class마다 TCACHE_COUNT개까지 할당 상태 그대로 쌓아 두었다가, 같은 크기 malloc에 lock 없이 다시 준다
+ * (작은 블록 bin은 SLAB_MAX보다 큰 요청이 쓰는 BT_TC_MIN class부터만 둔다)
+ * 다른 arena의 블록이나 slot을 free할 때 그 arena lock이 잡혀 있으면 기다리지 않고 arena의 remote stack에
+ * CAS로 넣는다. remote stack은 그 arena lock을 잡고 malloc이나 free를 하는 thread가 통째로 꺼내서 free한다
+ * (주인 thread가 끝났거나 할당을 멈춘 arena도 다른 thread의 free가 비워 준다)
+ */
+#define NUM_ARENAS (1 << ARENA_BITS)
+#define TCACHE_COUNT 32
+#define BT_TC_MIN (ALIGN(SLAB_MAX + 1 + WSIZE) / DSIZE - 2) // malloc이 경계 태그로 요청하는 가장 작은 class
+#define TCACHE_BINS (SLAB_CLASSES + SMALL_CLASSES - BT_TC_MIN)
+#define BT_BIN(c) ((c) >= BT_TC_MIN && (c) < SMALL_CLASSES ? SLAB_CLASSES + (c) - BT_TC_MIN : -1) // 블록 class -> tcache bin
+
+typedef struct {
+    pthread_mutex_t lock;
+    int id;
+    unsigned long long seg_bitmap; // bit c: class c 리스트가 비어 있지 않음
+    void *seg_heads[NUM_CLASSES]; // class별 리스트 head
+    char *chunks; // 가장 최근 chunk (첫 워드에 그 이전 chunk offset)
+    char *top; // 가장 최근 chunk의 끝 (epilogue 헤더 다음)
+    void *remote; // 다른 thread가 free한 블록 stack (payload 첫 8 byte가 링크)
+    run_t *partial[SLAB_CLASSES]; // class별 빈 slot이 있는 run 리스트
+} arena_t;
+
+typedef struct {
+    void *bins[TCACHE_BINS]; // bin별 cache된 블록, slot stack (payload 첫 8 byte가 링크)
+    unsigned char count[TCACHE_BINS];
+} tcache_t;
+
+static char *heap_base; // 힙 시작, free list offset의 기준
+static arena_t **arenas; // 힙 맨 앞의 arena 표, arena는 처음 배정될 때 만든다
+static unsigned long long **run_map; // arena 표 뒤의 run_map leaf 표
+static unsigned long map_base; // heap_base의 page 번호
+static int next_arena; // 다음 thread에 배정할 arena
+static unsigned heap_gen; // mm_init마다 증가, 이전 힙을 가리키는 thread 상태를 버리는 데 쓴다
+static pthread_mutex_t sbrk_lock = PTHREAD_MUTEX_INITIALIZER; // mem_sbrk와 arena 생성
+static pthread_once_t tc_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tc_key; // thread 종료 시 tcache 반납
+
+static __thread int my_arena = -1; // 이 thread의 arena 번호
+static __thread tcache_t *tc; // 이 thread의 tcache (블록 하나로 arena에서 할당)
+static __thread unsigned my_gen; // my_arena, tc를 정한 힙
+
+static void *extend_heap(arena_t *a, size_t words); // arena 힙 부족 시, (words*4) 만큼 확장
+static void *coalesce(arena_t *a, void *bp); // free된 블록과 인접한 블록들을 병합
+static void *find_fit(arena_t *a, size_t asize); // 요청 크기의 class부터 free block 탐색
+static void allocate(arena_t *a, void *bp, size_t asize); // 블록을 할당하고, 필요시 분할
+static void *grow_block(arena_t *a, void *bp, size_t asize); // realloc에서 이웃 블록으로 늘리기
+static void trim_block(arena_t *a, void *bp, size_t asize); // 할당된 블록의 남는 뒷부분 반납
+int mm_check(void); // heap consistency 점검
+static int check_arena(arena_t *a);
+static int check_run(arena_t *a, run_t *r);
+
+static void put_free_block(arena_t *a, void *bp); // 리스트에 free block 삽입
+static void remove_free_block(arena_t *a, void *bp); // 리스트에서 free block 제거
+static int size_class(size_t size); // 블록 크기 -> class 번호
+
+static void check_gen(void); // 이전 힙의 thread 상태 버리기
+static arena_t *thread_arena(void); // 이 thread의 arena (처음이면 배정)
+static arena_t *get_arena(int id); // arena 표에서 찾고, 없으면 생성
+static void *arena_malloc(arena_t *a, size_t asize); // arena lock을 잡고 할당
+static void *arena_malloc_end(arena_t *a, size_t asize); // 힙 끝을 우선해서 할당 (realloc)
+static void free_block(arena_t *a, void *bp); // 블록을 arena로 반납
+static void remote_free(arena_t *a, void *bp); // 다른 arena의 remote stack에 반납
+static void drain_remote(arena_t *a); // remote stack의 블록들을 반납
+static void tcache_init(arena_t *a);
+static void tcache_flush(void *p); // thread 종료 시 tcache 반납
+static void make_tc_key(void);
+
+static int slab_class(size_t size); // 요청 크기 -> slab class 번호
+static int is_run(void *p); // p가 run 안 (slot)인지
+static int set_run_map(run_t *r, int on); // run_map에 run 표시/해제
+static void *slab_malloc(arena_t *a, int cls); // arena lock을 잡고 slot 할당
+static void slab_free(arena_t *a, run_t *r, void *p); // slot을 run으로 반납
+static run_t *new_run(arena_t *a, int cls);
+static void release_run(arena_t *a, run_t *r); // 빈 run을 경계 태그 힙으로 반납
+static void *alloc_run_block(arena_t *a); // RUN_SIZE로 정렬된 run 블록 할당
+static void link_run(arena_t *a, run_t *r); // partial 리스트에 삽입
+static void unlink_run(arena_t *a, run_t *r); // partial 리스트에서 제거
 
 /* 
  * mm_init - initialize the malloc package.
  */
 int mm_init(void)
 {
-    free_listp = NULL;
-    // 4 워드 짜리 새로운 힙 리스트를 생성
+    int i;
+
+    heap_gen++;
+    next_arena = 0;
+    pthread_once(&tc_once, make_tc_key);
+
+    // 힙 맨 앞에 arena 표 (크기가 8의 배수라 뒤따르는 블록 정렬은 그대로)
     // 실패시 -1 반환
-    if((heap_listp = mem_sbrk(4 * WSIZE)) == (void*)-1) return -1;
+    if((arenas = mem_sbrk(NUM_ARENAS * sizeof(arena_t *))) == (void*)-1) return -1;
+    heap_base = (char *)arenas;
+    for (i = 0; i < NUM_ARENAS; i++) arenas[i] = NULL;
 
-    PUT(heap_listp, 0); // 정렬 용 패딩
-    PUT(heap_listp+(1*WSIZE), PACK(DSIZE, 1)); //prologue 블럭의 헤더
-    PUT(heap_listp+(2*WSIZE), PACK(DSIZE, 1)); //prologue 블럭의 풋터
-    PUT(heap_listp+(3*WSIZE), PACK(0, 1)); //epilogue 블럭의 헤더
-    heap_listp += (2*WSIZE); //prologue의 payload
+    // 그 뒤에 run_map leaf 표 (leaf는 run이 처음 생길 때 만든다)
+    if((run_map = mem_sbrk(MAP_TOP * sizeof(unsigned long long *))) == (void*)-1) return -1;
+    map_base = (unsigned long)heap_base >> RUN_SHIFT;
+    for (i = 0; i < MAP_TOP; i++) run_map[i] = NULL;
 
-    // 힙 확장, 실패시 -1 리턴
-    if(extend_heap(CHUNKSIZE / WSIZE) == NULL) return -1;
+    // mm_init을 부른 thread가 arena 0을 쓴다, 첫 chunk 생성 실패시 -1 리턴
+    if (thread_arena() == NULL) return -1;
+    if (extend_heap(arenas[0], CHUNKSIZE / WSIZE) == NULL) return -1;
 
     return 0;
 }
 
 /* 
- * mm_malloc - Allocate a block by incrementing the brk pointer.
- *     Always allocate a block whose size is a multiple of the alignment.
+ * mm_malloc - tcache, slab, 이 thread arena의 free list 순으로 할당 (payload는 8 byte 정렬)
  */
 void *mm_malloc(size_t size)
 {
-   size_t asize; // 블록 사이즈 조정
-   size_t extendsize; // 힙 확징 사이즈
-   char *bp;
-
-   if (size == 0) return NULL;
-   if (size <= DSIZE) asize = MIN_BLOCK; // 블럭의 최소 크기
-   else asize = DSIZE * ((size + (DSIZE) + (DSIZE -1)) / DSIZE); // 블럭 크기 8의 배수로 정렬
-
-   if (free_listp != NULL && (unsigned long)free_listp < 0x1000) {
-       printf("Corrupted free_listp: %p\n", free_listp);
-       free_listp = NULL;
+   size_t asize = 0; // 블록 사이즈 조정
+   arena_t *a;
+   void *bp;
+   int b;
+
+   if (size == 0 || size > MAX_BLOCK - CHUNKSIZE) return NULL;
+   if ((a = thread_arena()) == NULL) return NULL;
+
+   if (size <= SLAB_MAX) b = slab_class(size);
+   else {
+    asize = MAX(ALIGN(size + WSIZE), MIN_BLOCK); // 헤더만 붙여 8의 배수로 정렬, 최소 블럭 크기 보장
+    b = BT_BIN(size_class(asize));
    }
 
-   if ((bp = first_fit(asize)) != NULL) {
-    allocate(bp, asize);
-    //assert(mm_check());
-    return bp;
+   // slot과 작은 블록은 tcache에 같은 크기가 있으면 lock 없이 꺼내 준다
+   if (b >= 0) {
+    if (tc == NULL) tcache_init(a);
+    if (tc != NULL && (bp = tc->bins[b]) != NULL) {
+        tc->bins[b] = *(void **)bp;
+        tc->count[b]--;
+        return bp;
+    }
    }
 
-   extendsize = MAX(asize, CHUNKSIZE);
-   if((bp = extend_heap(extendsize/WSIZE)) == NULL) return NULL;
-
-   allocate(bp, asize);
-   //assert(mm_check());
-   return bp;
+   return size <= SLAB_MAX ? slab_malloc(a, b) : arena_malloc(a, asize);
 }
 
 /*
- * mm_free - Freeing a block does nothing.
+ * mm_free - tcache에 쌓거나, 블록의 arena lock을 잡고 반납 (다른 arena lock이 잡혀 있으면 remote stack으로)
  */
 void mm_free(void *ptr)
 {
     if(ptr == NULL) return;
-    size_t size = GET_SIZE(HDRP(ptr));
+    check_gen(); // free만 하는 thread에게 arena를 만들어 주지 않는다
+
+    // slot이면 run에서, 아니면 헤더에서 bin과 arena를 읽는다 (둘 다 할당된 동안 바뀌지 않는다)
+    run_t *r = is_run(ptr) ? RUN_OF(ptr) : NULL;
+    int b, id;
+    if (r != NULL) {
+        b = r->cls;
+        id = r->arena;
+    }
+    else {
+        unsigned int header = GET_HDR(ptr);
+        b = BT_BIN(size_class(header & SIZE_MASK));
+        id = header >> ARENA_SHIFT;
+    }
 
-    PUT(HDRP(ptr), PACK(size,0));
-    PUT(FTRP(ptr), PACK(size,0));
+    // tcache에 쌓아 둔다 (할당 상태 그대로라 다른 arena 블록이어도 된다)
+    if (tc != NULL && b >= 0 && tc->count[b] < TCACHE_COUNT) {
+        *(void **)ptr = tc->bins[b];
+        tc->bins[b] = ptr;
+        tc->count[b]++;
+        return;
+    }
 
-    coalesce(ptr);
-    //assert(mm_check());
+    arena_t *a = arenas[id];
+    if (a->id == my_arena) pthread_mutex_lock(&a->lock);
+    else if (pthread_mutex_trylock(&a->lock) != 0) {
+        remote_free(a, ptr);
+        return;
+    }
+    drain_remote(a);
+    if (r != NULL) slab_free(a, r, ptr);
+    else free_block(a, ptr);
+    pthread_mutex_unlock(&a->lock);
 }
 
 /*
- * mm_realloc - Implemented simply in terms of mm_malloc and mm_free
+ * mm_realloc - 줄이면 뒷부분을 떼어 내고, 늘리면 grow_block으로 제자리에서, 안 되면 옮겨서 복사
  */
 void *mm_realloc(void *ptr, size_t size)
 {
@@ -150,221 +343,677 @@ void *mm_realloc(void *ptr, size_t size)
         mm_free(ptr);
         return NULL;
     }
+    if (size > MAX_BLOCK - CHUNKSIZE) return NULL;
 
-    size_t old_size = GET_SIZE(HDRP(ptr));
-    size_t new_size = ALIGN(size+DSIZE); // 새로 필요한 크기 올림 정렬
-    if(new_size < MIN_BLOCK) new_size = MIN_BLOCK;
+    // slot은 제자리에서 늘릴 수 없으므로 slot보다 커지면 옮긴다
+    if (is_run(ptr)) {
+        size_t slot = RUN_OF(ptr)->slot;
+        if (size <= slot) return ptr;
 
-    if (old_size >= new_size) {
-        return ptr;
+        void *newptr = mm_malloc(size);
+        if(newptr == NULL) return NULL;
+        memcpy(newptr, ptr, slot);
+        mm_free(ptr);
+        return newptr;
     }
 
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
-    size_t next_size = GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+    unsigned int header = GET_HDR(ptr);
+    size_t old_size = header & SIZE_MASK;
+    size_t new_size = MAX(ALIGN(size + WSIZE), MIN_BLOCK); // 새로 필요한 크기 올림 정렬
 
-    if(!next_alloc && (old_size + next_size) >= new_size){
-        remove_free_block(NEXT_BLKP(ptr));
-        size_t total_size = old_size+next_size;
-        PUT(HDRP(ptr), PACK(total_size, 1));
-        PUT(FTRP(ptr), PACK(total_size, 1));
+    // 이웃 블록은 ptr이 속한 arena의 free list에 있으므로 그 arena lock을 잡는다
+    arena_t *a = arenas[header >> ARENA_SHIFT];
+    void *bp;
+
+    // 줄일 때는 남는 뒷부분을 free block으로 돌려준다
+    if (old_size >= new_size) {
+        if (old_size - new_size >= MIN_BLOCK) {
+            pthread_mutex_lock(&a->lock);
+            trim_block(a, ptr, new_size);
+            pthread_mutex_unlock(&a->lock);
+        }
         return ptr;
     }
 
-    void *newptr = mm_malloc(size);
+    pthread_mutex_lock(&a->lock);
+    bp = grow_block(a, ptr, new_size);
+    pthread_mutex_unlock(&a->lock);
+    if (bp != NULL) return bp;
+
+    // 옮긴 블록은 앞으로도 늘어날 수 있으므로 되도록 힙 끝에 둔다
+    void *newptr;
+    if (size <= SLAB_MAX) newptr = mm_malloc(size);
+    else if ((a = thread_arena()) == NULL) return NULL;
+    else newptr = arena_malloc_end(a, new_size);
     if(newptr == NULL) return NULL;
 
-    size_t copySize = old_size - DSIZE; // 실제 payload 크기만
+    size_t copySize = old_size - WSIZE; // 실제 payload 크기만
     if (size < copySize) copySize = size;
     memcpy(newptr, ptr, copySize);
     mm_free(ptr);
-    //assert(mm_check());
     return newptr;
 }
 
-void *extend_heap(size_t words){
+// a->lock을 잡은 상태에서 호출
+static void *extend_heap(arena_t *a, size_t words){
     char *bp;
     size_t size;
 
     // 정렬 보장을 위해 항상 짝수개의 워드로
     size = (words%2) ? (words+1)*WSIZE : words*WSIZE;
 
-    if((long)(bp = mem_sbrk(size)) == -1) return NULL; // 힙 확장
+    pthread_mutex_lock(&sbrk_lock);
+    if (a->top != NULL && a->top == (char *)mem_heap_hi() + 1 && (size_t)(a->top + size - a->chunks) < MAX_BLOCK) {
+        // 가장 최근 chunk가 sbrk 끝에 있으면 이어서 늘린다 (이전 epilogue 자리가 새 블록 헤더)
+        if((long)(bp = mem_sbrk(size)) == -1) bp = NULL;
+    }
+    else if((long)(bp = mem_sbrk(size + 4*WSIZE)) == -1) bp = NULL;
+    else {
+        // 새 chunk의 머리: 이전 chunk offset, prologue, epilogue
+        PUT(bp, OFFSET(a->chunks));
+        PUT(bp+(1*WSIZE), PACK(DSIZE, 1)); //prologue 블럭의 헤더
+        PUT(bp+(2*WSIZE), PACK(DSIZE, 1)); //prologue 블럭의 풋터
+        PUT(bp+(3*WSIZE), PACK(0, PREV_ALLOC | 1)); //epilogue 블럭의 헤더 (앞의 prologue는 할당 상태)
+        a->chunks = bp;
+        bp += 4*WSIZE;
+    }
+    pthread_mutex_unlock(&sbrk_lock);
+    if (bp == NULL) return NULL;
 
     // 새로 할당한 블럭을 free block으로
-    PUT(HDRP(bp), PACK(size, 0)); // 헤더
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); // 헤더 (이전 epilogue의 PREV_ALLOC 비트 유지)
     PUT(FTRP(bp), PACK(size, 0)); // 풋터
     PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); // 새 epilogue 헤더
+    a->top = NEXT_BLKP(bp);
 
     // 이전 블럭이 free였다면 병합
-    return coalesce(bp);
+    return coalesce(a, bp);
 }
 
-static void *coalesce(void *bp){
-    size_t prev_alloc = 1;
+static void *coalesce(arena_t *a, void *bp){
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp)); // prologue는 할당 상태라 첫 블록도 그대로 검사
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
-    // prologue 블록 이후부터 검사
-    if ((char*)bp > (char*)heap_listp + DSIZE) {
-        prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    }
-
     if (prev_alloc && next_alloc) { // 앞 뒤 모두 할당
-        put_free_block(bp);
+        put_free_block(a, bp);
         return bp;
     }
     else if (prev_alloc && !next_alloc){ // 뒤만 free
-        remove_free_block(NEXT_BLKP(bp));
+        remove_free_block(a, NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
     }
     else if (!prev_alloc && next_alloc){ // 앞만 free
-        remove_free_block(PREV_BLKP(bp));
+        remove_free_block(a, PREV_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         bp = PREV_BLKP(bp);
     }
     else{
-        remove_free_block(PREV_BLKP(bp));
-        remove_free_block(NEXT_BLKP(bp));
+        remove_free_block(a, PREV_BLKP(bp));
+        remove_free_block(a, NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
         bp = PREV_BLKP(bp);
     }
-    PUT(HDRP(bp), PACK(size,0));
+    // free block끼리는 이어지지 않으므로 병합된 블록의 이전 블록은 항상 할당 상태
+    PUT(HDRP(bp), PACK(size, PREV_ALLOC));
     PUT(FTRP(bp), PACK(size,0));
-    put_free_block(bp);
+    put_free_block(a, bp);
 
     return bp;
 }
 
-static void *first_fit(size_t asize){
+/*
+요청 크기의 class는 크기가 섞여 있을 수 있으므로 앞에서부터 FIT_SCAN개까지 first fit으로 보고
+(크기가 하나뿐인 작은 class는 head가 바로 맞는다, 마지막 class는 더 큰 class가 없으니 끝까지 본다)
+없으면 더 큰 class 중 비어 있지 않은 첫 class의 head를 쓴다
+*/
+static void *find_fit(arena_t *a, size_t asize){
+    int c = size_class(asize);
+    int n = 0;
+    unsigned long long rest;
     void *bp;
 
-    if(free_listp == NULL) return NULL;
-
-    for (bp = free_listp; bp!= NULL; bp = NEXT(bp)){
-        if ((unsigned long)bp < 0x1000 || (unsigned long)bp > 0xffffffff) {
-            printf("Invalid free block pointer: %p\n", bp);
-            return NULL;
-        }
-
+    for (bp = a->seg_heads[c]; bp != NULL && (n < FIT_SCAN || c == NUM_CLASSES - 1); bp = NEXT(bp), n++){
         if(GET_SIZE(HDRP(bp)) >= asize) return bp;
     }
-    return NULL;
-}
-
-static void *next_fit(size_t asize){
-    void *bp;
-
-    if(last_fit == NULL || GET_ALLOC(HDRP(last_fit))) {
-        last_fit = free_listp;
-    }
+    if (c == NUM_CLASSES - 1) return NULL;
 
-    for (bp = last_fit; bp!= NULL; bp = NEXT(bp)){
-        if(!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= asize) {
-            last_fit = bp;
-            return bp;
-        }
-    }
-    for (bp = free_listp; bp != last_fit && bp!= NULL; bp = NEXT(bp)){
-        if(!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= asize) {
-            last_fit = bp;
-            return bp;
-        }
-    }
-    return NULL;
+    rest = a->seg_bitmap & (~0ULL << (c + 1));
+    if (rest == 0) return NULL;
+    return a->seg_heads[__builtin_ctzll(rest)];
 }
 
-static void allocate(void *bp, size_t asize){
+static void allocate(arena_t *a, void *bp, size_t asize){
     size_t cur_size = GET_SIZE(HDRP(bp));
-    remove_free_block(bp);
-
-    if (last_fit == bp) {
-        last_fit = NEXT(bp);
-    }
+    remove_free_block(a, bp);
     // 할당 후 남은 크기가 최소 블럭 사이즈보다 크다면 split
     if((cur_size - asize) >= (MIN_BLOCK)){
-        PUT(HDRP(bp), PACK(asize, 1));
-        PUT(FTRP(bp), PACK(asize, 1));
+        PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | PACK_ARENA(a->id) | 1));
         bp = NEXT_BLKP(bp);
-        PUT(HDRP(bp), PACK(cur_size-asize, 0));
+        PUT(HDRP(bp), PACK(cur_size-asize, PREV_ALLOC));
         PUT(FTRP(bp), PACK(cur_size-asize, 0));
-        put_free_block(bp);
+        put_free_block(a, bp);
     }
     else{
-        PUT(HDRP(bp), PACK(cur_size, 1));
-        PUT(FTRP(bp), PACK(cur_size, 1));
+        PUT(HDRP(bp), PACK(cur_size, GET_PREV_ALLOC(HDRP(bp)) | PACK_ARENA(a->id) | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
     }
 }
 
+/*
+할당된 블록을 옮기지 않거나 가까이 옮겨서 asize로 늘린다, 안 되면 NULL
+  1. 뒤 free block을 합쳐서 충분하면 제자리에서
+  2. 힙 끝 블록이면 (뒤 free block 다음이 epilogue여도) 모자란 만큼만 힙을 늘려서 제자리에서
+  3. 앞 free block까지 합쳐서 충분하면 payload를 앞으로 memmove
+합친 뒤 남는 부분은 다시 떼어 낸다. a->lock을 잡은 상태에서 호출
+*/
+static void *grow_block(arena_t *a, void *bp, size_t asize){
+    size_t size = GET_SIZE(HDRP(bp));
+    char *next = NEXT_BLKP(bp);
+    size_t next_size = GET_ALLOC(HDRP(next)) ? 0 : GET_SIZE(HDRP(next));
+    size_t prev_size = GET_PREV_ALLOC(HDRP(bp)) ? 0 : GET_SIZE(HDRP(PREV_BLKP(bp)));
+    char *end = next + next_size; // 뒤 free block 다음 블록
+    char *newbp = bp;
+
+    // extend_heap이 뒤 free block과 병합해 준다, 새 chunk가 생겼으면 (sbrk 끝이 아니었다) 3으로
+    if (size + next_size >= asize) ;
+    else if (GET_SIZE(HDRP(end)) == 0 && end == a->top
+             && extend_heap(a, MAX(asize - size - next_size, MIN_BLOCK) / WSIZE) == next)
+        next_size = GET_SIZE(HDRP(next));
+    else if (prev_size + size + next_size >= asize) newbp = PREV_BLKP(bp);
+    else return NULL;
+
+    if (next_size > 0) remove_free_block(a, next);
+    if (newbp != bp) {
+        remove_free_block(a, newbp); // payload를 덮기 전에 리스트에서 뺀다
+        memmove(newbp, bp, size - WSIZE);
+        size += prev_size;
+    }
+    size += next_size;
+    PUT(HDRP(newbp), PACK(size, GET_PREV_ALLOC(HDRP(newbp)) | PACK_ARENA(a->id) | 1));
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(newbp)));
+    trim_block(a, newbp, asize);
+
+    return newbp;
+}
+
+// 남는 크기가 MIN_BLOCK 이상이면 떼어 내서 free (뒤 free block과 병합된다), a->lock을 잡은 상태에서 호출
+static void trim_block(arena_t *a, void *bp, size_t asize){
+    size_t size = GET_SIZE(HDRP(bp));
+    char *rest;
+
+    if (size - asize < MIN_BLOCK) return;
+    PUT(HDRP(bp), PACK(asize, GET(HDRP(bp)) & ~SIZE_MASK)); // 할당, 이전 블록, arena 비트 유지
+    rest = NEXT_BLKP(bp);
+    PUT(HDRP(rest), PACK(size - asize, PREV_ALLOC | PACK_ARENA(a->id) | 1));
+    free_block(a, rest);
+}
+
+// 만들어진 arena를 하나씩 lock을 잡고 점검 (tcache, remote stack의 블록은 할당 상태로 보인다)
 int mm_check(void){
-    void *bp = NEXT_BLKP(heap_listp);
+    int i;
+
+    for (i = 0; i < NUM_ARENAS; i++) {
+        arena_t *a = __atomic_load_n(&arenas[i], __ATOMIC_ACQUIRE);
+        int ok;
+
+        if (a == NULL) continue;
+        pthread_mutex_lock(&a->lock);
+        ok = check_arena(a);
+        pthread_mutex_unlock(&a->lock);
+        if (!ok) return 0;
+    }
+    return 1;
+}
+
+static int check_arena(arena_t *a){
+    char *chunk;
+    void *bp;
     int free_count_heap = 0;
     int free_count_list = 0;
+    int partial_count_heap = 0;
+    int partial_count_list = 0;
+    int c;
 
-    while (GET_SIZE(HDRP(bp))>0){
-        size_t header = GET(HDRP(bp));
-        size_t footer = GET(FTRP(bp));
-        size_t alloc = GET_ALLOC(HDRP(bp));
-        size_t size = GET_SIZE(HDRP(bp));
+    for (chunk = a->chunks; chunk != NULL; chunk = LINK(GET(chunk))) {
+        size_t prev_alloc = PREV_ALLOC; // prologue
 
-        if ((size_t)bp % 8 != 0) {
-            printf("%p not alligned\n", bp);
-            return 0;
-        }
-        if (header != footer) {
-            printf("header %#x and footer %#x mismatch at %p\n", (unsigned)header, (unsigned)footer, bp);
-            return 0;
-        }
-        if (!alloc) {
-            free_count_heap++;
-            if (GET_SIZE(HDRP(NEXT_BLKP(bp))) > 0 && !GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
-                printf("ERROR: consecutive free blocks at %p and %p\n", bp, NEXT_BLKP(bp));
+        for (bp = chunk + 4*WSIZE; GET_SIZE(HDRP(bp))>0; bp = NEXT_BLKP(bp)){
+            size_t header = GET(HDRP(bp));
+            size_t alloc = GET_ALLOC(HDRP(bp));
+            size_t size = GET_SIZE(HDRP(bp));
+
+            if ((size_t)bp % 8 != 0) {
+                printf("%p not alligned\n", bp);
+                return 0;
+            }
+            if (size < MIN_BLOCK) {
+                printf("ERROR: block %p smaller than minimum (%u)\n", bp, (unsigned)size);
                 return 0;
             }
+            if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc) {
+                printf("ERROR: prev-alloc bit of %p does not match previous block\n", bp);
+                return 0;
+            }
+            if (alloc && GET_ARENA(HDRP(bp)) != (unsigned)a->id) {
+                printf("ERROR: block %p of arena %u found in arena %d\n", bp, GET_ARENA(HDRP(bp)), a->id);
+                return 0;
+            }
+            if (is_run(bp)) {
+                if (!alloc || !check_run(a, bp)) {
+                    printf("ERROR: bad run %p in arena %d\n", bp, a->id);
+                    return 0;
+                }
+                if (((run_t *)bp)->nfree > 0) partial_count_heap++;
+            }
+            // 풋터는 free block에만 있다
+            if (!alloc && GET(FTRP(bp)) != size) {
+                printf("header %#x and footer %#x mismatch at %p\n", (unsigned)header, (unsigned)GET(FTRP(bp)), bp);
+                return 0;
+            }
+            prev_alloc = alloc ? PREV_ALLOC : 0;
+            if (!alloc) {
+                free_count_heap++;
+                if (GET_SIZE(HDRP(NEXT_BLKP(bp))) > 0 && !GET_ALLOC(HDRP(NEXT_BLKP(bp)))) {
+                    printf("ERROR: consecutive free blocks at %p and %p\n", bp, NEXT_BLKP(bp));
+                    return 0;
+                }
+            }
+        }
+        if (GET_PREV_ALLOC(HDRP(bp)) != prev_alloc) {
+            printf("ERROR: prev-alloc bit of epilogue does not match last block\n");
+            return 0;
         }
-        bp = NEXT_BLKP(bp);
     }
 
-    for (bp = free_listp; bp != NULL; bp = NEXT(bp)) {
-        if ((unsigned long)bp < 0x1000) {
-            printf("ERROR: invalid free list pointer %p\n", bp);
+    for (c = 0; c < NUM_CLASSES; c++) {
+        void *prev = NULL;
+
+        if (((a->seg_bitmap >> c) & 1) != (a->seg_heads[c] != NULL)) {
+            printf("ERROR: bitmap bit %d does not match class list\n", c);
             return 0;
         }
-        if (GET_ALLOC(HDRP(bp))) {
-            printf("ERROR: allocated block %p in free list\n", bp);
-            return 0;
+        for (bp = a->seg_heads[c]; bp != NULL; bp = NEXT(bp)) {
+            if ((char *)bp <= heap_base || (char *)bp > (char *)mem_heap_hi()) {
+                printf("ERROR: invalid free list pointer %p in class %d\n", bp, c);
+                return 0;
+            }
+            if (GET_ALLOC(HDRP(bp))) {
+                printf("ERROR: allocated block %p in free list\n", bp);
+                return 0;
+            }
+            if (size_class(GET_SIZE(HDRP(bp))) != c) {
+                printf("ERROR: block %p (size %u) in class %d\n", bp, (unsigned)GET_SIZE(HDRP(bp)), c);
+                return 0;
+            }
+            if (PREV(bp) != prev) {
+                printf("ERROR: broken prev link at %p in class %d\n", bp, c);
+                return 0;
+            }
+            prev = bp;
+            free_count_list++;
         }
-        free_count_list++;
     }
 
     if (free_count_heap != free_count_list) {
-        printf("ERROR: free count mismatch - heap:%d, list:%d\n", 
-               free_count_heap, free_count_list);
+        printf("ERROR: free count mismatch in arena %d - heap:%d, list:%d\n",
+               a->id, free_count_heap, free_count_list);
+        return 0;
+    }
+
+    for (c = 0; c < SLAB_CLASSES; c++) {
+        run_t *r, *prev = NULL;
+
+        for (r = a->partial[c]; r != NULL; prev = r, r = r->next) {
+            if (!is_run(r) || r->cls != c || r->nfree == 0 || r->prev != prev) {
+                printf("ERROR: bad run %p in partial list %d\n", r, c);
+                return 0;
+            }
+            partial_count_list++;
+        }
+    }
+    if (partial_count_heap != partial_count_list) {
+        printf("ERROR: partial run count mismatch in arena %d - heap:%d, list:%d\n",
+               a->id, partial_count_heap, partial_count_list);
         return 0;
     }
     return 1;
 }
 
-static void put_free_block(void *bp){
-    // LIFO 방식을 사용하여 새로운 블럭을 가장 앞에 붙인다
-    NEXT(bp) = free_listp;
-    PREV(bp) = NULL;
+// run 헤더와 bitmap이 맞는지
+static int check_run(arena_t *a, run_t *r){
+    int i, used = 0;
+
+    if ((unsigned long)r % RUN_SIZE != 0 || GET_SIZE(HDRP(r)) < RUN_SIZE) return 0;
+    if (r->arena != a->id || r->cls >= SLAB_CLASSES || r->slot != (r->cls + 1) * DSIZE) return 0;
+    if (r->nslots != RUN_SLOTS_BYTES / r->slot || r->nfree > r->nslots || r->bump > r->nslots) return 0;
+    for (i = 0; i < RUN_MAP_WORDS; i++) used += __builtin_popcountll(r->map[i]);
+    return used - (RUN_MAP_WORDS * 64 - r->nslots) == r->nslots - r->nfree;
+}
+
+static void put_free_block(arena_t *a, void *bp){
+    int c = size_class(GET_SIZE(HDRP(bp)));
+
+    // LIFO 방식을 사용하여 새로운 블럭을 class 리스트 가장 앞에 붙인다
+    SET_NEXT(bp, a->seg_heads[c]);
+    SET_PREV(bp, NULL);
 
-    if (free_listp != NULL) PREV(free_listp) = bp;
+    if (a->seg_heads[c] != NULL) SET_PREV(a->seg_heads[c], bp);
 
-    free_listp = bp;
+    a->seg_heads[c] = bp;
+    a->seg_bitmap |= 1ULL << c;
 }
 
-static void remove_free_block(void *bp){
+// 헤더의 크기로 class를 찾으므로 크기를 바꾸기 전에 호출해야 한다
+static void remove_free_block(arena_t *a, void *bp){
     if(bp == NULL) return;
 
+    int c = size_class(GET_SIZE(HDRP(bp)));
     void *next = NEXT(bp);
     void *prev = PREV(bp);
 
-    if (prev != NULL) NEXT(prev) = next;
-    else free_listp = next;
+    if (prev != NULL) SET_NEXT(prev, next);
+    else if ((a->seg_heads[c] = next) == NULL) a->seg_bitmap &= ~(1ULL << c);
+
+    if (next != NULL) SET_PREV(next, prev);
+
+    SET_NEXT(bp, NULL);
+    SET_PREV(bp, NULL);
+}
+
+static int size_class(size_t size){
+    int fl, c;
+
+    if (size < SMALL_LIMIT) return size / DSIZE - 2;
+
+    fl = 63 - __builtin_clzll(size); // floor(log2(size)), 7 이상
+    c = SMALL_CLASSES + (fl - 7) * (1 << SUB_BITS) + ((size >> (fl - SUB_BITS)) & ((1 << SUB_BITS) - 1));
+    return c < NUM_CLASSES ? c : NUM_CLASSES - 1;
+}
+
+// mm_init으로 힙이 새로 만들어졌으면 이전 힙의 arena, tcache는 버린다
+static void check_gen(void){
+    if (my_gen != heap_gen) {
+        my_gen = heap_gen;
+        my_arena = -1;
+        tc = NULL;
+    }
+}
+
+static arena_t *thread_arena(void){
+    check_gen();
+    if (my_arena < 0) {
+        int id = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % NUM_ARENAS;
+
+        if (get_arena(id) == NULL) return NULL;
+        my_arena = id;
+    }
+    return arenas[my_arena];
+}
+
+static arena_t *get_arena(int id){
+    arena_t *a = __atomic_load_n(&arenas[id], __ATOMIC_ACQUIRE);
+    int c;
+
+    if (a != NULL) return a;
+
+    pthread_mutex_lock(&sbrk_lock);
+    if ((a = arenas[id]) == NULL && (a = mem_sbrk(ALIGN(sizeof(arena_t)))) != (void *)-1) {
+        pthread_mutex_init(&a->lock, NULL);
+        a->id = id;
+        a->seg_bitmap = 0;
+        for (c = 0; c < NUM_CLASSES; c++) a->seg_heads[c] = NULL;
+        a->chunks = a->top = NULL; // 첫 chunk는 처음 할당할 때 만든다
+        a->remote = NULL;
+        for (c = 0; c < SLAB_CLASSES; c++) a->partial[c] = NULL;
+        __atomic_store_n(&arenas[id], a, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&sbrk_lock);
+
+    return a == (void *)-1 ? NULL : a;
+}
+
+static void *arena_malloc(arena_t *a, size_t asize){
+    void *bp;
+
+    pthread_mutex_lock(&a->lock);
+    drain_remote(a);
+    if ((bp = find_fit(a, asize)) == NULL)
+        bp = extend_heap(a, MAX(asize, CHUNKSIZE) / WSIZE);
+    if (bp != NULL) allocate(a, bp, asize);
+    pthread_mutex_unlock(&a->lock);
+
+    return bp;
+}
+
+/*
+realloc에서 옮길 블록을 할당한다. 힙 끝 free block에 들어가면 그 앞쪽에 두어 다음부터 grow_block이
+힙을 늘려 이어 붙일 수 있게 하고, 아니면 find_fit, 그것도 없으면 힙 끝을 모자란 만큼만 늘린다
+*/
+static void *arena_malloc_end(arena_t *a, size_t asize){
+    char *bp = NULL;
+    size_t have = 0;
+
+    pthread_mutex_lock(&a->lock);
+    drain_remote(a);
+    // a->top은 가장 최근 chunk의 epilogue, 그 앞 블록이 free면 힙 끝 free block
+    if (a->top != NULL && !GET_PREV_ALLOC(HDRP(a->top))) {
+        bp = PREV_BLKP(a->top);
+        have = GET_SIZE(HDRP(bp));
+    }
+    if (have < asize && (bp = find_fit(a, asize)) == NULL) {
+        // 새 chunk가 생겨서 (sbrk 끝이 아니었다) 모자라면 asize만큼 다시 늘린다
+        if ((bp = extend_heap(a, MAX(asize - have, MIN_BLOCK) / WSIZE)) != NULL && GET_SIZE(HDRP(bp)) < asize)
+            bp = extend_heap(a, asize / WSIZE);
+    }
+    if (bp != NULL) allocate(a, bp, asize);
+    pthread_mutex_unlock(&a->lock);
+
+    return bp;
+}
+
+// a->lock을 잡은 상태에서 호출
+static void free_block(arena_t *a, void *bp){
+    size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size,0));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+
+    coalesce(a, bp);
+}
+
+static void remote_free(arena_t *a, void *bp){
+    void *head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+
+    do {
+        *(void **)bp = head;
+    } while (!__atomic_compare_exchange_n(&a->remote, &head, bp, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// a->lock을 잡은 상태에서 호출, 하나씩 pop하지 않고 통째로 가져오므로 ABA 문제가 없다
+static void drain_remote(arena_t *a){
+    void *bp, *next;
+
+    if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == NULL) return;
+
+    for (bp = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_ACQUIRE); bp != NULL; bp = next) {
+        next = *(void **)bp;
+        if (is_run(bp)) slab_free(a, RUN_OF(bp), bp);
+        else free_block(a, bp);
+    }
+}
+
+static void tcache_init(arena_t *a){
+    tcache_t *t = arena_malloc(a, MAX(ALIGN(sizeof(tcache_t) + WSIZE), MIN_BLOCK));
+
+    if (t == NULL) return;
+    memset(t, 0, sizeof(tcache_t));
+    pthread_setspecific(tc_key, t);
+    tc = t;
+}
+
+// tcache에 남은 블록과 tcache 자신을 arena로 돌려준다 (tcache를 반납하면서 자기 arena의 remote stack도 비운다)
+static void tcache_flush(void *p){
+    tcache_t *t = p;
+    void *bp;
+    int c;
+
+    if (t != tc || my_gen != heap_gen) return; // 그 사이 mm_init으로 힙이 바뀌었다
+    tc = NULL;
+    for (c = 0; c < TCACHE_BINS; c++) {
+        while ((bp = t->bins[c]) != NULL) {
+            t->bins[c] = *(void **)bp;
+            mm_free(bp);
+        }
+    }
+    mm_free(t);
+}
+
+static void make_tc_key(void){
+    pthread_key_create(&tc_key, tcache_flush);
+}
 
-    if (next != NULL) PREV(next) = prev;
+static int slab_class(size_t size){
+    return ALIGN(size) / DSIZE - 1;
+}
+
+static int is_run(void *p){
+    unsigned long pg = ((unsigned long)p >> RUN_SHIFT) - map_base;
+    unsigned long long *leaf = __atomic_load_n(&run_map[pg >> LEAF_SHIFT], __ATOMIC_ACQUIRE);
+
+    if (leaf == NULL) return 0;
+    pg &= (1 << LEAF_SHIFT) - 1;
+    return (__atomic_load_n(&leaf[pg / 64], __ATOMIC_RELAXED) >> (pg % 64)) & 1;
+}
 
-    NEXT(bp) = NULL;
-    PREV(bp) = NULL;
-}
\ No newline at end of file
+// 같은 워드의 다른 bit를 다른 arena가 동시에 바꿀 수 있으므로 원자적으로 바꾼다
+static int set_run_map(run_t *r, int on){
+    unsigned long pg = ((unsigned long)r >> RUN_SHIFT) - map_base;
+    unsigned long long **slot = &run_map[pg >> LEAF_SHIFT];
+    unsigned long long *leaf = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+
+    if (leaf == NULL) {
+        pthread_mutex_lock(&sbrk_lock);
+        if ((leaf = *slot) == NULL && (leaf = mem_sbrk(LEAF_BYTES)) != (void *)-1) {
+            memset(leaf, 0, LEAF_BYTES);
+            __atomic_store_n(slot, leaf, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&sbrk_lock);
+        if (leaf == (void *)-1) return -1;
+    }
+    pg &= (1 << LEAF_SHIFT) - 1;
+    if (on) __atomic_fetch_or(&leaf[pg / 64], 1ULL << (pg % 64), __ATOMIC_RELAXED);
+    else __atomic_fetch_and(&leaf[pg / 64], ~(1ULL << (pg % 64)), __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void *slab_malloc(arena_t *a, int cls){
+    run_t *r;
+    void *p = NULL;
+    int i, w;
+
+    pthread_mutex_lock(&a->lock);
+    drain_remote(a);
+    if ((r = a->partial[cls]) == NULL) r = new_run(a, cls);
+    if (r != NULL) {
+        if (r->bump < r->nslots) i = r->bump++;
+        else {
+            for (w = r->hint; r->map[w] == ~0ULL; w++)
+                ;
+            r->hint = w;
+            i = w * 64 + __builtin_ctzll(~r->map[w]);
+        }
+        r->map[i / 64] |= 1ULL << (i % 64);
+        if (--r->nfree == 0) unlink_run(a, r);
+        p = SLOT(r, i);
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    return p;
+}
+
+// a->lock을 잡은 상태에서 호출
+static void slab_free(arena_t *a, run_t *r, void *p){
+    int i = ((char *)p - SLOT(r, 0)) / r->slot;
+
+    r->map[i / 64] &= ~(1ULL << (i % 64));
+    if (i / 64 < r->hint) r->hint = i / 64;
+    if (r->nfree++ == 0) link_run(a, r); // 꽉 찼던 run은 다시 partial 리스트로
+
+    // 다 빈 run은 class의 마지막 run이 아니면 돌려준다 (run 하나를 두고 만들고 없애기를 반복하지 않게)
+    if (r->nfree == r->nslots && (a->partial[r->cls] != r || r->next != NULL)) release_run(a, r);
+}
+
+// a->lock을 잡은 상태에서 호출
+static run_t *new_run(arena_t *a, int cls){
+    run_t *r = alloc_run_block(a);
+    int i;
+
+    if (r == NULL) return NULL;
+    if (set_run_map(r, 1) < 0) {
+        free_block(a, r);
+        return NULL;
+    }
+    r->slot = (cls + 1) * DSIZE;
+    r->nslots = RUN_SLOTS_BYTES / r->slot;
+    r->nfree = r->nslots;
+    r->bump = r->hint = 0;
+    r->cls = cls;
+    r->arena = a->id;
+    memset(r->map, 0, sizeof(r->map));
+    for (i = r->nslots; i < RUN_MAP_WORDS * 64; i++) r->map[i / 64] |= 1ULL << (i % 64);
+    link_run(a, r);
+
+    return r;
+}
+
+// a->lock을 잡은 상태에서 호출
+static void release_run(arena_t *a, run_t *r){
+    unlink_run(a, r);
+    set_run_map(r, 0);
+    free_block(a, r);
+}
+
+/*
+payload가 RUN_SIZE로 정렬된 블록을 할당한다. 정렬 지점이 어디에 오든 들어가도록 RUN_SIZE만큼 큰
+free block을 찾고, 정렬 지점 앞의 자투리는 (MIN_BLOCK보다 작으면 한 page 뒤로 미뤄서) free block으로 남긴다
+a->lock을 잡은 상태에서 호출
+*/
+static void *alloc_run_block(arena_t *a){
+    size_t asize = RUN_SIZE;
+    size_t need = asize + RUN_SIZE + MIN_BLOCK;
+    size_t size, lead;
+    char *bp, *run;
+
+    if ((bp = find_fit(a, need)) == NULL && (bp = extend_heap(a, MAX(need, CHUNKSIZE) / WSIZE)) == NULL)
+        return NULL;
+
+    run = (char *)(((unsigned long)bp + RUN_SIZE - 1) & ~(unsigned long)(RUN_SIZE - 1));
+    if (run != bp && run - bp < MIN_BLOCK) run += RUN_SIZE;
+    if ((lead = run - bp) > 0) {
+        size = GET_SIZE(HDRP(bp));
+        remove_free_block(a, bp);
+        PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(lead, 0));
+        put_free_block(a, bp);
+        PUT(HDRP(run), PACK(size - lead, 0));
+        PUT(FTRP(run), PACK(size - lead, 0));
+        put_free_block(a, run);
+    }
+    allocate(a, run, asize);
+
+    return run;
+}
+
+static void link_run(arena_t *a, run_t *r){
+    r->prev = NULL;
+    if ((r->next = a->partial[r->cls]) != NULL) r->next->prev = r;
+    a->partial[r->cls] = r;
+}
+
+static void unlink_run(arena_t *a, run_t *r){
+    if (r->prev != NULL) r->prev->next = r->next;
+    else a->partial[r->cls] = r->next;
+    if (r->next != NULL) r->next->prev = r->prev;
+}